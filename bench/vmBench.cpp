@@ -0,0 +1,119 @@
+/*
+usage: nico_vm_bench [source].v [runs]
+throughput of the bytecode vm in both dispatch modes against walking the
+parse trees, over the same program run again and again on zeroed cells.
+nico programs have no loops, so a long one measures best, for example
+    python3 scripts/makeCorpus.py corpus.v 1
+    nico_vm_bench corpus.v 20
+every mode has to return the same status, otherwise it exits with failure
+*/
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+#include "sourceFile.h"
+#include "pipeline.h"
+#include "symbolTable.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "timing.h"
+
+//the library prints these, main.cpp defines them for nico
+std::ostream& operator<<(std::ostream& out, TokenType t){ return out << TokenTypeStrings[(int)t]; }
+std::ostream& operator<<(std::ostream& out, NodeType t){ return out << NodeTypeStrings[(int)t]; }
+std::ostream& operator<<(std::ostream& out, NodeSubType t){ return out << NodeSubTypeStrings[(int)t]; }
+
+struct Measurement{
+    int64_t status = 0;
+    uint64_t steps = 0;     //per run, nodes or instructions
+    double time = 0;        //ms over every run
+};
+
+static void report(const std::string& name, const char* unit, const Measurement& m, int runs, const Measurement& baseline){
+    double perRun = m.time / runs;
+    std::cout << name << ": " << m.steps << " " << unit << "/run, " << perRun << " ms/run, ";
+    std::cout << m.steps * (double)runs / (m.time / 1000.0) / 1e6 << " M " << unit << "/s";
+    if(&m != &baseline){
+        std::cout << ", " << baseline.time / m.time << "x the tree";
+    }
+    std::cout << "\n";
+}
+
+int main(int argc, const char* argv[]){
+    if(argc < 2){
+        std::cerr << "usage: nico_vm_bench [source].v [runs]\n";
+        return EXIT_FAILURE;
+    }
+    int runs = argc > 2 ? std::atoi(argv[2]) : 10;
+    if(runs < 1){
+        std::cerr << "runs expects a count of at least 1\n";
+        return EXIT_FAILURE;
+    }
+    SourceFile source;
+    if(!source.open(argv[1])){
+        std::cerr << "Failed to open file \"" << argv[1] << "\": " << source.err_s << "\n";
+        return EXIT_FAILURE;
+    }
+    PipelineResult parsed = lexAndParse(source.text);
+    if(!parsed.delimiters.success || !parsed.parseTree.success){
+        std::cerr << argv[1] << ": does not parse, check it with nico first\n";
+        return EXIT_FAILURE;
+    }
+
+    std::chrono::steady_clock::time_point compileStart = std::chrono::steady_clock::now();
+    BytecodeBuilder builder;
+    builder.lower(parsed.parseTree, parsed.tokens);
+    builder.finish();
+    double compileTime = millisecondsSince(compileStart);
+    if(!builder.success){
+        std::cerr << argv[1] << ":" << builder.lineNumber << ": " << builder.err_s << "\n";
+        return EXIT_FAILURE;
+    }
+    const Bytecode& program = builder.program;
+    std::cout << "source: " << parsed.parseTree.traces.size() << " statements, " << program.code.size() << " bytecode instructions compiled in " << compileTime << " ms\n";
+
+    Measurement tree;
+    for(int i = 0; i < runs; i++){
+        TreeWalker walker;
+        walker.cells.assign((size_t)globalSymbols().size() * VARIABLE_CELLS, 0);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        walker.run(parsed.parseTree, parsed.tokens);
+        tree.time += millisecondsSince(start);
+        if(!walker.success){
+            std::cerr << argv[1] << ":" << walker.lineNumber << ": " << walker.err_s << "\n";
+            return EXIT_FAILURE;
+        }
+        tree.status = walker.result.status;
+        tree.steps = walker.result.instructions;
+    }
+    report("tree", "nodes", tree, runs, tree);
+
+    bool agree = true;
+    std::vector<int64_t> cells(program.variables.size() * VARIABLE_CELLS);
+    for(VmDispatch dispatch : {VmDispatch::switched, VmDispatch::threaded}){
+        if(dispatch == VmDispatch::threaded && !threadedDispatchAvailable()){
+            std::cout << "threaded: not available, built without computed goto\n";
+            continue;
+        }
+        Measurement vm;
+        for(int i = 0; i < runs; i++){
+            std::fill(cells.begin(), cells.end(), 0);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            VmResult result = runBytecode(program, cells.data(), dispatch);
+            vm.time += millisecondsSince(start);
+            vm.status = result.status;
+            vm.steps = result.instructions;
+        }
+        report(VmDispatchStrings[(int)dispatch], "instructions", vm, runs, tree);
+        agree = agree && vm.status == tree.status;
+    }
+    std::cout << "returned " << tree.status << "\n";
+    if(!agree){
+        std::cerr << "the vm and the tree walker returned different statuses\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,75 @@
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+#include "token.h"
+#include "parseTree.h"
+
+//bumped whenever the entry layout, the lexer or the parser changes what an entry holds
+#define AST_CACHE_FORMAT 2
+
+/*
+on disk cache of lexed and parsed sources for --cache. an entry is one
+file in the cache directory, named by a hash of the source text, of
+the compiler that wrote it and of the depth limit it parsed with. it
+holds the token stream, the names its symbols had and the parse tree as
+the flat arrays TokenStream and NodeArena keep in memory, each at an
+offset from the start of the file. nothing in an entry is a pointer, so
+an entry is mapped and each array copied out as a whole: a warm build
+neither lexes nor parses, and decodes nothing per token or node.
+an entry also holds the source it came from, so a hash collision is a
+miss rather than the wrong tree, and a hash of all its bytes, so is an
+entry damaged on disk. only successful parses are stored
+*/
+
+enum class CacheArrayId : uint8_t{
+    source,
+    types,
+    offsets,
+    lengths,
+    payloads,
+    intLiterals,
+    newlines,
+    symbolEnds,     //end of each name in symbolText, by SymbolId when the entry was written
+    symbolText,
+    nodes,
+    children,
+    traces,         //root NodeId of each statement, the entry's trees are in one arena
+    COUNT
+};
+
+//count elements at offset bytes from the start of the entry, 8 byte aligned
+struct CacheArray{
+    uint64_t offset = 0;
+    uint64_t count = 0;
+};
+
+struct CacheHeader{
+    char magic[8];
+    uint32_t format;
+    uint32_t nodeSize;
+    uint64_t sourceHash;
+    uint64_t compiler;
+    uint64_t checksum;          //of the header with this 0 and everything after it
+    ParseStats stats;
+    CacheArray arrays[(int)CacheArrayId::COUNT];
+};
+
+struct AstCache{
+    std::string dir;
+    int maxDepth = DEFAULT_MAX_PARSE_DEPTH;     //a tree parsed under one limit may be too deep for another
+    std::string err_s = "";
+    uint64_t sourceHash = 0;
+    uint64_t bytes = 0;         //size of the entry loaded or stored
+
+    //tokens and parseTree as they were parsed from source, false on a miss
+    bool load(std::string_view source, TokenStream& tokens, parseTreeReturn& parseTree);
+    //writes the entry for a successful parse of source, false with err_s when it could not be written
+    bool store(std::string_view source, const TokenStream& tokens, const parseTreeReturn& parseTree);
+    std::string path() const;
+};
+
+#endif
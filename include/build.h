@@ -0,0 +1,70 @@
+#ifndef BUILD_H
+#define BUILD_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "parseTree.h"
+#include "codegen.h"
+
+/*
+many files compiled to assembly in one process, for several sources on
+the command line or --manifest. every file is compiled on its own, start
+to finish on one thread of a work stealing pool, with its own symbol
+table, see SymbolScope, so files share nothing while they build and the
+assembly is the same as compiling each file alone.
+what a file reports is kept with it and printed in input order once the
+build is done, so the output does not depend on which thread got which file
+*/
+
+struct BuildJob{
+    std::string source;
+    std::string target;
+
+    //filled in by buildFiles
+    bool success = false;
+    std::string out;            //diagnostics the default path prints to stdout, led by the file name
+    std::string err;            //and to stderr
+    uint64_t bytes = 0;
+    uint64_t tokens = 0;
+    uint64_t statements = 0;
+    double time = 0;            //ms, start to finish of this file
+};
+
+struct BuildOptions{
+    int threads = 1;            //files compiled at once, each file is parsed on one
+    ParseOptions parse;
+    bool optimize = true;
+    bool verifyIr = false;
+    RegisterAllocator allocator = RegisterAllocator::linear;
+    std::string cacheDir;       //--cache, empty without
+};
+
+struct BuildStats{
+    uint64_t files = 0;
+    uint64_t failed = 0;
+    uint64_t bytes = 0;
+    uint64_t tokens = 0;
+    uint64_t statements = 0;
+    int threads = 0;
+    double time = 0;            //ms, the whole build
+    double fileTime = 0;        //ms, sum over files
+
+    void print() const;
+};
+
+//[source].v with .v replaced by .S, or .S appended when it does not end in .v
+std::string defaultTarget(std::string_view source);
+
+/*
+a manifest lists one file per line, "source.v" or "source.v target.S".
+blank lines and lines starting with # are skipped, relative paths are
+relative to the directory of the manifest
+*/
+bool readManifest(const char* path, std::vector<BuildJob>& jobs, std::string& err_s);
+
+BuildStats buildFiles(std::vector<BuildJob>& jobs, const BuildOptions& options);
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "token.h"
+#include "parseTree.h"
+#include "ir.h"
+
+/*
+register bytecode for interpreting programs without assembling them,
+lowered straight from parse trees and run by vm.h, with the semantics
+documented in ir.h. registers are temporaries of the statement being
+run, variables live in one flat array of cells, VARIABLE_CELLS per
+variable in the order they were first used
+*/
+enum class BcOp : uint8_t{
+    CONST,      //a = c as int32
+    CONSTW,     //a = constants[c]
+    LOAD,       //a = cells[c]
+    STORE,      //cells[c] = a
+    LOADX,      //a = cells[c + (b & VARIABLE_CELLS-1)]
+    STOREX,     //cells[c + (b & VARIABLE_CELLS-1)] = a
+    MOVE,       //a = b
+    INDEX,      //a = b * ARRAY_ROW_CELLS + c, the row major cell of a[b][c]
+    ADD,        //a = b op c, c a register
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    AND,
+    OR,
+    SHL,
+    SHR,
+    EQ,
+    NE,
+    LT,
+    GT,
+    LE,
+    GE,
+    NOT,        //a = b == 0
+    TRUTH,      //a = b != 0
+    INC,        //a = b + 1
+    DEC,        //a = b - 1
+    JMP,        //to instruction c
+    JZ,         //to instruction c when a is 0
+    JNZ,        //to instruction c when a is not 0
+    RETURN,     //ends the program with status a
+};
+
+const std::string BcOpStrings[] = {
+    "const",
+    "constw",
+    "load",
+    "store",
+    "loadx",
+    "storex",
+    "move",
+    "index",
+    "add",
+    "sub",
+    "mul",
+    "div",
+    "mod",
+    "and",
+    "or",
+    "shl",
+    "shr",
+    "eq",
+    "ne",
+    "lt",
+    "gt",
+    "le",
+    "ge",
+    "not",
+    "truth",
+    "inc",
+    "dec",
+    "jmp",
+    "jz",
+    "jnz",
+    "return",
+};
+
+//12 bytes, a and b are registers, c a register, cell, constant or jump target
+struct BcInst{
+    BcOp op;
+    uint16_t a = 0;
+    uint16_t b = 0;
+    uint32_t c = 0;
+};
+
+struct Bytecode{
+    std::vector<BcInst> code;
+    std::vector<int64_t> constants;     //that do not fit in c
+    std::vector<SymbolId> variables;    //by variable index, its cells start at index * VARIABLE_CELLS
+    uint32_t registers = 0;             //most any statement needs
+
+    void print() const;
+};
+
+//a lowered variable: its cell, or with indexed its first cell and the index in the frame's base register
+struct BcAddress{
+    uint32_t cell;
+    bool indexed;
+};
+
+//one node being compiled, see BytecodeBuilder::statement
+struct BcFrame{
+    NodeId node;
+    uint8_t step = 0;       //where the node resumes once its child is compiled
+    bool address = false;   //variables only, produce the cell instead of loading it
+    uint32_t base;          //first register the node may use, its result goes there
+    uint32_t jump = 0;      //&& and ||, the branch around the right side
+};
+
+/*
+compiles parse trees into code, a statement at a time, ending in a
+return 0 once finished. a node leaves its value in its base register,
+so a statement's registers are used like a stack
+*/
+struct BytecodeBuilder : TreeReader{
+    Bytecode program;
+    uint64_t statements = 0;
+    std::vector<BcFrame> frames;
+    std::vector<BcAddress> addresses;       //of variables lowered in address mode, used as a stack
+    std::vector<uint32_t> variableIndex;    //by SymbolId, UINT32_MAX until first used
+
+    bool lower(const parseTreeReturn&, const TokenStream&);
+    void finish();
+    void statement(NodeId);
+};
+
+#endif
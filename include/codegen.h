@@ -0,0 +1,43 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "ir.h"
+#include "regalloc.h"
+#include "x86.h"
+
+/*
+x86-64 linux backend, AT&T syntax for GNU as, linked with a plain ld.
+it implements the semantics documented in ir.h.
+programs are appended to text, which the caller can take and clear
+between calls, so a file can be compiled in chunks. with machineCode
+the same instructions are encoded into code instead, for jit.h
+*/
+struct CodeGenerator{
+    std::string text;
+    RegisterAllocator allocator = RegisterAllocator::linear;
+    bool machineCode = false;
+    MachineCode code;
+    std::vector<uint8_t> used;  //indexed by SymbolId, variables that need storage
+    uint32_t labels = 0;
+    uint32_t slots = 0;         //most spill slots any program needed, they are shared
+    uint64_t instructions = 0;  //emitted so far
+    uint64_t values = 0;        //that needed a register or slot
+    uint64_t spilled = 0;       //of those, left in a slot
+
+    //state of the program being emitted
+    const IrProgram* program = nullptr;
+    Allocation allocation;
+    uint32_t blockBase = 0;     //label of block 0
+
+    void begin(std::string_view sourceName);
+    void emit(const IrProgram&);
+    //variable and slot storage, call once after the last emit, false when machine code can not be linked
+    bool finish(std::string& err_s);
+};
+
+#endif
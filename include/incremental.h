@@ -0,0 +1,116 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+#include "token.h"
+#include "parseTree.h"
+#include "ir.h"
+#include "optimize.h"
+#include "codegen.h"
+
+/*
+incremental compilation to assembly for --watch. the source is split
+after every ';' and each statement is lexed, parsed, lowered, optimized
+and emitted as a unit of its own, the way --stream compiles a chunk.
+units are cached by a hash of their tokens, so only statements whose
+tokens changed are compiled again, the rest reuse their tree and
+assembly. the new source is compared against the last one, statements
+wholly before the first changed byte or after the last one are kept
+without being looked at, so a rebuild costs the edit plus copying the
+output together rather than the file.
+statements are compiled apart, so unlike a full build loads are not
+reused and registers are not allocated across them
+*/
+
+const uint32_t NO_UNIT = UINT32_MAX;
+
+//a compiled statement, shared by every statement with the same tokens
+struct StatementUnit{
+    uint64_t hash = 0;
+    std::string source;         //the statement's text, tokens point into it
+    TokenStream tokens;
+    parseTreeReturn parseTree;
+    std::string assembly;       //without line comments, the build adds them
+    std::vector<SymbolId> variables;    //whose storage the assembly uses
+    uint32_t slots = 0;
+    int lineDelta = -1;         //line of its code minus line of its first token, -1 without a line
+    bool labelled = false;      //has branches, so its labels may appear once per output
+    uint32_t users = 0;         //statements of the current build using it
+    uint64_t released = 0;      //build in which users last dropped to 0
+};
+
+//a statement of the last build, the bytes [start, end) of its source, end is past the ';'
+struct BuiltStatement{
+    uint32_t start;
+    uint32_t end;
+    int line;                   //of start
+    int row;                    //lines from start to the first token
+    uint32_t unit = NO_UNIT;    //NO_UNIT when it failed to compile
+};
+
+struct IncrementalStats{
+    uint64_t statements = 0;
+    uint64_t reused = 0;        //kept or found in the cache
+    uint64_t compiled = 0;
+    uint64_t bytesLexed = 0;
+    uint64_t tokensLexed = 0;
+    uint64_t units = 0;         //cached after the build
+    double diffTime = 0;        //finding the changed range, lexing it and looking it up, ms
+    double compileTime = 0;     //parsing through codegen of statements not in the cache
+    double linkTime = 0;        //putting the output together
+    OptimizeStats optimize;
+
+    void print() const;
+};
+
+/*
+one file's builds. update takes the whole new source each time and
+leaves the program in assembly, or the errors the default path would
+report for it. the unit cache outlives any one build, so undoing an
+edit reuses what the edit replaced
+*/
+struct IncrementalBuild{
+    bool optimize = true;
+    RegisterAllocator allocator = RegisterAllocator::linear;
+    ParseOptions parse;         //set before the first update, cached units were parsed with it
+
+    //result of the last update
+    bool success = true;
+    std::string assembly;
+    bool delimiterError = false;
+    std::string delimiterErr_s = "";
+    int delimiterLine = -1;
+    TokenType delimiterToken = TokenType::NULLTOKEN;
+    std::vector<ParseDiagnostic> diagnostics;   //one per statement that failed to parse
+    std::string err_s = "";                     //first statement that failed to lower
+    int lineNumber = -1;
+    IncrementalStats stats;
+
+    //last source and how it split
+    std::string text;
+    std::vector<BuiltStatement> statements;
+    uint32_t tailStart = 0;     //bytes after the last ';', never compiled, only checked for delimiters
+    int tailLine = 1;
+    uint64_t builds = 0;
+
+    std::vector<std::unique_ptr<StatementUnit>> units;    //null once evicted
+    std::vector<uint32_t> freeUnits;
+    std::unordered_multimap<uint64_t, uint32_t> unitsByHash;
+    std::vector<uint32_t> released;     //units whose last user went away, evicted a build later if still unused
+    uint32_t failed = 0;                //statements without a unit
+    uint32_t labels = 0;                //next label, labels are never reused so units can be mixed freely
+    std::string exitAssembly;
+
+    IrBuilder builder;
+    CodeGenerator codegen;
+
+    bool update(std::string_view source, std::string_view sourceName);
+};
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef IR_H
+#define IR_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "token.h"
+#include "parseTree.h"
+
+/*
+the semantics every lowering of a program commits to:
+  - every value is a 64 bit signed integer, + - * and << wrap around
+  - x / 0 and x % 0 are 0, INT64_MIN / -1 wraps to INT64_MIN
+  - shift counts are taken mod 64, >> is arithmetic
+  - comparisons, !, && and || give 0 or 1, && and || short circuit
+  - operands are evaluated left to right
+  - every variable is a zeroed global array of VARIABLE_CELLS cells. a
+    plain name is cell 0, a[i][j] is cell i*ARRAY_ROW_CELLS + j, and the
+    cell index wraps mod VARIABLE_CELLS
+  - assignments, prefix ++ and -- give the value stored, postfix the old one
+  - return exits with its value as the status, the end of the file exits 0
+*/
+#define VARIABLE_CELLS 4096
+#define ARRAY_ROW_CELLS 64
+
+typedef uint32_t ValueId;
+typedef uint32_t BlockId;
+const ValueId NO_VALUE = UINT32_MAX;
+const BlockId NO_BLOCK = UINT32_MAX;
+
+enum class IrType : uint8_t{
+    none,
+    i64,
+    addr,
+};
+
+const std::string IrTypeStrings[] = {
+    "none",
+    "i64",
+    "addr",
+};
+
+enum class IrOp : uint8_t{
+    CONST,
+    ADDR,
+    LOAD,
+    STORE,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    AND,
+    OR,
+    SHL,
+    SHR,
+    EQ,
+    NE,
+    LT,
+    GT,
+    LE,
+    GE,
+    PHI,
+    JMP,
+    BR,
+    EXIT,
+};
+
+const std::string IrOpStrings[] = {
+    "const",
+    "addr",
+    "load",
+    "store",
+    "add",
+    "sub",
+    "mul",
+    "div",
+    "mod",
+    "and",
+    "or",
+    "shl",
+    "shr",
+    "eq",
+    "ne",
+    "lt",
+    "gt",
+    "le",
+    "ge",
+    "phi",
+    "jmp",
+    "br",
+    "exit",
+};
+
+/*
+an instruction defines the value named by its own index, so operands are
+indices into IrProgram::insts. what each op reads:
+  const         imm
+  addr          imm SymbolId, a masked cell index or NO_VALUE for cell 0
+  load          a address
+  store         a address, b value
+  add .. ge     a, b
+  phi           a first entry of IrProgram::phiArgs, b entry count
+  jmp           b target
+  br            a condition, taken to b when nonzero and to c when zero
+  exit          a status
+*/
+struct IrInst{
+    IrOp op;
+    IrType type = IrType::none;
+    uint32_t a = NO_VALUE;
+    uint32_t b = NO_VALUE;
+    uint32_t c = NO_VALUE;
+    int64_t imm = 0;
+};
+
+//instructions [first, end) of IrProgram::insts
+struct IrBlock{
+    uint32_t first = 0;
+    uint32_t end = 0;
+};
+
+struct PhiArg{
+    BlockId block;  //predecessor the value comes from
+    ValueId value;
+};
+
+//first instruction lowered from the statement on line
+struct IrLine{
+    uint32_t inst;
+    int line;
+};
+
+/*
+SSA form of a program, or of one chunk of a streamed one, as flat arrays.
+a block is a contiguous run of insts, blocks are laid out in order and
+every branch goes forward, so layout order is a topological order of the
+control flow graph and a value's live range is an interval of positions.
+variables live in memory, so phis only come from && and ||.
+the last block stays open while statements are appended, finish() in
+IrBuilder ends it with the program exit
+*/
+struct IrProgram{
+    std::vector<IrInst> insts;
+    std::vector<IrBlock> blocks;
+    std::vector<PhiArg> phiArgs;
+    std::vector<IrLine> lines;
+    bool finished = false;
+
+    ValueId add(IrOp, IrType, uint32_t a=NO_VALUE, uint32_t b=NO_VALUE, uint32_t c=NO_VALUE, int64_t imm=0);
+    ValueId constant(int64_t);
+    //ends the current block where it is and opens an empty one after it
+    BlockId startBlock();
+    BlockId current() const { return (BlockId)blocks.size() - 1; }
+    uint32_t size() const { return (uint32_t)insts.size(); }
+    void print() const;
+    //frees every instruction and block, keeping capacity
+    void clear();
+};
+
+bool isTerminator(IrOp);
+//stores and terminators, every other instruction can go if its value is unused
+bool hasSideEffects(IrOp);
+bool isCommutative(IrOp);
+//whether a and b name value operands, phis read theirs from IrProgram::phiArgs
+bool readsA(const IrInst&);
+bool readsB(const IrInst&);
+//add through ge applied to two known operands, with the semantics above
+int64_t evaluate(IrOp, int64_t a, int64_t b);
+
+//each value's live range [start, end] in instruction positions, start is NO_VALUE for instructions without a value
+struct LiveInterval{
+    uint32_t start = NO_VALUE;
+    uint32_t end = 0;
+};
+
+/*
+a phi's range starts at the first terminator of its predecessors, where
+its incoming values are copied in, and a phi argument is used there
+*/
+std::vector<LiveInterval> liveIntervals(const IrProgram&);
+
+//checks the invariants above, false with err_s naming the first instruction that breaks one
+bool verifyIr(const IrProgram&, std::string& err_s);
+
+/*
+dominance with the layout order as a topological order: a reachable
+block's immediate dominator comes before it, so one forward pass finds
+every idom, and preorder numbers over the dominator tree answer
+dominates() in constant time. unreachable blocks dominate only themselves
+*/
+struct Dominators{
+    std::vector<BlockId> idom;
+    std::vector<uint32_t> pre;
+    std::vector<uint32_t> size;
+
+    bool dominates(BlockId a, BlockId b) const {
+        if(a == b){ return true; }
+        if(idom[a] == NO_BLOCK || idom[b] == NO_BLOCK){ return false; }
+        return pre[a] <= pre[b] && pre[b] < pre[a] + size[a];
+    }
+};
+
+Dominators dominators(const std::vector<std::vector<BlockId>>& preds);
+//indexed by block, the blocks whose terminator branches to it
+std::vector<std::vector<BlockId>> predecessors(const IrProgram&);
+
+//one node being lowered, see IrBuilder::statement
+struct IrFrame{
+    NodeId node;
+    uint8_t step = 0;       //where the node resumes once its child is lowered
+    bool address = false;   //variables only, produce the cell address instead of loading it
+    BlockId block = NO_BLOCK;
+    ValueId value = NO_VALUE;
+    uint32_t branch = NO_VALUE;
+};
+
+/*
+lowers parse trees into program, a statement at a time. the caller may
+take and clear the program between calls, the next statement then
+starts a new block that follows the old ones in layout
+*/
+struct IrBuilder : TreeReader{
+    IrProgram program;
+    uint64_t statements = 0;
+    std::vector<IrFrame> frames;
+    std::vector<ValueId> values;    //results of lowered nodes, used as a stack
+
+    //appends every statement of a successful parse, false once a statement cannot be lowered
+    bool lower(const parseTreeReturn&, const TokenStream&);
+    //ends the program with exit 0, call once after the last lower
+    void finish();
+    void statement(NodeId);
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <string>
+#include <cstdint>
+
+#include "x86.h"
+
+/*
+runs linked machine code in process for --run. the code is copied into
+an anonymous mapping that is made read and execute only, the data area
+after it stays read write and starts zeroed like .bss. the program is
+called as a function and its EXIT returns the status instead of ending
+the process
+*/
+struct JitProgram{
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    std::string err_s = "";
+
+    JitProgram() = default;
+    JitProgram(const JitProgram&) = delete;
+    JitProgram& operator=(const JitProgram&) = delete;
+    ~JitProgram();
+
+    bool load(const MachineCode&);
+    //the status of the EXIT that ended the program
+    int64_t run();
+};
+
+#endif
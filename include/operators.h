@@ -0,0 +1,176 @@
+#ifndef OPERATORS_H
+#define OPERATORS_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+#include "token.h"
+
+//stored as the payload of BINARY_OPERATOR and UNARY_OPERATOR tokens
+enum class Operator : uint8_t{
+    PLUS,
+    MINUS,
+    STAR,
+    SLASH,
+    PERCENT,
+    ASSIGN,
+    LESS,
+    GREATER,
+    PLUS_ASSIGN,
+    MINUS_ASSIGN,
+    STAR_ASSIGN,
+    SLASH_ASSIGN,
+    PERCENT_ASSIGN,
+    EQUAL,
+    LESS_EQUAL,
+    GREATER_EQUAL,
+    NOT_EQUAL,
+    AND,
+    OR,
+    SHIFT_LEFT,
+    SHIFT_RIGHT,
+    BIT_AND,
+    BIT_OR,
+    INCREMENT,
+    DECREMENT,
+    NOT,
+    NONE
+};
+
+const std::string OperatorStrings[] = {
+    "+", "-", "*", "/", "%", "=", "<", ">",
+    "+=", "-=", "*=", "/=", "%=", "==", "<=", ">=",
+    "!=", "&&", "||", "<<", ">>", "&", "|",
+    "++", "--", "!",
+    "NONE",
+};
+
+//stored as the payload of RESERVED tokens
+enum class Keyword : uint8_t{
+    RETURN,
+    NONE
+};
+
+const std::string KeywordStrings[] = {
+    "return",
+    "NONE",
+};
+
+struct LexemeEntry{
+    std::string_view text;
+    uint8_t value;      //Operator or Keyword
+    TokenType type;
+};
+
+//the RESERVED and operator sets of definitions.txt, & and | are lexed as well
+constexpr LexemeEntry operatorEntries[] = {
+    {"+", (uint8_t)Operator::PLUS, TokenType::BINARY_OPERATOR},
+    {"-", (uint8_t)Operator::MINUS, TokenType::BINARY_OPERATOR},
+    {"*", (uint8_t)Operator::STAR, TokenType::BINARY_OPERATOR},
+    {"/", (uint8_t)Operator::SLASH, TokenType::BINARY_OPERATOR},
+    {"%", (uint8_t)Operator::PERCENT, TokenType::BINARY_OPERATOR},
+    {"=", (uint8_t)Operator::ASSIGN, TokenType::BINARY_OPERATOR},
+    {"<", (uint8_t)Operator::LESS, TokenType::BINARY_OPERATOR},
+    {">", (uint8_t)Operator::GREATER, TokenType::BINARY_OPERATOR},
+    {"+=", (uint8_t)Operator::PLUS_ASSIGN, TokenType::BINARY_OPERATOR},
+    {"-=", (uint8_t)Operator::MINUS_ASSIGN, TokenType::BINARY_OPERATOR},
+    {"*=", (uint8_t)Operator::STAR_ASSIGN, TokenType::BINARY_OPERATOR},
+    {"/=", (uint8_t)Operator::SLASH_ASSIGN, TokenType::BINARY_OPERATOR},
+    {"%=", (uint8_t)Operator::PERCENT_ASSIGN, TokenType::BINARY_OPERATOR},
+    {"==", (uint8_t)Operator::EQUAL, TokenType::BINARY_OPERATOR},
+    {"<=", (uint8_t)Operator::LESS_EQUAL, TokenType::BINARY_OPERATOR},
+    {">=", (uint8_t)Operator::GREATER_EQUAL, TokenType::BINARY_OPERATOR},
+    {"!=", (uint8_t)Operator::NOT_EQUAL, TokenType::BINARY_OPERATOR},
+    {"&&", (uint8_t)Operator::AND, TokenType::BINARY_OPERATOR},
+    {"||", (uint8_t)Operator::OR, TokenType::BINARY_OPERATOR},
+    {"<<", (uint8_t)Operator::SHIFT_LEFT, TokenType::BINARY_OPERATOR},
+    {">>", (uint8_t)Operator::SHIFT_RIGHT, TokenType::BINARY_OPERATOR},
+    {"&", (uint8_t)Operator::BIT_AND, TokenType::BINARY_OPERATOR},
+    {"|", (uint8_t)Operator::BIT_OR, TokenType::BINARY_OPERATOR},
+    {"++", (uint8_t)Operator::INCREMENT, TokenType::UNARY_OPERATOR},
+    {"--", (uint8_t)Operator::DECREMENT, TokenType::UNARY_OPERATOR},
+    {"!", (uint8_t)Operator::NOT, TokenType::UNARY_OPERATOR},
+};
+
+constexpr LexemeEntry keywordEntries[] = {
+    {"return", (uint8_t)Keyword::RETURN, TokenType::RESERVED},
+};
+
+/*
+perfect hash over a fixed set of lexemes, built entirely at compile time.
+a key is the length, first and last character, which is the whole text
+of a one or two character operator, mixed by a multiplier searched for
+until no two entries share a slot. lookup is one multiply and a key
+compare, longer lexemes also compare their text
+*/
+constexpr uint32_t lexemeKey(std::string_view s){
+    return (uint32_t)s.size() | ((uint32_t)(unsigned char)s.front() << 8) | ((uint32_t)(unsigned char)s.back() << 16);
+}
+
+template<size_t SLOTS>
+struct LexemeTable{
+    static_assert((SLOTS & (SLOTS - 1)) == 0, "slot count must be a power of two");
+    uint32_t seed = 0; //0 when no collision free multiplier was found
+    int8_t slots[SLOTS] = {};
+    uint32_t keys[SLOTS] = {};
+
+    constexpr uint32_t slot(uint32_t key) const {
+        return ((key * seed) >> 16) & (SLOTS - 1);
+    }
+};
+
+template<size_t SLOTS, size_t N>
+constexpr LexemeTable<SLOTS> makeLexemeTable(const LexemeEntry (&entries)[N]){
+    LexemeTable<SLOTS> table;
+    for(uint32_t seed = 0x9E3779B1u; seed < 0x9E3779B1u + 200000u; seed += 2){
+        table.seed = seed;
+        for(size_t i = 0; i < SLOTS; i++){ table.slots[i] = -1; }
+        bool collision = false;
+        for(size_t i = 0; i < N && !collision; i++){
+            uint32_t key = lexemeKey(entries[i].text);
+            uint32_t s = table.slot(key);
+            if(table.slots[s] != -1){
+                collision = true;
+            } else {
+                table.slots[s] = (int8_t)i;
+                table.keys[s] = key;
+            }
+        }
+        if(!collision){
+            return table;
+        }
+    }
+    table.seed = 0;
+    return table;
+}
+
+constexpr LexemeTable<128> operatorTable = makeLexemeTable<128>(operatorEntries);
+constexpr LexemeTable<16> keywordTable = makeLexemeTable<16>(keywordEntries);
+static_assert(operatorTable.seed != 0, "no perfect hash for the operator set, grow the table");
+static_assert(keywordTable.seed != 0, "no perfect hash for the keyword set, grow the table");
+
+//entry for s, nullptr if s is not in the table
+template<size_t SLOTS, size_t N>
+inline const LexemeEntry* lookupLexeme(const LexemeTable<SLOTS>& table, const LexemeEntry (&entries)[N], std::string_view s){
+    uint32_t key = lexemeKey(s);
+    uint32_t h = table.slot(key);
+    int8_t i = table.slots[h];
+    if(i < 0 || table.keys[h] != key){
+        return nullptr;
+    }
+    if(s.size() > 2 && entries[i].text != s){
+        return nullptr;
+    }
+    return &entries[i];
+}
+
+inline const LexemeEntry* lookupOperator(std::string_view s){
+    return lookupLexeme(operatorTable, operatorEntries, s);
+}
+
+inline const LexemeEntry* lookupKeyword(std::string_view s){
+    return lookupLexeme(keywordTable, keywordEntries, s);
+}
+
+#endif
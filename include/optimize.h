@@ -0,0 +1,54 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include <string>
+#include <cstdint>
+
+#include "ir.h"
+
+//what the passes did, summed over every program they ran on
+struct OptimizeStats{
+    uint64_t folded = 0;        //instructions computed at compile time
+    uint64_t simplified = 0;    //instructions replaced by an operand or a cheaper instruction
+    uint64_t branches = 0;      //conditional branches with a known condition
+    uint64_t reused = 0;        //instructions replaced by an earlier one computing the same value
+    uint64_t removed = 0;       //instructions dropped as dead or unreachable
+    uint64_t before = 0;        //instructions in and out of optimizeIr
+    uint64_t after = 0;
+    double time = 0;            //ms
+
+    void print() const;
+};
+
+/*
+constant folding and algebraic simplification, in one forward pass that
+rebuilds the program. operations on known operands are evaluated with
+the semantics in ir.h, identities like x+0, x*1 and x&-1 give their
+operand, x*2^k becomes a shift, constant chains like (x+1)+2 are
+combined and constants move to the right operand, where the backend
+takes them as immediates. branches on known conditions become jumps,
+phis left with one incoming value are replaced by it, blocks nothing
+reaches are dropped and a jump to a block with no other predecessor is
+merged into it
+*/
+void foldConstants(IrProgram&, OptimizeStats&);
+
+/*
+global value numbering. a constant, address, arithmetic instruction or
+load that computes the same value as one in a dominating position is
+replaced by it, so repeated index expressions like a[b[1][2]][3] are
+computed once. a load is only reused while no store that could write
+its cell lies on any path in between: stores through a computed cell
+may write any cell of the variable, stores to a constant cell only that
+one. a store also makes its value what the next load of the address
+reads. instructions are left in place, dead code elimination drops them
+*/
+void numberValues(IrProgram&, OptimizeStats&);
+
+//drops every instruction without side effects whose value is never used
+void eliminateDeadCode(IrProgram&, OptimizeStats&);
+
+//every pass in order, with verify the program is checked after each one and false means err_s names the pass that broke it
+bool optimizeIr(IrProgram&, OptimizeStats&, bool verify, std::string& err_s);
+
+#endif
@@ -3,17 +3,74 @@
 
 #include <vector>
 #include <memory>
+#include <cstdint>
 
 #include "token.h"
 
+typedef uint32_t NodeId;
+const NodeId NO_NODE = UINT32_MAX;
+const uint32_t NO_TOKEN = UINT32_MAX;
+
+struct NodeArena;
+
+//16 bytes, children are the range [firstChild, firstChild+childCount) of NodeArena::children
 struct Node{
     NodeType type;
     NodeSubType subtype = NodeSubType::none;
-    std::shared_ptr<Token> token = nullptr;
-    std::vector<std::shared_ptr<Node>> children = {};
+    uint32_t token = NO_TOKEN; //index into the TokenStream the tree was parsed from
+    uint32_t firstChild = 0;
+    uint32_t childCount = 0;
     Node(NodeType _type);
-    Node(NodeType _type, std::shared_ptr<Token>);
-    void print(int depth=0);
+    Node(NodeType _type, uint32_t _token);
+    void print(const NodeArena&, const TokenStream&, int depth=0) const;
+    void printLine(const TokenStream&, int depth) const;
+};
+
+/*
+contiguous pool for every node of a parse, addressed by 32 bit NodeId.
+a node's children are written to the shared children array in one go
+when the node is created, so the tree is built bottom up
+*/
+struct NodeArena{
+    std::vector<Node> nodes;
+    std::vector<NodeId> children;
+    NodeId add(NodeType, uint32_t token=NO_TOKEN);
+    NodeId add(NodeType, NodeSubType, uint32_t token, const NodeId* kids, uint32_t count);
+    Node& at(NodeId id){ return nodes[id]; }
+    const Node& at(NodeId id) const { return nodes[id]; }
+    NodeId child(NodeId id, uint32_t i) const { return children[nodes[id].firstChild + i]; }
+    void reserve(size_t);
+    //frees the whole tree, every NodeId handed out so far becomes invalid
+    void clear();
+};
+
+//line of the leftmost token under id, -1 if it has none
+int nodeLine(const NodeArena&, const TokenStream&, NodeId id);
+//operand nodes only wrap the node that computes the value
+NodeId unwrapOperand(const NodeArena&, NodeId id);
+//operator of the token of node's kid-th child
+Operator childOperator(const NodeArena&, const TokenStream&, NodeId node, uint32_t kid);
+
+/*
+the trees a pass over them reads and the first error it reports, shared
+by IrBuilder, BytecodeBuilder and TreeWalker
+*/
+struct TreeReader{
+    bool success = true;
+    std::string err_s = "";
+    int lineNumber = -1;
+
+    const TokenStream* tokens = nullptr;
+    const NodeArena* arena = nullptr;
+
+    //stops the pass with message at the line of id
+    void fail(NodeId id, const std::string& message){
+        success = false;
+        err_s = message;
+        lineNumber = nodeLine(*arena, *tokens, id);
+    }
+    NodeId unwrap(NodeId id) const { return unwrapOperand(*arena, id); }
+    Operator operatorOf(NodeId node, uint32_t kid) const { return childOperator(*arena, *tokens, node, kid); }
 };
 
 enum class ErrorType{
@@ -34,22 +91,193 @@ const std::string ErrorTypeStrings[] = {
     "NONE",
 };
 
+//one entry per parse function, used to index ParseStats::calls
+enum class ParseRule{
+    statement,
+    expression,
+    unary,
+    operand,
+    parentheses,
+    function_call,
+    argument,
+    variable,
+    value,
+    COUNT
+};
+
+const std::string ParseRuleStrings[] = {
+    "statement",
+    "expression",
+    "unary",
+    "operand",
+    "parentheses",
+    "function_call",
+    "argument",
+    "variable",
+    "value",
+};
+
+enum class ParseMessage{
+    MAX_DEPTH,
+    UNEXPECTED_EOF,
+    EMPTY_STATEMENT,
+    BAD_RETURN_VALUE,
+    TOKEN_AFTER_RETURN,
+    EXPECTED_SEMI,
+    BAD_BINARY_OPERAND,
+    EXPECTED_OPERAND,
+    BAD_PREFIX_OPERAND,
+    NO_OPERAND,
+    NO_OPEN_PARENTH,
+    MISSING_CLOSE_PARENTH,
+    EMPTY_PARENTHESES,
+    BAD_PARENTHESES,
+    TOKEN_IN_PARENTHESES,
+    EXPECTED_COMMA,
+    BAD_ARGUMENT,
+    EXPECTED_IDENTIFIER,
+    MISSING_CLOSE_BRACKET,
+    BAD_INDEX,
+    TOKEN_IN_INDEX,
+    EXPECTED_INT_LITERAL,
+};
+
+const std::string ParseMessageStrings[] = {
+    "Maximum parse depth exceeded",
+    "Unexpected end of statement",
+    "Empty statement",
+    "Bad return value",
+    "Unexpected token after return value",
+    "Unexpected token, expected ;",
+    "bad 2nd operand of binary operator",
+    "Expected operand",
+    "bad operand of prefix operator",
+    "No valid operand found",
+    "No open parenth",
+    "Missing closing parenthesis",
+    "Empty parentheses",
+    "Bad inner parentheses statement",
+    "Unexpected token in parentheses",
+    "Expected , between arguments",
+    "Bad function argument",
+    "Expected Identifier",
+    "Missing Closing Bracket",
+    "Malformed array index",
+    "Unexpected token in array index",
+    "Expected INT_LITERAL",
+};
+
+const uint32_t NO_ERROR = UINT32_MAX;
+
+/*
+what a failing rule records instead of building a message. a rule that
+fails because a sub rule failed points at that record through cause, so
+every failed statement leaves one chain ending at the original error
+*/
+struct ParseError{
+    ErrorType type;
+    ParseMessage message;
+    ParseRule rule;
+    uint32_t token;
+    uint32_t cause = NO_ERROR;
+};
+
 struct StackTrace{
-    std::shared_ptr<Node> node;
+    NodeId node = NO_NODE;
     bool success = false;
+    uint32_t error = NO_ERROR; //index into ParseState::errors
+    uint32_t arena = 0;        //index into parseTreeReturn::arenas holding node
+    StackTrace();
+    StackTrace(NodeId);
+};
+
+//human readable ParseError chain, only built for statements that failed
+struct ParseDiagnostic{
     ErrorType errType = ErrorType::NONE;
     std::string err_s = "";
-    std::vector<std::shared_ptr<StackTrace>> children = {};
-    StackTrace();
-    StackTrace(std::shared_ptr<Node>);
-    StackTrace(ErrorType, std::string);
+    int lineNumber = -1;
+    std::vector<ParseDiagnostic> children = {};
+    ParseDiagnostic() = default;
+    ParseDiagnostic(ParseDiagnostic&&) = default;
+    ParseDiagnostic& operator=(ParseDiagnostic&&) = default;
+    ParseDiagnostic(const ParseDiagnostic&) = default;
+    ParseDiagnostic& operator=(const ParseDiagnostic&) = default;
+    ~ParseDiagnostic();
+    void print(int depth=0, std::ostream& out=std::cout) const;
+};
+
+struct ParseStats{
+    long long calls[(int)ParseRule::COUNT] = {};
+    long long tokens = 0;
+    long long totalCalls() const;
+    void add(const ParseStats&);
+    void print() const;
+};
+
+//one rule waiting on the rule it called, see parseStatementRange
+struct ParseFrame{
+    ParseRule rule;
+    uint8_t step = 0;       //where the rule resumes when its callee returns
+    int minPrec = 0;        //expression only
+    uint32_t end = 0;       //end of the rule's token range
+    uint32_t position = 0;  //operator or name token
+    uint32_t close = 0;     //matching close delimiter of the range being parsed
+    uint32_t base = 0;      //scratch size when the rule started
+    NodeId node = NO_NODE;  //left hand side or value built so far
+};
+
+//default limit on open rules, deep enough for 100k nested parentheses at 5 rules each
+#define DEFAULT_MAX_PARSE_DEPTH 1000000
+
+struct ParseOptions{
+    int threads = 1;
+    int maxDepth = DEFAULT_MAX_PARSE_DEPTH;
+};
+
+//everything a parse function needs besides its token range, one per parsing thread
+struct alignas(64) ParseState{
+    ParseStats stats;
+    const TokenStream* tokens = nullptr;
+    //delimiter match table from matchDelimiters
+    const std::vector<int>* match = nullptr;
+    NodeArena* arena = nullptr;
+    //children of nodes under construction, used as a stack
+    std::vector<NodeId> scratch;
+    //reused across statements, only failed statements keep their records
+    std::vector<ParseError> errors;
+    //explicit rule stack, grows with nesting depth instead of the native stack
+    std::vector<ParseFrame> frames;
+    int maxDepth = DEFAULT_MAX_PARSE_DEPTH;
 };
 
 struct parseTreeReturn{
+    //one per parsing thread, a statement's nodes all live in the arena its trace names
+    std::vector<NodeArena> arenas;
     std::vector<StackTrace> traces;
     bool success = true;
+    //one per failed statement, empty when success is true
+    std::vector<ParseDiagnostic> diagnostics;
+    ParseStats stats;
+
+    const NodeArena& arenaOf(const StackTrace& trace) const { return arenas[trace.arena]; }
 };
 
-parseTreeReturn createParseTree(std::vector<Token>&);
+//threads > 1 parses statements in parallel, the result is identical for any thread count
+parseTreeReturn createParseTree(const TokenStream&, const std::vector<int>&, const ParseOptions& options=ParseOptions());
+
+/*
+single threaded parse of a token stream that is still growing, each
+advance() parses the statements completed since the last call.
+tokens and match must only grow, and not while advance() runs
+*/
+struct ParseStream{
+    parseTreeReturn ret;
+    std::vector<ParseState> states;
+    uint32_t lineStart = 0;
+    uint32_t scanned = 0;  //tokens already searched for SEMI
+    void begin(const TokenStream* tokens, const std::vector<int>* match, int maxDepth=DEFAULT_MAX_PARSE_DEPTH);
+    void advance();
+    parseTreeReturn finish();
+};
 
 #endif
\ No newline at end of file
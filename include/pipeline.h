@@ -0,0 +1,20 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <string_view>
+
+#include "token.h"
+#include "tokenize.h"
+#include "parseTree.h"
+
+//same results as tokenize, matchDelimiters and createParseTree run one after another
+struct PipelineResult{
+    TokenStream tokens;
+    DelimiterMatch delimiters;
+    parseTreeReturn parseTree;
+};
+
+//options.threads is ignored, the parser runs on the calling thread
+PipelineResult lexAndParse(std::string_view source, const ParseOptions& options=ParseOptions());
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "ir.h"
+
+enum class RegisterAllocator : uint8_t{
+    naive,      //every value in a spill slot
+    linear,     //linear scan over the registers, spilling what does not fit
+};
+
+const std::string RegisterAllocatorStrings[] = {
+    "naive",
+    "linear",
+};
+
+const uint8_t NO_REGISTER = UINT8_MAX;
+
+//where each value of a program lives, registers are numbered 0 to the count the allocator was given
+struct Allocation{
+    std::vector<uint8_t> reg;       //indexed by ValueId, NO_REGISTER for values in a slot
+    std::vector<uint32_t> slot;     //indexed by ValueId, only meaningful without a register
+    uint32_t slots = 0;
+    uint64_t values = 0;            //values that needed a location
+    uint64_t spilled = 0;           //of those, left in a slot
+};
+
+//needs is indexed by ValueId, the values that have to be kept somewhere
+Allocation allocateNaive(const IrProgram&, const std::vector<uint8_t>& needs);
+
+/*
+linear scan in order of interval start. an operand's register is free
+again at its last use, so an instruction's result can take the register
+of an operand it consumes, which is tried first: the backend then works
+in place instead of moving. with no register free, whichever of the new
+interval and the active ones has the lowest spill weight, uses per
+instruction of its interval, goes to a slot for its whole interval.
+
+a phi's register is live from the top of its block and written at the
+end of each predecessor, so it only needs to be free at those copies,
+not over the blocks laid out in between. a phi prefers the register of
+an incoming value that dies at its copy, which makes that copy vanish
+*/
+Allocation allocateLinear(const IrProgram&, const std::vector<uint8_t>& needs, uint8_t registers);
+
+#endif
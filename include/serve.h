@@ -0,0 +1,93 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+#include "symbolTable.h"
+#include "incremental.h"
+
+//bumped whenever the messages below change
+#define SERVE_PROTOCOL 2
+
+/*
+compile server for --serve, and the client side of it for --connect.
+the server listens on a unix socket and builds each request with the
+statement cache of --watch, see incremental.h: every source it is asked
+for keeps a session with its own symbol table and IncrementalBuild
+between requests, so building a file again compiles only statements
+whose tokens changed since the last request for it, and an unchanged
+file only has its output put together.
+requests for different files are built at once on the server's threads,
+requests for the same file wait for each other.
+
+a message is a run of fields, each a ServeField tag, a 32 bit length and
+that many bytes, ended by ServeField::end. all numbers are native endian,
+both ends are on the same machine. a request with an unknown tag or a
+field over its limit is answered with the reason in err
+*/
+
+enum class ServeField : uint32_t{
+    end,
+    protocol,       //SERVE_PROTOCOL, first in every request
+    path,           //request: file the server reads the source from
+    text,           //request: the source itself, instead of path
+    name,           //request: the source's name in diagnostics and the assembly
+    options,        //request: optimize and allocator, a byte each, then the parse depth limit in 32 bits
+    status,         //response: the exit status a local compile would have had
+    out,            //response: what a local compile with -q prints to stdout
+    err,            //response: and to stderr
+    assembly,       //response: the target, only on success
+    COUNT
+};
+
+struct ServeRequest{
+    std::string path;
+    std::string text;
+    std::string name;
+    bool optimize = true;
+    RegisterAllocator allocator = RegisterAllocator::linear;
+    int32_t maxDepth = DEFAULT_MAX_PARSE_DEPTH;
+};
+
+struct ServeResponse{
+    int status = 1;
+    std::string out;
+    std::string err;
+    std::string assembly;
+};
+
+//one source the server has built, named by its path, or its name when sent inline
+struct ServeSession{
+    std::mutex lock;
+    SymbolTable symbols;        //the build's SymbolIds are ids in this table
+    IncrementalBuild build;
+    uint64_t used = 0;          //request that last used it, the least recent goes first
+};
+
+struct CompileServer{
+    std::string socketPath;
+    int threads = 1;
+    bool log = false;           //a line on stdout per request
+    std::string err_s = "";
+
+    int listenFd = -1;
+    std::mutex lock;            //guards sessions, requests and logging
+    std::unordered_map<std::string, std::shared_ptr<ServeSession>> sessions;
+    uint64_t requests = 0;
+
+    //binds socketPath, false with err_s when it is in use or can not be bound
+    bool listen();
+    //serves on threads threads until the process is stopped
+    void run();
+    ServeResponse handle(const ServeRequest&);
+};
+
+//sends request to the server at socketPath and waits for its response, false with err_s when that failed
+bool requestCompile(const char* socketPath, const ServeRequest& request, ServeResponse& response, std::string& err_s);
+
+#endif
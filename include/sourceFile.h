@@ -0,0 +1,31 @@
+#ifndef SOURCEFILE_H
+#define SOURCEFILE_H
+
+#include <string>
+#include <string_view>
+
+/*
+the bytes of a source file, mapped read only when the file is a regular
+file, otherwise (pipes, failed mmap) read once into buffer.
+text views whichever one holds the bytes and stays valid until the
+SourceFile is destroyed, nothing is copied on the mapped path
+*/
+struct SourceFile{
+    std::string_view text;
+    bool mapped = false;
+    bool success = true;
+    std::string err_s = "";
+
+    std::string buffer;          //fallback storage
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+
+    SourceFile() = default;
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+    ~SourceFile();
+
+    bool open(const char* path);
+};
+
+#endif
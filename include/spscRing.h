@@ -0,0 +1,41 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <thread>
+#include <cstddef>
+
+/*
+bounded lock free queue between exactly one producer and one consumer
+thread. slots are reused in place, the producer fills acquire() and
+hands it over with publish(), the consumer reads front() and gives it
+back with release(). both sides yield while the ring is full or empty
+*/
+template<typename T, size_t N>
+struct SpscRing{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "ring size must be a power of two");
+    T slots[N];
+    //on separate cache lines so the two threads do not share one
+    alignas(64) std::atomic<size_t> head{0}; //next slot to consume
+    alignas(64) std::atomic<size_t> tail{0}; //next slot to produce
+
+    T* acquire(){
+        size_t t = tail.load(std::memory_order_relaxed);
+        while(t - head.load(std::memory_order_acquire) == N){ std::this_thread::yield(); }
+        return &slots[t & (N - 1)];
+    }
+    void publish(){
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    T* front(){
+        size_t h = head.load(std::memory_order_relaxed);
+        while(tail.load(std::memory_order_acquire) == h){ std::this_thread::yield(); }
+        return &slots[h & (N - 1)];
+    }
+    void release(){
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+#endif
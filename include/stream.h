@@ -0,0 +1,45 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+#include "token.h"
+#include "parseTree.h"
+
+struct StreamResult{
+    bool success = true;
+    //set when the file could not be read
+    std::string err_s = "";
+    //first delimiter error, reported like matchDelimiters does
+    bool delimiterError = false;
+    std::string delimiterErr_s = "";
+    int delimiterLine = -1;
+    TokenType delimiterToken = TokenType::NULLTOKEN;
+    //one per failed statement, in file order
+    std::vector<ParseDiagnostic> diagnostics;
+
+    uint64_t bytes = 0;
+    uint64_t tokens = 0;
+    uint64_t statements = 0;
+    uint64_t chunks = 0;
+    size_t largestChunk = 0;   //bytes, bounds the token and node storage held at once
+    ParseStats stats;
+};
+
+//called for every chunk once it is parsed, before its tokens and nodes are released
+typedef std::function<void(const TokenStream&, const parseTreeReturn&)> ChunkEmitter;
+
+/*
+compiles path in constant memory, reading it in chunks that end at a
+statement boundary. each chunk is lexed, matched, parsed and passed to
+emit, then freed before the next is read, so peak memory follows the
+largest statement rather than the file. the symbol table is the only
+thing that grows, with the number of distinct names, besides whatever
+emit keeps of each chunk
+*/
+StreamResult compileStream(const char* path, const ParseOptions& options, const ChunkEmitter& emit);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+typedef uint32_t SymbolId;
+const SymbolId NO_SYMBOL = UINT32_MAX;
+
+/*
+every distinct identifier is stored once and gets a dense 32 bit id, so
+phases after the lexer compare and hash names as integers.
+name text lives in fixed size arena blocks that never move, so the views
+handed out by name() stay valid for the life of the table
+*/
+struct SymbolTable{
+    std::vector<std::string_view> names; //indexed by SymbolId
+    std::vector<uint32_t> hashes;        //indexed by SymbolId
+    std::vector<SymbolId> slots;         //open addressing, NO_SYMBOL when empty
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t blockUsed = 0;
+    size_t blockSize = 0;
+
+    SymbolId intern(std::string_view);
+    SymbolId find(std::string_view) const;
+    std::string_view name(SymbolId id) const { return names[id]; }
+    uint32_t size() const { return (uint32_t)names.size(); }
+};
+
+//the table shared by every phase of the compile running on the calling thread
+SymbolTable& globalSymbols();
+
+/*
+makes table what globalSymbols returns on the calling thread until the
+scope ends, threads outside any scope share one table for the process.
+files built together each get a table of their own, so no thread waits
+on another to intern a name and ids come out as they would if the file
+were compiled alone. a thread helping another one's compile, like the
+lexer of --pipeline, opens a scope on the table of the thread it helps
+*/
+struct SymbolScope{
+    SymbolTable* previous;
+
+    explicit SymbolScope(SymbolTable& table);
+    SymbolScope(const SymbolScope&) = delete;
+    SymbolScope& operator=(const SymbolScope&) = delete;
+    ~SymbolScope();
+};
+
+#endif
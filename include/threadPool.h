@@ -0,0 +1,52 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <cstdint>
+
+//one worker's tasks, the owner pops from the back, thieves take from the front
+struct WorkQueue{
+    std::mutex lock;
+    std::deque<uint32_t> tasks;
+    void push(uint32_t task);
+    bool pop(uint32_t* task);
+    bool steal(uint32_t* task);
+};
+
+/*
+fixed set of workers for jobs split into independent numbered tasks.
+tasks are dealt out in contiguous blocks, one per worker, and a worker
+that runs out steals from the others, so uneven tasks still balance.
+the calling thread works as worker 0, tasks never spawn new tasks
+*/
+struct ThreadPool{
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<WorkQueue>> queues;  //one per worker
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const std::function<void(int, uint32_t)>* job = nullptr;
+    uint64_t generation = 0;
+    int running = 0;
+    bool stopping = false;
+
+    explicit ThreadPool(int workers);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    int workers() const { return (int)queues.size(); }
+    //calls job(worker, task) for every task in [0, taskCount), returns once all have finished
+    void parallelFor(uint32_t taskCount, const std::function<void(int worker, uint32_t task)>& job);
+
+    void workerLoop(int worker);
+    void work(int worker);
+};
+
+#endif
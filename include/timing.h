@@ -0,0 +1,11 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <chrono>
+
+//wall time from start until now, what every --stats line reports
+inline double millisecondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
@@ -2,8 +2,17 @@
 #define TOKEN_H
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
 #include <iostream>
 
+#include "symbolTable.h"
+
+//defined in operators.h
+enum class Operator : uint8_t;
+enum class Keyword : uint8_t;
+
 enum class TokenType{
     INT_LITERAL,
     STR_LITERAL,
@@ -83,17 +92,36 @@ extern std::ostream& operator<<(std::ostream& out, NodeType t);
 extern std::ostream& operator<<(std::ostream& out, TokenType t);
 extern std::ostream& operator<<(std::ostream& out, NodeSubType t);
 
-struct Token{
-    TokenType type;
-    int i_value = 0;
-    bool has_i_val = false;
-    std::string s_value = "";
-    bool has_s_val = false;
-    int lineNumber = -1;
-    Token() : type(TokenType::NULLTOKEN) {}
-    Token(TokenType _type) : type(_type) {}
-    Token(TokenType _type, int _value) : type(_type), i_value(_value), has_i_val(true) {}
-    Token(TokenType _type, std::string _value) : type(_type), s_value(_value), has_s_val(true) {}
+/*
+struct of arrays token storage, token i is index i of every per token
+array. text is never copied, offsets point into source, which has to
+outlive the stream. line numbers are looked up from the newline table
+instead of being stored per token
+*/
+struct TokenStream{
+    std::string_view source;
+    std::vector<uint8_t> types;       //TokenType
+    std::vector<uint32_t> offsets;    //byte offset into source
+    std::vector<uint32_t> lengths;
+    std::vector<uint32_t> payloads;   //index into intLiterals, SymbolId of an IDENTIFIER, Operator or Keyword
+    std::vector<int64_t> intLiterals;
+    std::vector<uint32_t> newlines;   //offset of every '\n' in source, ascending
+    int lineBase = 0;                 //lines before source, when it is a slice of a larger file
+
+    uint32_t size() const { return (uint32_t)types.size(); }
+    TokenType type(uint32_t i) const { return (TokenType)types[i]; }
+    std::string_view text(uint32_t i) const { return source.substr(offsets[i], lengths[i]); }
+    int64_t intValue(uint32_t i) const { return intLiterals[payloads[i]]; }
+    SymbolId symbol(uint32_t i) const { return payloads[i]; }
+    Operator op(uint32_t i) const { return (Operator)payloads[i]; }
+    Keyword keyword(uint32_t i) const { return (Keyword)payloads[i]; }
+    int lineNumber(uint32_t i) const;
+    void push(TokenType, uint32_t offset, uint32_t length, uint32_t payload=0);
+    void reserve(size_t);
+    //appends the tokens of a stream lexed from the same source
+    void append(const TokenStream&);
+    //empties the stream, keeping its capacity
+    void clear();
 };
 
 #endif
\ No newline at end of file
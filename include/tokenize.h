@@ -2,9 +2,31 @@
 #define TOKENIZE_H
 
 #include <vector>
+#include <string_view>
 #include "token.h"
 
-std::vector<Token> tokenize(const std::string&);
-void printTokens(std::vector<Token>&);
+struct DelimiterMatch{
+    //index of the matching (), [] or {} token, -1 for everything else
+    std::vector<int> match;
+    bool success = true;
+    int errIndex = -1;
+    std::string err_s = "";
+};
+
+//pairs delimiters as tokens are appended to a stream
+struct DelimiterMatcher{
+    DelimiterMatch result;
+    std::vector<int> openStack;
+    uint32_t matched = 0; //tokens already looked at
+    void extend(const TokenStream&);
+    //reports the innermost open that never closed
+    void finish();
+};
+
+TokenStream tokenize(std::string_view);
+void tokenizeRange(TokenStream&, size_t from, size_t to);
+DelimiterMatch matchDelimiters(const TokenStream&);
+void printToken(const TokenStream&, uint32_t);
+void printTokens(const TokenStream&);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef VM_H
+#define VM_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "bytecode.h"
+
+enum class VmDispatch : uint8_t{
+    threaded,   //computed goto, each handler jumps straight to the next one
+    switched,   //a switch in a loop, for compilers without computed goto
+    tree,       //walks the parse trees instead, the baseline bytecode is measured against
+};
+
+const std::string VmDispatchStrings[] = {
+    "threaded",
+    "switch",
+    "tree",
+};
+
+//whether threaded dispatch was compiled in, without it runBytecode uses the switch
+bool threadedDispatchAvailable();
+
+struct VmResult{
+    int64_t status = 0;
+    uint64_t instructions = 0;  //executed, or nodes visited by TreeWalker
+};
+
+//runs program to its return, cells holds program.variables.size() * VARIABLE_CELLS of them, zeroed for a fresh run
+VmResult runBytecode(const Bytecode& program, int64_t* cells, VmDispatch);
+
+struct WalkFrame{
+    NodeId node;
+    uint8_t step = 0;
+    bool address = false;  //variables only, produce the cell instead of its value
+};
+
+/*
+evaluates parse trees directly, statement by statement, on an explicit
+stack of frames like the builders. cells are indexed by SymbolId *
+VARIABLE_CELLS. trees can be fed a chunk at a time, run stops at the
+first return
+*/
+struct TreeWalker : TreeReader{
+    std::vector<int64_t> cells;
+    VmResult result;
+    bool returned = false;
+    std::vector<WalkFrame> frames;
+    std::vector<int64_t> values;
+
+    //false once a statement returned or could not be evaluated
+    bool run(const parseTreeReturn&, const TokenStream&);
+    void statement(NodeId);
+};
+
+#endif
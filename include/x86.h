@@ -0,0 +1,118 @@
+#ifndef X86_H
+#define X86_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+the x86-64 instructions the backend selects, as data, so the same
+selection is either printed as AT&T assembly for GNU as or encoded
+straight into machine code for --run
+*/
+
+//registers in the order the allocator numbers them, the allocatable ones first
+const uint8_t ALLOCATABLE = 12;
+const uint8_t RDI = 2;
+const uint8_t RAX = 12;
+const uint8_t RCX = 13;
+const uint8_t RDX = 14;
+const uint8_t X86_REGISTERS = 15;
+
+enum class X86Op : uint8_t{
+    MOV,        //with a 4 byte register and an immediate, mov $imm32, %r32, which zero extends
+    MOVABS,
+    LEA,
+    ADD, SUB, AND, OR, XOR, CMP,
+    IMUL,       //with an immediate source, imul $imm, %r, %r
+    TEST,
+    SHL, SAR,   //by an immediate or %cl
+    NEG, IDIV,
+    CQO,
+    SETE, SETNE, SETL, SETG, SETLE, SETGE,
+    MOVZB,      //movzbl
+    JMP, JZ, JNZ, JBE,
+    EXIT,       //ends the program with the status in %rdi
+    LABEL,
+};
+
+const std::string X86OpStrings[] = {
+    "mov",
+    "movabs",
+    "lea",
+    "add", "sub", "and", "or", "xor", "cmp",
+    "imul",
+    "test",
+    "shl", "sar",
+    "neg", "idiv",
+    "cqo",
+    "sete", "setne", "setl", "setg", "setle", "setge",
+    "movzb",
+    "jmp", "jz", "jnz", "jbe",
+    "exit",
+    "label",
+};
+
+enum class OperandKind : uint8_t{
+    none,
+    reg,
+    imm,
+    variable,   //rip relative, into the storage of a variable
+    slot,       //rip relative, into the spill slots
+    base,       //through a register
+    label,
+};
+
+struct Operand{
+    OperandKind kind = OperandKind::none;
+    uint8_t reg = 0;            //reg: the register, base: the base register
+    uint8_t index = UINT8_MAX;  //base: a register scaled by 8, UINT8_MAX without one
+    uint8_t size = 8;           //reg: 8, 4 or 1 bytes
+    uint32_t id = 0;            //variable: SymbolId, label: label number
+    int64_t value = 0;          //imm: the immediate, otherwise the displacement in bytes
+};
+
+Operand regOperand(uint8_t reg, uint8_t size = 8);
+Operand immOperand(int64_t value);
+Operand variableOperand(uint32_t symbol, int64_t offset);
+Operand slotOperand(uint32_t slot);
+Operand baseOperand(uint8_t base, int64_t offset = 0, uint8_t index = UINT8_MAX);
+Operand labelOperand(uint32_t label);
+
+//operands in AT&T order, one operand instructions only have dst
+struct X86Inst{
+    X86Op op;
+    Operand dst;
+    Operand src;
+};
+
+//appends the instruction as a line of assembly, or a label
+void printX86(std::string& text, const X86Inst&);
+
+struct Fixup{
+    uint32_t at;        //offset of the 4 byte displacement
+    uint32_t end;       //offset of the next instruction, which it is relative to
+    Operand target;     //a variable, slot or label
+};
+
+/*
+encoded program, code followed by a page aligned data area holding the
+spill slots and then every variable used. rip relative displacements
+are filled in by link, once the code has its final size
+*/
+struct MachineCode{
+    std::vector<uint8_t> bytes;
+    std::vector<uint32_t> labels;   //offset of each label, by number
+    std::vector<Fixup> fixups;
+    uint32_t exitLabel = 0;         //where EXIT jumps, to restore registers and return
+    uint64_t dataStart = 0;
+    uint64_t dataSize = 0;
+
+    //saves the registers the caller expects preserved
+    void begin(uint32_t exitLabel);
+    void encode(const X86Inst&);
+    //used is indexed by SymbolId, false when a displacement does not fit
+    bool link(uint32_t slots, const std::vector<uint8_t>& used, std::string& err_s);
+};
+
+#endif
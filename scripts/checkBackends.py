@@ -0,0 +1,127 @@
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+# runs generated programs through every way nico can execute them and compares exit codes,
+# --interpret=tree is the reference since it evaluates the parse trees without any IR.
+# catches the optimizer (folding, value numbering) and the register allocators miscompiling
+# usage: python3 checkBackends.py [nico binary] [programs] [seed]
+# programs that disagree are written to checkBackends-[seed]-[n].v in the working directory
+
+binaryOperators = ["+", "-", "*", "/", "%", "<", ">", "==", "<=", ">=", "!=", "&&", "||", "<<", ">>"]
+assignOperators = ["=", "+=", "-=", "*=", "/=", "%="]
+names = ["x", "y", "z", "i", "a", "b", "grid"]
+
+# every variant is compared against the tree walker, the linked assembly is added when as and ld are found
+variants = [
+    ["--run"],
+    ["--run", "-O0"],
+    ["--run", "--regalloc=naive"],
+    ["--run", "-O0", "--regalloc=naive"],
+    ["--interpret"],
+    ["--interpret=switch"],
+]
+
+def variable(rng, depth):
+    name = rng.choice(names)
+    if depth < 3 and rng.random() < 0.25:
+        return name + "[" + expression(rng, depth + 1) + "]"
+    return name
+
+# like makeCorpus.py, plus assignments and increments inside expressions,
+# which put stores on one side of a short circuit
+def operand(rng, depth):
+    r = rng.random()
+    if depth < 3 and r < 0.1:
+        return "(" + expression(rng, depth + 1) + ")"
+    if depth < 3 and r < 0.18:
+        return "(" + variable(rng, depth + 1) + " " + rng.choice(assignOperators) + " " + expression(rng, depth + 1) + ")"
+    if r < 0.24:
+        return rng.choice(["++", "--"]) + variable(rng, depth)
+    if r < 0.3:
+        return variable(rng, depth) + rng.choice(["++", "--"])
+    if r < 0.6:
+        return str(rng.choice([0, 1, 2, 3, 7, 63, 64, 255, 1000, 9223372036854775807]) if rng.random() < 0.3 else rng.randint(0, 100))
+    return variable(rng, depth)
+
+def expression(rng, depth):
+    e = operand(rng, depth)
+    for i in range(rng.randint(0, 3)):
+        e += " " + rng.choice(binaryOperators) + " " + operand(rng, depth)
+    return e
+
+def statement(rng):
+    r = rng.random()
+    if r < 0.7:
+        return variable(rng, 0) + " " + rng.choice(assignOperators) + " " + expression(rng, 0) + ";"
+    if r < 0.85:
+        return variable(rng, 0) + rng.choice(["++", "--"]) + ";"
+    return rng.choice(["++", "--"]) + variable(rng, 0) + ";"
+
+# the exit code keeps 8 bits, so every variable is weighed into it
+def program(rng):
+    lines = [statement(rng) for i in range(rng.randint(3, 40))]
+    lines.append("return " + " + ".join(str(2 * k + 1) + " * " + name for k, name in enumerate(names)) + ";")
+    return "\n".join(lines) + "\n"
+
+# the exit code, or what went wrong when the command printed an error
+def status(command):
+    try:
+        result = subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, timeout=20)
+    except subprocess.TimeoutExpired:
+        return "timeout"
+    if result.stderr:
+        return "error: " + result.stderr.decode(errors="replace").splitlines()[0]
+    return result.returncode
+
+def linkedStatus(nico, source, directory):
+    assembly = os.path.join(directory, "p.S")
+    objectFile = os.path.join(directory, "p.o")
+    executable = os.path.join(directory, "p")
+    if status([nico, source, assembly, "-q"]) != 0:
+        return "compile failed"
+    if status(["as", "-o", objectFile, assembly]) != 0 or status(["ld", "-o", executable, objectFile]) != 0:
+        return "link failed"
+    return status([executable])
+
+if len(sys.argv) < 2:
+    print("usage: python3 checkBackends.py [nico binary] [programs] [seed]")
+    sys.exit(1)
+
+nico = sys.argv[1]
+count = int(sys.argv[2]) if len(sys.argv) > 2 else 200
+seed = int(sys.argv[3]) if len(sys.argv) > 3 else 0
+rng = random.Random(seed)
+link = shutil.which("as") is not None and shutil.which("ld") is not None
+
+checked = 0
+skipped = 0
+failed = 0
+with tempfile.TemporaryDirectory() as directory:
+    source = os.path.join(directory, "p.v")
+    for n in range(count):
+        text = program(rng)
+        with open(source, 'w') as file:
+            file.write(text)
+        reference = status([nico, source, "--interpret=tree", "-q"])
+        # rejected by the compiler, nothing to compare
+        if not isinstance(reference, int):
+            skipped += 1
+            continue
+        results = [(" ".join(flags), status([nico, source, "-q"] + flags)) for flags in variants]
+        if link:
+            results.append(("assembly", linkedStatus(nico, source, directory)))
+        wrong = [(name, got) for name, got in results if got != reference]
+        checked += 1
+        if wrong:
+            failed += 1
+            saved = "checkBackends-" + str(seed) + "-" + str(n) + ".v"
+            with open(saved, 'w') as file:
+                file.write(text)
+            print(saved + ": --interpret=tree returned " + str(reference) + ", " + ", ".join(name + " returned " + str(got) for name, got in wrong))
+
+print(str(checked) + " programs checked, " + str(failed) + " disagreed, " + str(skipped) + " skipped" + ("" if link else " (as or ld not found, assembly not linked)"))
+sys.exit(1 if failed else 0)
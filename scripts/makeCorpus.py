@@ -0,0 +1,53 @@
+import random
+import sys
+
+# writes a large generated .v file for timing the compiler phases
+# usage: python3 makeCorpus.py [target].v [size in MB] [seed]
+
+binaryOperators = ["+", "-", "*", "/", "%", "<", ">", "==", "<=", ">=", "!=", "&&", "||", "<<", ">>"]
+assignOperators = ["=", "+=", "-=", "*="]
+names = ["x", "y", "z", "count", "total", "idx", "a", "b", "grid", "values"]
+
+def variable(rng, depth):
+    name = rng.choice(names)
+    if depth < 3 and rng.random() < 0.3:
+        return name + "[" + expression(rng, depth + 1) + "]"
+    return name
+
+def operand(rng, depth):
+    r = rng.random()
+    if depth < 3 and r < 0.15:
+        return "(" + expression(rng, depth + 1) + ")"
+    if r < 0.5:
+        return str(rng.randint(0, 1000))
+    return variable(rng, depth)
+
+def expression(rng, depth):
+    e = operand(rng, depth)
+    for i in range(rng.randint(0, 3)):
+        e += " " + rng.choice(binaryOperators) + " " + operand(rng, depth)
+    return e
+
+def statement(rng):
+    r = rng.random()
+    if r < 0.6:
+        return variable(rng, 0) + " " + rng.choice(assignOperators) + " " + expression(rng, 0) + ";"
+    if r < 0.8:
+        return variable(rng, 0) + rng.choice(["++", "--"]) + ";"
+    return rng.choice(["++", "--"]) + variable(rng, 0) + ";"
+
+if len(sys.argv) < 3:
+    print("usage: python3 makeCorpus.py [target].v [size in MB] [seed]")
+    sys.exit(1)
+
+target = sys.argv[1]
+size = int(float(sys.argv[2]) * 1024 * 1024)
+rng = random.Random(int(sys.argv[3]) if len(sys.argv) > 3 else 0)
+
+written = 0
+with open(target, 'w') as file:
+    while written < size:
+        line = statement(rng) + "\n"
+        file.write(line)
+        written += len(line)
+    file.write("return x;\n")
@@ -0,0 +1,347 @@
+#ifndef ASTCACHE_CPP
+#define ASTCACHE_CPP
+
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "astCache.h"
+
+static const char CACHE_MAGIC[8] = {'n', 'i', 'c', 'o', 'a', 's', 't', '\0'};
+
+//numbers temporary entries, files built together may store the same source at once
+static std::atomic<uint32_t> temporaries{0};
+
+static uint64_t mix(uint64_t h, uint64_t word){
+    h = (h ^ word) * 1099511628211ull;
+    return h ^ (h >> 29);
+}
+
+//8 bytes a step, the source stored in an entry settles collisions
+static uint64_t hashSource(std::string_view source){
+    uint64_t h = mix(14695981039346656037ull, source.size());
+    size_t i = 0;
+    for(; i + 8 <= source.size(); i += 8){
+        uint64_t word;
+        std::memcpy(&word, source.data() + i, 8);
+        h = mix(h, word);
+    }
+    for(; i < source.size(); i++){
+        h = mix(h, (unsigned char)source[i]);
+    }
+    return h;
+}
+
+//four lanes so the multiplies overlap, every entry is hashed in full on load
+static uint64_t hashBytes(const char* data, size_t size){
+    uint64_t lanes[4] = {14695981039346656037ull, 1, 2, 3};
+    size_t i = 0;
+    for(; i + 32 <= size; i += 32){
+        for(int lane = 0; lane < 4; lane++){
+            uint64_t word;
+            std::memcpy(&word, data + i + lane * 8, 8);
+            lanes[lane] = mix(lanes[lane], word);
+        }
+    }
+    uint64_t h = mix(lanes[0], size);
+    for(int lane = 1; lane < 4; lane++){
+        h = mix(h, lanes[lane]);
+    }
+    for(; i < size; i++){
+        h = mix(h, (unsigned char)data[i]);
+    }
+    return h;
+}
+
+static uint64_t entryChecksum(CacheHeader header, const char* entry, size_t size){
+    header.checksum = 0;
+    return mix(hashBytes((const char*)&header, sizeof(header)), hashBytes(entry + sizeof(header), size - sizeof(header)));
+}
+
+//the format and the running binary's size and modification time, so rebuilding nico invalidates every entry
+static uint64_t compilerIdentity(){
+    uint64_t h = mix(14695981039346656037ull, AST_CACHE_FORMAT);
+    struct stat info;
+    if(stat("/proc/self/exe", &info) == 0){
+        h = mix(h, (uint64_t)info.st_size);
+        h = mix(h, (uint64_t)info.st_mtime);
+    }
+    return h;
+}
+
+static void appendHex(std::string& out, uint64_t value){
+    const char digits[] = "0123456789abcdef";
+    for(int shift = 60; shift >= 0; shift -= 4){
+        out += digits[(value >> shift) & 15];
+    }
+}
+
+std::string AstCache::path() const{
+    std::string ret = dir + "/";
+    appendHex(ret, sourceHash);
+    ret += "-";
+    appendHex(ret, mix(compilerIdentity(), (uint64_t)maxDepth));
+    ret += ".ast";
+    return ret;
+}
+
+//the array's elements when it lies inside the entry, nullptr otherwise
+template<typename T>
+static const T* arrayOf(const char* entry, size_t size, const CacheArray& array){
+    if(array.offset % 8 != 0 || array.offset > size || array.count > (size - array.offset) / sizeof(T)){
+        return nullptr;
+    }
+    return (const T*)(entry + array.offset);
+}
+
+template<typename T>
+static bool copyArray(std::vector<T>& out, const char* entry, size_t size, const CacheArray& array){
+    const T* elements = arrayOf<T>(entry, size, array);
+    if(elements == nullptr){ return false; }
+    out.assign(elements, elements + array.count);
+    return true;
+}
+
+/*
+checks that the arrays are consistent, behind the checksum, so an entry
+that is not what store wrote is a miss rather than a crash: every index
+in range, and every child before its parent, as the parser builds
+trees, so no walk can loop
+*/
+static bool validEntry(const TokenStream& tokens, uint32_t symbols, const NodeArena& arena, const std::vector<uint32_t>& traces){
+    for(uint32_t i = 0; i < tokens.size(); i++){
+        if(tokens.types[i] >= (uint8_t)TokenType::NULLTOKEN){ return false; }
+        if((uint64_t)tokens.offsets[i] + tokens.lengths[i] > tokens.source.size()){ return false; }
+        if(tokens.type(i) == TokenType::INT_LITERAL && tokens.payloads[i] >= tokens.intLiterals.size()){ return false; }
+        if(tokens.type(i) == TokenType::IDENTIFIER && tokens.payloads[i] >= symbols){ return false; }
+    }
+    for(NodeId id = 0; id < arena.nodes.size(); id++){
+        const Node& n = arena.nodes[id];
+        if((uint32_t)n.type > (uint32_t)NodeType::_operator || (uint32_t)n.subtype > (uint32_t)NodeSubType::none){ return false; }
+        if(n.token != NO_TOKEN && n.token >= tokens.size()){ return false; }
+        if((uint64_t)n.firstChild + n.childCount > arena.children.size()){ return false; }
+        for(uint32_t c = 0; c < n.childCount; c++){
+            if(arena.children[n.firstChild + c] >= id){ return false; }
+        }
+    }
+    for(uint32_t root : traces){
+        if(root >= arena.nodes.size()){ return false; }
+    }
+    return true;
+}
+
+//fills tokens and parseTree from a mapped entry, false when it is not the entry for source
+static bool readEntry(const char* entry, size_t size, AstCache* cache, std::string_view source, TokenStream& tokens, parseTreeReturn& parseTree){
+    CacheHeader header;
+    std::memcpy(&header, entry, sizeof(header));
+    if(std::memcmp(header.magic, CACHE_MAGIC, 8) != 0 || header.format != AST_CACHE_FORMAT || header.nodeSize != sizeof(Node)){
+        return false;
+    }
+    if(header.sourceHash != cache->sourceHash || header.checksum != entryChecksum(header, entry, size)){
+        return false;
+    }
+    const CacheArray* arrays = header.arrays;
+    const char* stored = arrayOf<char>(entry, size, arrays[(int)CacheArrayId::source]);
+    if(stored == nullptr || arrays[(int)CacheArrayId::source].count != source.size()){
+        return false;
+    }
+    if(std::memcmp(stored, source.data(), source.size()) != 0){
+        return false;
+    }
+
+    TokenStream loaded;
+    loaded.source = source;
+    NodeArena arena;
+    std::vector<uint32_t> traces;
+    std::vector<uint32_t> symbolEnds;
+    const char* symbolText = arrayOf<char>(entry, size, arrays[(int)CacheArrayId::symbolText]);
+    bool copied = symbolText != nullptr
+        && copyArray(loaded.types, entry, size, arrays[(int)CacheArrayId::types])
+        && copyArray(loaded.offsets, entry, size, arrays[(int)CacheArrayId::offsets])
+        && copyArray(loaded.lengths, entry, size, arrays[(int)CacheArrayId::lengths])
+        && copyArray(loaded.payloads, entry, size, arrays[(int)CacheArrayId::payloads])
+        && copyArray(loaded.intLiterals, entry, size, arrays[(int)CacheArrayId::intLiterals])
+        && copyArray(loaded.newlines, entry, size, arrays[(int)CacheArrayId::newlines])
+        && copyArray(symbolEnds, entry, size, arrays[(int)CacheArrayId::symbolEnds])
+        && copyArray(arena.nodes, entry, size, arrays[(int)CacheArrayId::nodes])
+        && copyArray(arena.children, entry, size, arrays[(int)CacheArrayId::children])
+        && copyArray(traces, entry, size, arrays[(int)CacheArrayId::traces]);
+    size_t tokenCount = loaded.types.size();
+    if(!copied || loaded.offsets.size() != tokenCount || loaded.lengths.size() != tokenCount || loaded.payloads.size() != tokenCount){
+        return false;
+    }
+    if(!validEntry(loaded, (uint32_t)symbolEnds.size(), arena, traces)){
+        return false;
+    }
+
+    //ids are handed out in order, so a fresh process interns the names back to the ids they had
+    std::vector<SymbolId> remap(symbolEnds.size());
+    bool identity = true;
+    uint32_t start = 0;
+    for(uint32_t i = 0; i < symbolEnds.size(); i++){
+        uint32_t end = symbolEnds[i];
+        if(end < start || end > arrays[(int)CacheArrayId::symbolText].count){
+            return false;
+        }
+        remap[i] = globalSymbols().intern(std::string_view(symbolText + start, end - start));
+        identity = identity && remap[i] == i;
+        start = end;
+    }
+    if(!identity){
+        for(uint32_t i = 0; i < loaded.size(); i++){
+            if(loaded.type(i) == TokenType::IDENTIFIER){
+                loaded.payloads[i] = remap[loaded.payloads[i]];
+            }
+        }
+    }
+
+    tokens = std::move(loaded);
+    parseTree = parseTreeReturn();
+    parseTree.arenas.push_back(std::move(arena));
+    parseTree.traces.reserve(traces.size());
+    for(uint32_t root : traces){
+        parseTree.traces.push_back(StackTrace(root));
+    }
+    parseTree.stats = header.stats;
+    return true;
+}
+
+bool AstCache::load(std::string_view source, TokenStream& tokens, parseTreeReturn& parseTree){
+    sourceHash = hashSource(source);
+    int fd = open(path().c_str(), O_RDONLY);
+    if(fd < 0){
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CacheHeader)){
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)info.st_size;
+#ifdef MAP_POPULATE
+    //every page is read once, faulting them in up front is cheaper than one at a time
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+#else
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+#endif
+    close(fd);
+    if(mapping == MAP_FAILED){
+        return false;
+    }
+    bool hit = readEntry((const char*)mapping, size, this, source, tokens, parseTree);
+    munmap(mapping, size);
+    if(hit){
+        bytes = size;
+    }
+    return hit;
+}
+
+//appends count elements at the next 8 byte boundary of entry and records where
+static void appendArray(std::string& entry, CacheArray& array, const void* data, size_t count, size_t elementSize){
+    entry.resize((entry.size() + 7) & ~(size_t)7, '\0');
+    array.offset = entry.size();
+    array.count = count;
+    entry.append((const char*)data, count * elementSize);
+}
+
+template<typename T>
+static void appendVector(std::string& entry, CacheHeader& header, CacheArrayId id, const std::vector<T>& v){
+    appendArray(entry, header.arrays[(int)id], v.data(), v.size(), sizeof(T));
+}
+
+bool AstCache::store(std::string_view source, const TokenStream& tokens, const parseTreeReturn& parseTree){
+    sourceHash = hashSource(source);
+    CacheHeader header = {};
+    std::memcpy(header.magic, CACHE_MAGIC, 8);
+    header.format = AST_CACHE_FORMAT;
+    header.nodeSize = sizeof(Node);
+    header.sourceHash = sourceHash;
+    header.compiler = compilerIdentity();
+    header.stats = parseTree.stats;
+
+    //every arena's nodes one after another, ids moved up by the nodes before them
+    NodeArena merged;
+    std::vector<uint32_t> nodeBase;
+    for(const NodeArena& arena : parseTree.arenas){
+        uint32_t nodes = (uint32_t)merged.nodes.size();
+        uint32_t children = (uint32_t)merged.children.size();
+        nodeBase.push_back(nodes);
+        for(Node n : arena.nodes){
+            n.firstChild += children;
+            merged.nodes.push_back(n);
+        }
+        for(NodeId child : arena.children){
+            merged.children.push_back(child + nodes);
+        }
+    }
+    std::vector<uint32_t> traces;
+    traces.reserve(parseTree.traces.size());
+    for(const StackTrace& trace : parseTree.traces){
+        traces.push_back(trace.node + nodeBase[trace.arena]);
+    }
+    const SymbolTable& symbols = globalSymbols();
+    std::vector<uint32_t> symbolEnds;
+    std::string symbolText;
+    for(SymbolId id = 0; id < symbols.size(); id++){
+        symbolText += symbols.name(id);
+        symbolEnds.push_back((uint32_t)symbolText.size());
+    }
+
+    std::string entry((const char*)&header, sizeof(header));
+    appendArray(entry, header.arrays[(int)CacheArrayId::source], source.data(), source.size(), 1);
+    appendVector(entry, header, CacheArrayId::types, tokens.types);
+    appendVector(entry, header, CacheArrayId::offsets, tokens.offsets);
+    appendVector(entry, header, CacheArrayId::lengths, tokens.lengths);
+    appendVector(entry, header, CacheArrayId::payloads, tokens.payloads);
+    appendVector(entry, header, CacheArrayId::intLiterals, tokens.intLiterals);
+    appendVector(entry, header, CacheArrayId::newlines, tokens.newlines);
+    appendVector(entry, header, CacheArrayId::symbolEnds, symbolEnds);
+    appendArray(entry, header.arrays[(int)CacheArrayId::symbolText], symbolText.data(), symbolText.size(), 1);
+    appendVector(entry, header, CacheArrayId::nodes, merged.nodes);
+    appendVector(entry, header, CacheArrayId::children, merged.children);
+    appendVector(entry, header, CacheArrayId::traces, traces);
+    header.checksum = entryChecksum(header, entry.data(), entry.size());
+    std::memcpy(entry.data(), &header, sizeof(header));
+
+    //written beside the entry and renamed over it, so a reader never maps half an entry
+    if(mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST){
+        err_s = std::strerror(errno);
+        return false;
+    }
+    std::string file = path();
+    std::string temporary = file + "." + std::to_string(getpid()) + "." + std::to_string(temporaries++);
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        err_s = std::strerror(errno);
+        return false;
+    }
+    size_t written = 0;
+    while(written < entry.size()){
+        ssize_t n = write(fd, entry.data() + written, entry.size() - written);
+        if(n < 0 && errno == EINTR){ continue; }
+        if(n <= 0){ break; }
+        written += (size_t)n;
+    }
+    bool success = written == entry.size();
+    if(!success){
+        err_s = std::strerror(errno);
+    }
+    close(fd);
+    if(success && rename(temporary.c_str(), file.c_str()) != 0){
+        err_s = std::strerror(errno);
+        success = false;
+    }
+    if(!success){
+        unlink(temporary.c_str());
+        return false;
+    }
+    bytes = entry.size();
+    return true;
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef BUILD_CPP
+#define BUILD_CPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+
+#include "build.h"
+#include "sourceFile.h"
+#include "tokenize.h"
+#include "ir.h"
+#include "optimize.h"
+#include "astCache.h"
+#include "threadPool.h"
+#include "timing.h"
+
+std::string defaultTarget(std::string_view source){
+    if(source.size() > 2 && source.substr(source.size() - 2) == ".v"){
+        source.remove_suffix(2);
+    }
+    return std::string(source) + ".S";
+}
+
+bool readManifest(const char* path, std::vector<BuildJob>& jobs, std::string& err_s){
+    std::ifstream in(path);
+    if(!in){
+        err_s = "Failed to open manifest \"" + std::string(path) + "\"";
+        return false;
+    }
+    std::string dir = path;
+    size_t slash = dir.rfind('/');
+    dir = (slash == std::string::npos) ? "" : dir.substr(0, slash + 1);
+    std::string line;
+    int lineNumber = 0;
+    while(std::getline(in, line)){
+        lineNumber++;
+        std::istringstream fields(line);
+        std::string source, target, extra;
+        if(!(fields >> source) || source[0] == '#'){
+            continue;
+        }
+        fields >> target;
+        if(fields >> extra){
+            err_s = std::string(path) + ":" + std::to_string(lineNumber) + ": expected a source and at most one target";
+            return false;
+        }
+        BuildJob job;
+        job.source = (source[0] == '/') ? source : dir + source;
+        if(target.empty()){
+            job.target = defaultTarget(job.source);
+        } else {
+            job.target = (target[0] == '/') ? target : dir + target;
+        }
+        jobs.push_back(std::move(job));
+    }
+    return true;
+}
+
+/*
+the default path for one file, quiet. failures go to job.out and job.err
+in the formats the default path prints them in, with the file name in
+front of parse errors since many files report to one terminal
+*/
+static bool compileFile(BuildJob& job, const BuildOptions& options){
+    const char* fname = job.source.c_str();
+    SymbolTable symbols;
+    SymbolScope scope(symbols);
+
+    SourceFile source;
+    if(!source.open(fname)){
+        job.err += "Failed to open file \"" + job.source + "\": " + source.err_s + "\n";
+        return false;
+    }
+    job.bytes = source.text.size();
+
+    TokenStream tokens;
+    parseTreeReturn parseTree;
+    AstCache cache;
+    cache.dir = options.cacheDir;
+    cache.maxDepth = options.parse.maxDepth;
+    bool cached = !cache.dir.empty() && cache.load(source.text, tokens, parseTree);
+    if(!cached){
+        tokens = tokenize(source.text);
+        DelimiterMatch delimiters = matchDelimiters(tokens);
+        if(!delimiters.success){
+            job.err += job.source + ":" + std::to_string(tokens.lineNumber(delimiters.errIndex)) + ": " + delimiters.err_s;
+            job.err += std::string(" [") + TokenTypeStrings[(int)tokens.type(delimiters.errIndex)] + "]\n";
+            return false;
+        }
+        ParseOptions parseOptions = options.parse;
+        parseOptions.threads = 1;
+        parseTree = createParseTree(tokens, delimiters.match, parseOptions);
+        if(!cache.dir.empty() && parseTree.success && !cache.store(source.text, tokens, parseTree)){
+            job.err += "Failed to write cache entry \"" + cache.path() + "\": " + cache.err_s + "\n";
+        }
+    }
+    job.tokens = tokens.size();
+    job.statements = parseTree.traces.size();
+    if(!parseTree.success){
+        std::ostringstream out;
+        out << job.source << ": Errors in creating parse tree\n";
+        for(int i = 0; i < (int)parseTree.diagnostics.size(); i++){
+            parseTree.diagnostics.at(i).print(0, out);
+        }
+        job.out += out.str();
+        return false;
+    }
+
+    IrBuilder builder;
+    builder.lower(parseTree, tokens);
+    builder.finish();
+    if(!builder.success){
+        job.err += job.source + ":" + std::to_string(builder.lineNumber) + ": " + builder.err_s + "\n";
+        return false;
+    }
+    std::string irErr_s;
+    OptimizeStats optimizeStats;
+    bool irValid = !options.verifyIr || verifyIr(builder.program, irErr_s);
+    if(irValid && options.optimize){
+        irValid = optimizeIr(builder.program, optimizeStats, options.verifyIr, irErr_s);
+    }
+    if(!irValid){
+        job.err += job.source + ": invalid IR: " + irErr_s + "\n";
+        return false;
+    }
+
+    CodeGenerator codegen;
+    codegen.allocator = options.allocator;
+    codegen.begin(job.source);
+    codegen.emit(builder.program);
+    std::string linkErr_s;
+    if(!codegen.finish(linkErr_s)){
+        job.err += job.source + ": " + linkErr_s + "\n";
+        return false;
+    }
+    std::ofstream out(job.target, std::ios::binary);
+    out.write(codegen.text.data(), codegen.text.size());
+    out.close();
+    if(!out){
+        job.err += "Failed to write file \"" + job.target + "\"\n";
+        return false;
+    }
+    return true;
+}
+
+BuildStats buildFiles(std::vector<BuildJob>& jobs, const BuildOptions& options){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    BuildStats stats;
+    stats.files = jobs.size();
+    stats.threads = std::max(1, std::min(options.threads, (int)jobs.size()));
+    ThreadPool pool(stats.threads);
+    pool.parallelFor((uint32_t)jobs.size(), [&](int, uint32_t task){
+        std::chrono::steady_clock::time_point fileStart = std::chrono::steady_clock::now();
+        BuildJob& job = jobs[task];
+        job.success = compileFile(job, options);
+        job.time = millisecondsSince(fileStart);
+    });
+    for(const BuildJob& job : jobs){
+        stats.failed += !job.success;
+        stats.bytes += job.bytes;
+        stats.tokens += job.tokens;
+        stats.statements += job.statements;
+        stats.fileTime += job.time;
+    }
+    stats.time = millisecondsSince(start);
+    return stats;
+}
+
+void BuildStats::print() const{
+    double seconds = time / 1000.0;
+    std::cout << "build: " << files << " files, " << failed << " failed, " << bytes / (1024.0 * 1024.0) << " MB on " << threads << " threads\n";
+    std::cout << "lex + parse: " << tokens << " tokens, " << statements << " statements\n";
+    std::cout << "compile: " << time << " ms (" << files / seconds << " files/s), " << fileTime << " ms over files (";
+    std::cout << (time > 0 ? fileTime / time : 0) << "x)\n";
+}
+
+#endif
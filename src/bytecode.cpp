@@ -0,0 +1,401 @@
+#ifndef BYTECODE_CPP
+#define BYTECODE_CPP
+
+#include <iostream>
+#include <algorithm>
+
+#include "bytecode.h"
+#include "operators.h"
+#include "symbolTable.h"
+
+static void printCell(const Bytecode& program, uint32_t cell){
+    std::cout << "@" << globalSymbols().name(program.variables[cell / VARIABLE_CELLS]);
+    if(cell % VARIABLE_CELLS != 0){ std::cout << "+" << cell % VARIABLE_CELLS; }
+}
+
+void Bytecode::print() const{
+    for(uint32_t i = 0; i < code.size(); i++){
+        const BcInst& in = code[i];
+        std::cout << "    " << i << ": " << BcOpStrings[(int)in.op];
+        switch(in.op){
+            case BcOp::CONST:
+                std::cout << " r" << in.a << ", " << (int32_t)in.c;
+                break;
+            case BcOp::CONSTW:
+                std::cout << " r" << in.a << ", " << constants[in.c];
+                break;
+            case BcOp::LOAD: case BcOp::STORE:
+                std::cout << " r" << in.a << ", ";
+                printCell(*this, in.c);
+                break;
+            case BcOp::LOADX: case BcOp::STOREX:
+                std::cout << " r" << in.a << ", ";
+                printCell(*this, in.c);
+                std::cout << "[r" << in.b << "]";
+                break;
+            case BcOp::MOVE: case BcOp::NOT: case BcOp::TRUTH: case BcOp::INC: case BcOp::DEC:
+                std::cout << " r" << in.a << ", r" << in.b;
+                break;
+            case BcOp::JMP:
+                std::cout << " " << in.c;
+                break;
+            case BcOp::JZ: case BcOp::JNZ:
+                std::cout << " r" << in.a << ", " << in.c;
+                break;
+            case BcOp::RETURN:
+                std::cout << " r" << in.a;
+                break;
+            default:
+                std::cout << " r" << in.a << ", r" << in.b << ", r" << in.c;
+                break;
+        }
+        std::cout << "\n";
+    }
+}
+
+/*
+compiling. like IrBuilder, nodes run on an explicit stack of frames: a
+node compiles a child by setting the step it resumes at and pushing the
+child with the register its value goes to (callNode), and finishes by
+popping itself (returnValue). the frame reference a node holds is
+invalid after callNode
+*/
+
+//a node uses at most three registers from its base
+static void callNode(BytecodeBuilder* builder, NodeId node, uint32_t base, bool address=false){
+    if(base + 3 > UINT16_MAX){
+        return builder->fail(node, "expression too deeply nested for the bytecode registers");
+    }
+    builder->program.registers = std::max(builder->program.registers, base + 3);
+    BcFrame f;
+    f.node = builder->unwrap(node);
+    f.address = address;
+    f.base = base;
+    builder->frames.push_back(f);
+}
+
+static void returnValue(BytecodeBuilder* builder){
+    builder->frames.pop_back();
+}
+
+//whether the value of the node being compiled is read, a statement's is not
+static bool valueUsed(BytecodeBuilder* builder){
+    return builder->frames.size() > 1;
+}
+
+static uint32_t emit(BytecodeBuilder* builder, BcOp op, uint32_t a, uint32_t b = 0, uint32_t c = 0){
+    builder->program.code.push_back({op, (uint16_t)a, (uint16_t)b, c});
+    return (uint32_t)builder->program.code.size() - 1;
+}
+
+static void loadConstant(BytecodeBuilder* builder, uint32_t reg, int64_t value){
+    if(value >= INT32_MIN && value <= INT32_MAX){
+        emit(builder, BcOp::CONST, reg, 0, (uint32_t)(int32_t)value);
+        return;
+    }
+    emit(builder, BcOp::CONSTW, reg, 0, (uint32_t)builder->program.constants.size());
+    builder->program.constants.push_back(value);
+}
+
+//first cell of a variable, UINT32_MAX once cells no longer fit in 32 bits
+static uint32_t firstCell(BytecodeBuilder* builder, SymbolId symbol){
+    if(symbol >= builder->variableIndex.size()){
+        builder->variableIndex.resize(symbol + 1, UINT32_MAX);
+    }
+    if(builder->variableIndex[symbol] == UINT32_MAX){
+        if(builder->program.variables.size() >= UINT32_MAX / VARIABLE_CELLS){
+            return UINT32_MAX;
+        }
+        builder->variableIndex[symbol] = (uint32_t)builder->program.variables.size();
+        builder->program.variables.push_back(symbol);
+    }
+    return builder->variableIndex[symbol] * VARIABLE_CELLS;
+}
+
+static bool literal(BytecodeBuilder* builder, NodeId id, int64_t* value){
+    const Node& n = builder->arena->at(builder->unwrap(id));
+    if(n.type != NodeType::value || builder->tokens->type(n.token) != TokenType::INT_LITERAL){
+        return false;
+    }
+    *value = builder->tokens->intValue(n.token);
+    return true;
+}
+
+//the arithmetic and comparison ops, assignment operators map to the op they apply
+static bool arithmeticOp(Operator op, BcOp* out){
+    switch(op){
+        case Operator::PLUS: case Operator::PLUS_ASSIGN: *out = BcOp::ADD; return true;
+        case Operator::MINUS: case Operator::MINUS_ASSIGN: *out = BcOp::SUB; return true;
+        case Operator::STAR: case Operator::STAR_ASSIGN: *out = BcOp::MUL; return true;
+        case Operator::SLASH: case Operator::SLASH_ASSIGN: *out = BcOp::DIV; return true;
+        case Operator::PERCENT: case Operator::PERCENT_ASSIGN: *out = BcOp::MOD; return true;
+        case Operator::BIT_AND: *out = BcOp::AND; return true;
+        case Operator::BIT_OR: *out = BcOp::OR; return true;
+        case Operator::SHIFT_LEFT: *out = BcOp::SHL; return true;
+        case Operator::SHIFT_RIGHT: *out = BcOp::SHR; return true;
+        case Operator::EQUAL: *out = BcOp::EQ; return true;
+        case Operator::NOT_EQUAL: *out = BcOp::NE; return true;
+        case Operator::LESS: *out = BcOp::LT; return true;
+        case Operator::GREATER: *out = BcOp::GT; return true;
+        case Operator::LESS_EQUAL: *out = BcOp::LE; return true;
+        case Operator::GREATER_EQUAL: *out = BcOp::GE; return true;
+        default: return false;
+    }
+}
+
+static void compileValue(BytecodeBuilder* builder){
+    const BcFrame& f = builder->frames.back();
+    uint32_t token = builder->arena->at(f.node).token;
+    if(builder->tokens->type(token) != TokenType::INT_LITERAL){
+        return builder->fail(f.node, "string literals are not supported");
+    }
+    loadConstant(builder, f.base, builder->tokens->intValue(token));
+    returnValue(builder);
+}
+
+/*
+a[i][j] folds its indices row major into one cell index in the base
+register, literal indices give a fixed cell and no code at all
+*/
+static void compileVariable(BytecodeBuilder* builder){
+    BcFrame& f = builder->frames.back();
+    const Node& n = builder->arena->at(f.node);
+    uint32_t first = firstCell(builder, builder->tokens->symbol(n.token));
+    if(first == UINT32_MAX){
+        return builder->fail(f.node, "too many variables for the bytecode cells");
+    }
+    uint32_t base = f.base;
+    bool address = f.address;
+
+    if(f.step == 0){
+        uint64_t cell = 0;
+        bool fixed = true;
+        for(uint32_t k = 0; k < n.childCount; k++){
+            int64_t index;
+            if(!literal(builder, builder->arena->child(f.node, k), &index)){
+                fixed = false;
+                break;
+            }
+            cell = cell * ARRAY_ROW_CELLS + (uint64_t)index;
+        }
+        if(fixed){
+            cell = first + (cell & (VARIABLE_CELLS - 1));
+            if(address){
+                builder->addresses.push_back({(uint32_t)cell, false});
+            } else {
+                emit(builder, BcOp::LOAD, base, 0, (uint32_t)cell);
+            }
+            return returnValue(builder);
+        }
+    }
+    //step s has the first s indices compiled, the row major index so far in base and the newest in base+1
+    if(f.step >= 2){
+        emit(builder, BcOp::INDEX, base, base, base + 1);
+    }
+    if(f.step < n.childCount){
+        NodeId index = builder->arena->child(f.node, f.step);
+        uint32_t reg = f.step == 0 ? base : base + 1;
+        f.step++;
+        return callNode(builder, index, reg);
+    }
+    if(address){
+        builder->addresses.push_back({first, true});
+    } else {
+        emit(builder, BcOp::LOADX, base, base, first);
+    }
+    returnValue(builder);
+}
+
+static void load(BytecodeBuilder* builder, uint32_t reg, const BcAddress& address, uint32_t index){
+    emit(builder, address.indexed ? BcOp::LOADX : BcOp::LOAD, reg, index, address.cell);
+}
+
+static void store(BytecodeBuilder* builder, uint32_t reg, const BcAddress& address, uint32_t index){
+    emit(builder, address.indexed ? BcOp::STOREX : BcOp::STORE, reg, index, address.cell);
+}
+
+//with a computed cell its index holds base, so the value is kept in base+1
+static void compileAssignment(BytecodeBuilder* builder){
+    BcFrame& f = builder->frames.back();
+    Operator op = builder->operatorOf(f.node, 1);
+    uint32_t base = f.base;
+    switch(f.step){
+    case 0: {
+        NodeId target = builder->unwrap(builder->arena->child(f.node, 0));
+        if(builder->arena->at(target).type != NodeType::variable){
+            return builder->fail(f.node, "left side of " + OperatorStrings[(int)op] + " must be a variable");
+        }
+        f.step = 1;
+        return callNode(builder, target, base, true);
+    }
+    case 1:
+        f.step = 2;
+        return callNode(builder, builder->arena->child(f.node, 2), builder->addresses.back().indexed ? base + 1 : base);
+    default: {
+        BcAddress address = builder->addresses.back();
+        builder->addresses.pop_back();
+        uint32_t value = address.indexed ? base + 1 : base;
+        BcOp arith;
+        if(op != Operator::ASSIGN && arithmeticOp(op, &arith)){
+            load(builder, value + 1, address, base);
+            emit(builder, arith, value, value + 1, value);
+        }
+        store(builder, value, address, base);
+        if(value != base && valueUsed(builder)){
+            emit(builder, BcOp::MOVE, base, value);
+        }
+        return returnValue(builder);
+    }
+    }
+}
+
+/*
+a && b jumps past b when a is 0, which is then the result, a || b turns
+a into 0 or 1 first and jumps past b when that is 1
+*/
+static void compileLogical(BytecodeBuilder* builder){
+    BcFrame& f = builder->frames.back();
+    bool isAnd = builder->operatorOf(f.node, 1) == Operator::AND;
+    uint32_t base = f.base;
+    switch(f.step){
+    case 0:
+        f.step = 1;
+        return callNode(builder, builder->arena->child(f.node, 0), base);
+    case 1:
+        if(!isAnd){
+            emit(builder, BcOp::TRUTH, base, base);
+        }
+        f.jump = emit(builder, isAnd ? BcOp::JZ : BcOp::JNZ, base);
+        f.step = 2;
+        return callNode(builder, builder->arena->child(f.node, 2), base);
+    default:
+        emit(builder, BcOp::TRUTH, base, base);
+        builder->program.code[f.jump].c = (uint32_t)builder->program.code.size();
+        return returnValue(builder);
+    }
+}
+
+static void compileBinary(BytecodeBuilder* builder){
+    BcFrame& f = builder->frames.back();
+    Operator op = builder->operatorOf(f.node, 1);
+    switch(op){
+        case Operator::ASSIGN: case Operator::PLUS_ASSIGN: case Operator::MINUS_ASSIGN:
+        case Operator::STAR_ASSIGN: case Operator::SLASH_ASSIGN: case Operator::PERCENT_ASSIGN:
+            return compileAssignment(builder);
+        case Operator::AND: case Operator::OR:
+            return compileLogical(builder);
+        default:
+            break;
+    }
+    BcOp arith;
+    if(!arithmeticOp(op, &arith)){
+        return builder->fail(f.node, "operator " + OperatorStrings[(int)op] + " is not supported");
+    }
+    uint32_t base = f.base;
+    switch(f.step){
+    case 0:
+        f.step = 1;
+        return callNode(builder, builder->arena->child(f.node, 0), base);
+    case 1:
+        f.step = 2;
+        return callNode(builder, builder->arena->child(f.node, 2), base + 1);
+    default:
+        emit(builder, arith, base, base, base + 1);
+        return returnValue(builder);
+    }
+}
+
+//prefix and postfix ++, -- and !, kids are (operator) (operand) or (operand) (operator)
+static void compileUnary(BytecodeBuilder* builder){
+    BcFrame& f = builder->frames.back();
+    bool prefix = builder->arena->at(f.node).subtype == NodeSubType::prefix_unary;
+    NodeId operand = builder->unwrap(builder->arena->child(f.node, prefix ? 1 : 0));
+    Operator op = builder->operatorOf(f.node, prefix ? 0 : 1);
+    uint32_t base = f.base;
+
+    if(f.step == 0){
+        if(op != Operator::NOT && builder->arena->at(operand).type != NodeType::variable){
+            return builder->fail(f.node, "operand of " + OperatorStrings[(int)op] + " must be a variable");
+        }
+        f.step = 1;
+        return callNode(builder, operand, base, op != Operator::NOT);
+    }
+    if(op == Operator::NOT){
+        emit(builder, BcOp::NOT, base, base);
+        return returnValue(builder);
+    }
+    BcAddress address = builder->addresses.back();
+    builder->addresses.pop_back();
+    uint32_t old = address.indexed ? base + 1 : base;
+    uint32_t updated = prefix ? old : old + 1;
+    load(builder, old, address, base);
+    emit(builder, op == Operator::INCREMENT ? BcOp::INC : BcOp::DEC, updated, old);
+    store(builder, updated, address, base);
+    if(old != base && valueUsed(builder)){
+        emit(builder, BcOp::MOVE, base, old);
+    }
+    returnValue(builder);
+}
+
+static void compileReturn(BytecodeBuilder* builder){
+    BcFrame& f = builder->frames.back();
+    uint32_t base = f.base;
+    if(builder->arena->at(f.node).childCount > 0 && f.step == 0){
+        f.step = 1;
+        return callNode(builder, builder->arena->child(f.node, 0), base);
+    }
+    if(f.step == 0){
+        loadConstant(builder, base, 0);
+    }
+    emit(builder, BcOp::RETURN, base);
+    returnValue(builder);
+}
+
+void BytecodeBuilder::statement(NodeId root){
+    frames.clear();
+    addresses.clear();
+    callNode(this, root, 0);
+    while(success && !frames.empty()){
+        NodeId id = frames.back().node;
+        const Node& n = arena->at(id);
+        switch(n.type){
+            case NodeType::value:
+                compileValue(this);
+                break;
+            case NodeType::variable:
+                compileVariable(this);
+                break;
+            case NodeType::statement:
+                switch(n.subtype){
+                    case NodeSubType::binary_op: compileBinary(this); break;
+                    case NodeSubType::prefix_unary: case NodeSubType::postfix_unary: compileUnary(this); break;
+                    case NodeSubType::_return: compileReturn(this); break;
+                    case NodeSubType::func_call: fail(id, "function calls are not supported"); break;
+                    default: fail(id, "unexpected statement"); break;
+                }
+                break;
+            default:
+                fail(id, "unexpected " + NodeTypeStrings[(int)n.type] + " node");
+                break;
+        }
+    }
+}
+
+bool BytecodeBuilder::lower(const parseTreeReturn& parseTree, const TokenStream& _tokens){
+    tokens = &_tokens;
+    for(const StackTrace& trace : parseTree.traces){
+        if(!success){ break; }
+        arena = &parseTree.arenaOf(trace);
+        statement(trace.node);
+        statements++;
+    }
+    return success;
+}
+
+void BytecodeBuilder::finish(){
+    program.registers = std::max(program.registers, 1u);
+    emit(this, BcOp::CONST, 0, 0, 0);
+    emit(this, BcOp::RETURN, 0);
+}
+
+#endif
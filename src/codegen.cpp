@@ -0,0 +1,433 @@
+#ifndef CODEGEN_CPP
+#define CODEGEN_CPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+#include "codegen.h"
+
+/*
+every value lives in a register or a spill slot in .bss, as the
+register allocator decides, see regalloc.h. %rax, %rcx and %rdx are
+never allocated: they hold operands that are not in registers, the
+shift count and idiv's operands. an instruction computes in place in
+its result's register where it can, and in %rax before storing to a
+slot otherwise. constants and fixed variable addresses have no
+location, they are rematerialized as immediates or rip relative
+operands at each use
+*/
+
+//one instruction, printed into text or encoded into code
+static void ins(CodeGenerator* gen, X86Op op, const Operand& dst = {}, const Operand& src = {}){
+    if(gen->machineCode){
+        gen->code.encode({op, dst, src});
+    } else {
+        printX86(gen->text, {op, dst, src});
+    }
+    if(op != X86Op::LABEL){
+        gen->instructions++;
+    }
+}
+
+static uint32_t newLabel(CodeGenerator* gen){
+    return gen->labels++;
+}
+
+static void placeLabel(CodeGenerator* gen, uint32_t label){
+    ins(gen, X86Op::LABEL, labelOperand(label));
+}
+
+static const IrInst& inst(CodeGenerator* gen, ValueId v){
+    return gen->program->insts[v];
+}
+
+//an addr of cell 0 or of a constant cell, a fixed rip relative address
+static bool isStaticAddress(const IrProgram& program, const IrInst& in){
+    return in.op == IrOp::ADDR && (in.a == NO_VALUE || program.insts[in.a].op == IrOp::CONST);
+}
+
+static bool needsLocation(const IrProgram& program, const IrInst& in){
+    return in.type != IrType::none && in.op != IrOp::CONST && !isStaticAddress(program, in);
+}
+
+static bool fitsImm32(int64_t value){
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+//the register v lives in, or NO_REGISTER
+static uint8_t registerOf(CodeGenerator* gen, ValueId v){
+    return gen->allocation.reg[v];
+}
+
+//where v is computed: its own register, or %rax when it lives in a slot
+static uint8_t target(CodeGenerator* gen, ValueId v){
+    uint8_t reg = registerOf(gen, v);
+    return reg == NO_REGISTER ? RAX : reg;
+}
+
+//a variable's storage gets emitted by finish from now on
+static SymbolId useVariable(CodeGenerator* gen, const IrInst& address){
+    SymbolId symbol = (SymbolId)address.imm;
+    if(symbol >= gen->used.size()){
+        gen->used.resize(symbol + 1, 0);
+    }
+    gen->used[symbol] = 1;
+    return symbol;
+}
+
+//the rip relative operand of a static address
+static Operand staticOperand(CodeGenerator* gen, const IrInst& address){
+    int64_t offset = address.a == NO_VALUE ? 0 : inst(gen, address.a).imm * 8;
+    return variableOperand(useVariable(gen, address), offset);
+}
+
+static Operand slotOf(CodeGenerator* gen, ValueId v){
+    return slotOperand(gen->allocation.slot[v]);
+}
+
+static void loadImmediate(CodeGenerator* gen, int64_t value, uint8_t reg){
+    if(value >= 0 && value <= (int64_t)UINT32_MAX){
+        ins(gen, X86Op::MOV, regOperand(reg, 4), immOperand(value));
+    } else if(fitsImm32(value)){
+        ins(gen, X86Op::MOV, regOperand(reg), immOperand(value));
+    } else {
+        ins(gen, X86Op::MOVABS, regOperand(reg), immOperand(value));
+    }
+}
+
+//v into reg, nothing when it is already there
+static void loadValue(CodeGenerator* gen, ValueId v, uint8_t reg){
+    const IrInst& in = inst(gen, v);
+    if(in.op == IrOp::CONST){
+        return loadImmediate(gen, in.imm, reg);
+    }
+    if(isStaticAddress(*gen->program, in)){
+        return ins(gen, X86Op::LEA, regOperand(reg), staticOperand(gen, in));
+    }
+    uint8_t from = registerOf(gen, v);
+    if(from == reg){
+        return;
+    }
+    if(from != NO_REGISTER){
+        return ins(gen, X86Op::MOV, regOperand(reg), regOperand(from));
+    }
+    ins(gen, X86Op::MOV, regOperand(reg), slotOf(gen, v));
+}
+
+//v's register, loading it into scratch first if it has none
+static uint8_t valueRegister(CodeGenerator* gen, ValueId v, uint8_t scratch){
+    uint8_t reg = registerOf(gen, v);
+    if(reg != NO_REGISTER){
+        return reg;
+    }
+    loadValue(gen, v, scratch);
+    return scratch;
+}
+
+//v, computed in reg, to where v lives
+static void storeValue(CodeGenerator* gen, ValueId v, uint8_t reg){
+    uint8_t to = registerOf(gen, v);
+    if(to == reg){
+        return;
+    }
+    if(to != NO_REGISTER){
+        return ins(gen, X86Op::MOV, regOperand(to), regOperand(reg));
+    }
+    ins(gen, X86Op::MOV, slotOf(gen, v), regOperand(reg));
+}
+
+//v as the source operand of an alu instruction: a register, a slot or an immediate, a wide constant goes through scratch
+static Operand sourceOperand(CodeGenerator* gen, ValueId v, uint8_t scratch){
+    const IrInst& in = inst(gen, v);
+    if(in.op == IrOp::CONST){
+        if(fitsImm32(in.imm)){
+            return immOperand(in.imm);
+        }
+        loadImmediate(gen, in.imm, scratch);
+        return regOperand(scratch);
+    }
+    uint8_t reg = registerOf(gen, v);
+    if(reg != NO_REGISTER){
+        return regOperand(reg);
+    }
+    return slotOf(gen, v);
+}
+
+//memory operand of the cell an addr value points at, loading the address into %rdx if it has to be
+static Operand memoryOperand(CodeGenerator* gen, ValueId address){
+    const IrInst& in = inst(gen, address);
+    if(isStaticAddress(*gen->program, in)){
+        return staticOperand(gen, in);
+    }
+    return baseOperand(valueRegister(gen, address, RDX));
+}
+
+static X86Op setcc(IrOp op){
+    switch(op){
+        case IrOp::EQ: return X86Op::SETE;
+        case IrOp::NE: return X86Op::SETNE;
+        case IrOp::LT: return X86Op::SETL;
+        case IrOp::GT: return X86Op::SETG;
+        case IrOp::LE: return X86Op::SETLE;
+        default: return X86Op::SETGE;
+    }
+}
+
+static X86Op aluOp(IrOp op){
+    switch(op){
+        case IrOp::ADD: return X86Op::ADD;
+        case IrOp::SUB: return X86Op::SUB;
+        case IrOp::AND: return X86Op::AND;
+        case IrOp::OR: return X86Op::OR;
+        default: return X86Op::IMUL;
+    }
+}
+
+static bool isComparison(IrOp op){
+    return op == IrOp::EQ || op == IrOp::NE || op == IrOp::LT || op == IrOp::GT || op == IrOp::LE || op == IrOp::GE;
+}
+
+//idiv faults on divisors 0 and -1, a constant one is handled here and a variable one is tested for
+static void emitDivision(CodeGenerator* gen, ValueId v){
+    const IrInst& in = inst(gen, v);
+    const IrInst& right = inst(gen, in.b);
+    bool mod = in.op == IrOp::MOD;
+    loadValue(gen, in.a, RAX);
+    if(right.op == IrOp::CONST){
+        if(right.imm == 0 || (right.imm == -1 && mod)){
+            ins(gen, X86Op::XOR, regOperand(RAX, 4), regOperand(RAX, 4));
+        } else if(right.imm == -1){
+            ins(gen, X86Op::NEG, regOperand(RAX));
+        } else {
+            loadImmediate(gen, right.imm, RCX);
+            ins(gen, X86Op::CQO);
+            ins(gen, X86Op::IDIV, regOperand(RCX));
+            if(mod){ ins(gen, X86Op::MOV, regOperand(RAX), regOperand(RDX)); }
+        }
+        return storeValue(gen, v, RAX);
+    }
+    //they are exactly the divisors with divisor+1 <= 1 unsigned
+    uint8_t divisor = valueRegister(gen, in.b, RCX);
+    uint32_t special = newLabel(gen);
+    uint32_t done = newLabel(gen);
+    ins(gen, X86Op::LEA, regOperand(RDX), baseOperand(divisor, 1));
+    ins(gen, X86Op::CMP, regOperand(RDX), immOperand(1));
+    ins(gen, X86Op::JBE, labelOperand(special));
+    ins(gen, X86Op::CQO);
+    ins(gen, X86Op::IDIV, regOperand(divisor));
+    if(mod){ ins(gen, X86Op::MOV, regOperand(RAX), regOperand(RDX)); }
+    ins(gen, X86Op::JMP, labelOperand(done));
+    placeLabel(gen, special);
+    if(mod){
+        ins(gen, X86Op::XOR, regOperand(RAX, 4), regOperand(RAX, 4));
+    } else {
+        //x / 0 = 0 and x / -1 = -x
+        ins(gen, X86Op::AND, regOperand(RAX), regOperand(divisor));
+        ins(gen, X86Op::NEG, regOperand(RAX));
+    }
+    placeLabel(gen, done);
+    storeValue(gen, v, RAX);
+}
+
+//a constant right operand is folded into the instruction as an immediate
+static void emitBinary(CodeGenerator* gen, ValueId v){
+    const IrInst& in = inst(gen, v);
+    if(in.op == IrOp::DIV || in.op == IrOp::MOD){
+        return emitDivision(gen, v);
+    }
+    ValueId left = in.a;
+    ValueId right = in.b;
+    uint8_t result = target(gen, v);
+
+    if(isComparison(in.op)){
+        Operand source = sourceOperand(gen, right, RCX);
+        uint8_t reg = valueRegister(gen, left, RAX);
+        ins(gen, X86Op::CMP, regOperand(reg), source);
+        ins(gen, setcc(in.op), regOperand(result, 1));
+        ins(gen, X86Op::MOVZB, regOperand(result, 4), regOperand(result, 1));
+        return storeValue(gen, v, result);
+    }
+    if(in.op == IrOp::SHL || in.op == IrOp::SHR){
+        X86Op op = in.op == IrOp::SHL ? X86Op::SHL : X86Op::SAR;
+        const IrInst& count = inst(gen, right);
+        if(count.op == IrOp::CONST){
+            loadValue(gen, left, result);
+            ins(gen, op, regOperand(result), immOperand(count.imm & 63));
+        } else {
+            //the count is in %cl before the result register is overwritten
+            loadValue(gen, right, RCX);
+            loadValue(gen, left, result);
+            ins(gen, op, regOperand(result), regOperand(RCX, 1));
+        }
+        return storeValue(gen, v, result);
+    }
+
+    //computing in place would overwrite the right operand before it is read
+    if(result != RAX && right != left && registerOf(gen, right) == result){
+        if(isCommutative(in.op)){
+            std::swap(left, right);
+        } else {
+            result = RAX;
+        }
+    }
+    Operand source = sourceOperand(gen, right, RCX);
+    loadValue(gen, left, result);
+    ins(gen, aluOp(in.op), regOperand(result), source);
+    storeValue(gen, v, result);
+}
+
+//copies the values flowing from block into the phis at the top of target, only with mov, which leaves the flags alone
+static void phiCopies(CodeGenerator* gen, BlockId block, BlockId target){
+    const IrProgram& program = *gen->program;
+    for(uint32_t i = program.blocks[target].first; i < program.blocks[target].end && program.insts[i].op == IrOp::PHI; i++){
+        const IrInst& phi = program.insts[i];
+        for(uint32_t k = 0; k < phi.b; k++){
+            const PhiArg& arg = program.phiArgs[phi.a + k];
+            if(arg.block != block){ continue; }
+            const IrInst& value = program.insts[arg.value];
+            if(registerOf(gen, i) != NO_REGISTER){
+                loadValue(gen, arg.value, registerOf(gen, i));
+            } else if(value.op == IrOp::CONST && fitsImm32(value.imm)){
+                ins(gen, X86Op::MOV, slotOf(gen, i), immOperand(value.imm));
+            } else {
+                storeValue(gen, i, valueRegister(gen, arg.value, RAX));
+            }
+        }
+    }
+}
+
+static Operand blockLabel(CodeGenerator* gen, BlockId block){
+    return labelOperand(gen->blockBase + block);
+}
+
+static void emitInst(CodeGenerator* gen, BlockId block, ValueId v){
+    const IrInst& in = inst(gen, v);
+    switch(in.op){
+        case IrOp::CONST: case IrOp::PHI:
+            return;
+        case IrOp::ADDR: {
+            if(isStaticAddress(*gen->program, in)){ return; }
+            uint8_t index = valueRegister(gen, in.a, RAX);
+            uint8_t result = target(gen, v);
+            ins(gen, X86Op::LEA, regOperand(RDX), variableOperand(useVariable(gen, in), 0));
+            ins(gen, X86Op::LEA, regOperand(result), baseOperand(RDX, 0, index));
+            return storeValue(gen, v, result);
+        }
+        case IrOp::LOAD: {
+            Operand mem = memoryOperand(gen, in.a);
+            uint8_t result = target(gen, v);
+            ins(gen, X86Op::MOV, regOperand(result), mem);
+            return storeValue(gen, v, result);
+        }
+        case IrOp::STORE: {
+            const IrInst& value = inst(gen, in.b);
+            if(value.op == IrOp::CONST && fitsImm32(value.imm)){
+                return ins(gen, X86Op::MOV, memoryOperand(gen, in.a), immOperand(value.imm));
+            }
+            uint8_t reg = valueRegister(gen, in.b, RAX);
+            return ins(gen, X86Op::MOV, memoryOperand(gen, in.a), regOperand(reg));
+        }
+        case IrOp::JMP:
+            phiCopies(gen, block, in.b);
+            if(in.b != block + 1){ ins(gen, X86Op::JMP, blockLabel(gen, in.b)); }
+            return;
+        case IrOp::BR: {
+            //the condition is tested before the copies, so they may reuse its register
+            uint8_t reg = registerOf(gen, in.a);
+            if(reg != NO_REGISTER){
+                ins(gen, X86Op::TEST, regOperand(reg), regOperand(reg));
+            } else if(inst(gen, in.a).op != IrOp::CONST){
+                ins(gen, X86Op::CMP, slotOf(gen, in.a), immOperand(0));
+            } else {
+                loadValue(gen, in.a, RAX);
+                ins(gen, X86Op::TEST, regOperand(RAX), regOperand(RAX));
+            }
+            phiCopies(gen, block, in.b);
+            phiCopies(gen, block, in.c);
+            if(in.b == block + 1){
+                return ins(gen, X86Op::JZ, blockLabel(gen, in.c));
+            }
+            ins(gen, X86Op::JNZ, blockLabel(gen, in.b));
+            if(in.c != block + 1){ ins(gen, X86Op::JMP, blockLabel(gen, in.c)); }
+            return;
+        }
+        case IrOp::EXIT:
+            loadValue(gen, in.a, RDI);
+            return ins(gen, X86Op::EXIT);
+        default:
+            return emitBinary(gen, v);
+    }
+}
+
+void CodeGenerator::begin(std::string_view sourceName){
+    if(machineCode){
+        return code.begin(newLabel(this));
+    }
+    text += "# generated by nico from ";
+    text += sourceName;
+    text += "\n    .text\n    .globl _start\n_start:\n";
+}
+
+void CodeGenerator::emit(const IrProgram& _program){
+    program = &_program;
+    std::vector<uint8_t> needs(_program.size());
+    for(ValueId v = 0; v < _program.size(); v++){
+        needs[v] = needsLocation(_program, _program.insts[v]);
+    }
+    if(allocator == RegisterAllocator::linear){
+        allocation = allocateLinear(_program, needs, ALLOCATABLE);
+    } else {
+        allocation = allocateNaive(_program, needs);
+    }
+    slots = std::max(slots, allocation.slots);
+    values += allocation.values;
+    spilled += allocation.spilled;
+    blockBase = labels;
+    labels += (uint32_t)_program.blocks.size();
+
+    //only blocks something branches to get a label
+    std::vector<uint8_t> targeted(_program.blocks.size(), 0);
+    for(const IrInst& in : _program.insts){
+        if(in.op == IrOp::JMP){ targeted[in.b] = 1; }
+        if(in.op == IrOp::BR){ targeted[in.b] = 1; targeted[in.c] = 1; }
+    }
+
+    size_t line = 0;
+    for(BlockId b = 0; b < _program.blocks.size(); b++){
+        if(targeted[b]){
+            placeLabel(this, blockBase + b);
+        }
+        for(uint32_t i = _program.blocks[b].first; i < _program.blocks[b].end; i++){
+            for(; !machineCode && line < _program.lines.size() && _program.lines[line].inst == i; line++){
+                if(_program.lines[line].line >= 0){
+                    text += "    # line " + std::to_string(_program.lines[line].line) + "\n";
+                }
+            }
+            emitInst(this, b, i);
+        }
+    }
+    program = nullptr;
+}
+
+bool CodeGenerator::finish(std::string& err_s){
+    if(machineCode){
+        return code.link(slots, used, err_s);
+    }
+    text += "\n    .bss\n    .p2align 3\n";
+    if(slots > 0){
+        text += "nico_slots:\n    .zero " + std::to_string(slots * 8) + "\n";
+    }
+    for(SymbolId symbol = 0; symbol < used.size(); symbol++){
+        if(!used[symbol]){ continue; }
+        text += "v_";
+        text += globalSymbols().name(symbol);
+        text += ":\n    .zero " + std::to_string(VARIABLE_CELLS * 8) + "\n";
+    }
+    text += "\n    .section .note.GNU-stack,\"\",@progbits\n";
+    return true;
+}
+
+#endif
@@ -0,0 +1,368 @@
+#ifndef INCREMENTAL_CPP
+#define INCREMENTAL_CPP
+
+#include <iostream>
+#include <algorithm>
+#include <utility>
+#include <chrono>
+#include <cstring>
+
+#include "incremental.h"
+#include "tokenize.h"
+#include "timing.h"
+
+//length of the common start of a and b, n at most, whole blocks go through memcmp
+static size_t commonPrefix(const char* a, const char* b, size_t n){
+    size_t i = 0;
+    while(i + 4096 <= n && std::memcmp(a + i, b + i, 4096) == 0){ i += 4096; }
+    while(i < n && a[i] == b[i]){ i++; }
+    return i;
+}
+
+//length of the common end of the ranges ending at a and b
+static size_t commonSuffix(const char* a, const char* b, size_t n){
+    size_t i = 0;
+    while(i + 4096 <= n && std::memcmp(a - i - 4096, b - i - 4096, 4096) == 0){ i += 4096; }
+    while(i < n && a[-1 - (ptrdiff_t)i] == b[-1 - (ptrdiff_t)i]){ i++; }
+    return i;
+}
+
+//what a token compares by, its literal or its symbol, operator or keyword, never its position
+static uint64_t tokenValue(const TokenStream& tokens, uint32_t i){
+    return tokens.type(i) == TokenType::INT_LITERAL ? (uint64_t)tokens.intValue(i) : tokens.payloads[i];
+}
+
+//FNV-1a over each token's type and value, so spacing and line breaks do not change it
+static uint64_t hashTokens(const TokenStream& tokens){
+    uint64_t h = 14695981039346656037ull;
+    for(uint32_t i = 0; i < tokens.size(); i++){
+        h = (h ^ tokens.types[i]) * 1099511628211ull;
+        h = (h ^ tokenValue(tokens, i)) * 1099511628211ull;
+    }
+    return h;
+}
+
+static bool sameTokens(const TokenStream& a, const TokenStream& b){
+    if(a.size() != b.size()){ return false; }
+    for(uint32_t i = 0; i < a.size(); i++){
+        if(a.types[i] != b.types[i] || tokenValue(a, i) != tokenValue(b, i)){ return false; }
+    }
+    return true;
+}
+
+//a cached unit for tokens that this build may use again, NO_UNIT if there is none
+static uint32_t findUnit(IncrementalBuild* build, const TokenStream& tokens, uint64_t hash){
+    auto range = build->unitsByHash.equal_range(hash);
+    for(auto it = range.first; it != range.second; ++it){
+        const StatementUnit& unit = *build->units[it->second];
+        if(unit.labelled && unit.users > 0){ continue; }
+        if(sameTokens(unit.tokens, tokens)){
+            return it->second;
+        }
+    }
+    return NO_UNIT;
+}
+
+static void acquire(IncrementalBuild* build, uint32_t unit){
+    build->units[unit]->users++;
+}
+
+static void release(IncrementalBuild* build, uint32_t unit){
+    StatementUnit& u = *build->units[unit];
+    if(--u.users == 0){
+        u.released = build->builds;
+        build->released.push_back(unit);
+    }
+}
+
+static void evict(IncrementalBuild* build, uint32_t unit){
+    auto range = build->unitsByHash.equal_range(build->units[unit]->hash);
+    for(auto it = range.first; it != range.second; ++it){
+        if(it->second == unit){
+            build->unitsByHash.erase(it);
+            break;
+        }
+    }
+    build->units[unit].reset();
+    build->freeUnits.push_back(unit);
+}
+
+//the IR of one statement, lowered and optimized in builder.program, false when it can not be lowered
+static bool lowerUnit(IncrementalBuild* build, const parseTreeReturn& parseTree, const TokenStream& tokens){
+    IrBuilder& builder = build->builder;
+    builder.program.clear();
+    builder.success = true;
+    if(!builder.lower(parseTree, tokens)){
+        return false;
+    }
+    if(build->optimize){
+        std::string err_s;
+        optimizeIr(builder.program, build->stats.optimize, false, err_s);
+    }
+    return true;
+}
+
+//emits builder.program into unit, with labels no other unit has used
+static void emitUnit(IncrementalBuild* build, StatementUnit& unit){
+    IrProgram& program = build->builder.program;
+    CodeGenerator& codegen = build->codegen;
+    //the build writes line comments itself, the statement's line is not known here
+    int codeLine = program.lines.empty() ? -1 : program.lines[0].line;
+    program.lines.clear();
+    codegen.text.clear();
+    codegen.slots = 0;
+    codegen.labels = build->labels;
+    codegen.allocator = build->allocator;
+    codegen.emit(program);
+    build->labels = codegen.labels;
+    unit.assembly = codegen.text;
+    unit.slots = codegen.slots;
+    unit.lineDelta = codeLine < 0 ? -1 : codeLine - unit.tokens.lineNumber(0);
+    //takes back the variables emit marked, so the next unit starts from none
+    for(const IrInst& in : program.insts){
+        if(in.op == IrOp::JMP || in.op == IrOp::BR){
+            unit.labelled = true;
+        }
+        if(in.op == IrOp::ADDR && (SymbolId)in.imm < codegen.used.size() && codegen.used[(SymbolId)in.imm]){
+            codegen.used[(SymbolId)in.imm] = 0;
+            unit.variables.push_back((SymbolId)in.imm);
+        }
+    }
+}
+
+//compiles tokens, lexed from slice, into a new unit, NO_UNIT when the statement has an error
+static uint32_t compileUnit(IncrementalBuild* build, std::string_view slice, TokenStream&& tokens, uint64_t hash){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    build->stats.compiled++;
+    std::unique_ptr<StatementUnit> unit = std::make_unique<StatementUnit>();
+    unit->hash = hash;
+    unit->source.assign(slice);
+    unit->tokens = std::move(tokens);
+    unit->tokens.source = unit->source;
+
+    DelimiterMatch delimiters = matchDelimiters(unit->tokens);
+    bool compiled = delimiters.success;
+    if(compiled){
+        unit->parseTree = createParseTree(unit->tokens, delimiters.match, build->parse);
+        compiled = unit->parseTree.success && lowerUnit(build, unit->parseTree, unit->tokens);
+    }
+    if(compiled){
+        emitUnit(build, *unit);
+    }
+    build->stats.compileTime += millisecondsSince(start);
+    if(!compiled){
+        return NO_UNIT;
+    }
+
+    uint32_t index;
+    if(!build->freeUnits.empty()){
+        index = build->freeUnits.back();
+        build->freeUnits.pop_back();
+        build->units[index] = std::move(unit);
+    } else {
+        index = (uint32_t)build->units.size();
+        build->units.push_back(std::move(unit));
+    }
+    build->unitsByHash.emplace(hash, index);
+    return index;
+}
+
+//lexes the statement and finds or compiles its unit, returns the lines it spans
+static int buildStatement(IncrementalBuild* build, std::string_view slice, BuiltStatement& statement){
+    TokenStream tokens = tokenize(slice);
+    build->stats.bytesLexed += slice.size();
+    build->stats.tokensLexed += tokens.size();
+    int lines = (int)tokens.newlines.size();
+    statement.row = tokens.size() > 0 ? tokens.lineNumber(0) - 1 : 0;
+
+    uint64_t hash = hashTokens(tokens);
+    uint32_t unit = findUnit(build, tokens, hash);
+    if(unit != NO_UNIT){
+        build->stats.reused++;
+    } else {
+        unit = compileUnit(build, slice, std::move(tokens), hash);
+    }
+    statement.unit = unit;
+    if(unit != NO_UNIT){
+        acquire(build, unit);
+    } else {
+        build->failed++;
+    }
+    return lines;
+}
+
+/*
+reports what is wrong with source[start, end) as the default path would,
+the first delimiter error, every parse error or the first lowering error.
+failed statements are not cached, their lines move with every edit above
+*/
+static void diagnose(IncrementalBuild* build, std::string_view slice, int line, bool statement){
+    TokenStream tokens = tokenize(slice);
+    tokens.lineBase = line - 1;
+    DelimiterMatch delimiters = matchDelimiters(tokens);
+    if(!delimiters.success){
+        if(!build->delimiterError){
+            build->delimiterError = true;
+            build->delimiterErr_s = delimiters.err_s;
+            build->delimiterLine = tokens.lineNumber(delimiters.errIndex);
+            build->delimiterToken = tokens.type(delimiters.errIndex);
+        }
+        return;
+    }
+    if(!statement){ return; }
+    parseTreeReturn parseTree = createParseTree(tokens, delimiters.match, build->parse);
+    if(!parseTree.success){
+        for(ParseDiagnostic& d : parseTree.diagnostics){
+            build->diagnostics.push_back(std::move(d));
+        }
+        return;
+    }
+    IrBuilder& builder = build->builder;
+    builder.program.clear();
+    builder.success = true;
+    if(!builder.lower(parseTree, tokens) && build->err_s.empty()){
+        build->err_s = builder.err_s;
+        build->lineNumber = builder.lineNumber;
+    }
+}
+
+//header, every statement's assembly with its line, the exit and the storage, as CodeGenerator lays them out
+static void link(IncrementalBuild* build, std::string_view sourceName){
+    CodeGenerator out;
+    out.text.swap(build->assembly);
+    out.text.clear();
+    out.begin(sourceName);
+    out.used.assign(globalSymbols().size(), 0);
+    for(const BuiltStatement& statement : build->statements){
+        if(statement.unit == NO_UNIT){ continue; }
+        const StatementUnit& unit = *build->units[statement.unit];
+        if(unit.lineDelta >= 0){
+            out.text += "    # line " + std::to_string(statement.line + statement.row + unit.lineDelta) + "\n";
+        }
+        out.text += unit.assembly;
+        out.slots = std::max(out.slots, unit.slots);
+        for(SymbolId symbol : unit.variables){
+            out.used[symbol] = 1;
+        }
+    }
+    out.text += build->exitAssembly;
+    std::string err_s;
+    out.finish(err_s);
+    build->assembly.swap(out.text);
+}
+
+bool IncrementalBuild::update(std::string_view source, std::string_view sourceName){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    builds++;
+    success = true;
+    delimiterError = false;
+    diagnostics.clear();
+    err_s = "";
+    lineNumber = -1;
+    stats = IncrementalStats();
+    if(exitAssembly.empty()){
+        builder.program.clear();
+        builder.program.startBlock();
+        builder.finish();
+        StatementUnit exitUnit;
+        emitUnit(this, exitUnit);
+        exitAssembly = exitUnit.assembly;
+    }
+
+    //statements in the unchanged prefix keep their place, those in the unchanged suffix move by delta
+    size_t common = std::min(text.size(), source.size());
+    size_t prefix = commonPrefix(text.data(), source.data(), common);
+    size_t suffix = commonSuffix(text.data() + text.size(), source.data() + source.size(), common - prefix);
+    size_t suffixStart = text.size() - suffix;
+    int64_t delta = (int64_t)source.size() - (int64_t)text.size();
+    size_t first = std::partition_point(statements.begin(), statements.end(), [&](const BuiltStatement& s){
+        return s.end <= prefix;
+    }) - statements.begin();
+    //the ';' before a kept statement has to be unchanged as well
+    size_t last = std::partition_point(statements.begin() + first, statements.end(), [&](const BuiltStatement& s){
+        return s.start <= suffixStart;
+    }) - statements.begin();
+
+    for(size_t i = first; i < last; i++){
+        if(statements[i].unit == NO_UNIT){
+            failed--;
+        } else {
+            release(this, statements[i].unit);
+        }
+    }
+
+    //everything between is split again, lexed and looked up
+    uint32_t from = first < statements.size() ? statements[first].start : tailStart;
+    int line = first < statements.size() ? statements[first].line : tailLine;
+    size_t to = last < statements.size() ? (size_t)(statements[last].start + delta) : source.size();
+    std::vector<BuiltStatement> rebuilt;
+    while(from < to){
+        const char* semi = (const char*)std::memchr(source.data() + from, ';', to - from);
+        if(semi == nullptr){ break; }
+        uint32_t end = (uint32_t)(semi - source.data()) + 1;
+        BuiltStatement statement{from, end, line, 0};
+        line += buildStatement(this, source.substr(from, end - from), statement);
+        rebuilt.push_back(statement);
+        from = end;
+    }
+    int lineShift = last < statements.size() ? line - statements[last].line : 0;
+    for(size_t i = last; i < statements.size(); i++){
+        statements[i].start = (uint32_t)(statements[i].start + delta);
+        statements[i].end = (uint32_t)(statements[i].end + delta);
+        statements[i].line += lineShift;
+    }
+    if(last == statements.size()){
+        tailStart = from;
+        tailLine = line;
+    } else {
+        tailStart = (uint32_t)(tailStart + delta);
+        tailLine += lineShift;
+    }
+    stats.reused += first + (statements.size() - last);
+    statements.erase(statements.begin() + first, statements.begin() + last);
+    statements.insert(statements.begin() + first, rebuilt.begin(), rebuilt.end());
+    text.assign(source);
+
+    //units nothing used for a whole build go
+    std::vector<uint32_t> recent;
+    for(uint32_t unit : released){
+        if(units[unit] == nullptr || units[unit]->users > 0){ continue; }
+        if(units[unit]->released == builds){
+            recent.push_back(unit);
+        } else {
+            evict(this, unit);
+        }
+    }
+    released.swap(recent);
+    stats.statements = statements.size();
+    stats.units = units.size() - freeUnits.size();
+    stats.diffTime = millisecondsSince(start) - stats.compileTime;
+
+    if(failed > 0){
+        for(const BuiltStatement& statement : statements){
+            if(statement.unit == NO_UNIT){
+                diagnose(this, source.substr(statement.start, statement.end - statement.start), statement.line, true);
+            }
+        }
+    }
+    diagnose(this, source.substr(tailStart), tailLine, false);
+    success = failed == 0 && !delimiterError && diagnostics.empty() && err_s.empty();
+    if(!success){
+        return false;
+    }
+    std::chrono::steady_clock::time_point linkStart = std::chrono::steady_clock::now();
+    link(this, sourceName);
+    stats.linkTime = millisecondsSince(linkStart);
+    return true;
+}
+
+void IncrementalStats::print() const{
+    double ratio = statements > 0 ? (double)reused / statements : 1.0;
+    std::cout << "incremental: " << reused << " of " << statements << " statements reused (" << ratio * 100.0 << "%), ";
+    std::cout << compiled << " compiled, " << units << " units cached\n";
+    std::cout << "diff: " << bytesLexed / 1024.0 << " KB, " << tokensLexed << " tokens lexed again in " << diffTime << " ms\n";
+    std::cout << "compile: " << compiled << " statements in " << compileTime << " ms\n";
+    std::cout << "link: " << linkTime << " ms\n";
+}
+
+#endif
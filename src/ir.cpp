@@ -0,0 +1,653 @@
+#ifndef IR_CPP
+#define IR_CPP
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "ir.h"
+#include "operators.h"
+
+ValueId IrProgram::add(IrOp op, IrType type, uint32_t a, uint32_t b, uint32_t c, int64_t imm){
+    if(blocks.empty()){
+        startBlock();
+    }
+    IrInst inst;
+    inst.op = op;
+    inst.type = type;
+    inst.a = a;
+    inst.b = b;
+    inst.c = c;
+    inst.imm = imm;
+    insts.push_back(inst);
+    blocks.back().end = size();
+    return size() - 1;
+}
+
+ValueId IrProgram::constant(int64_t value){
+    return add(IrOp::CONST, IrType::i64, NO_VALUE, NO_VALUE, NO_VALUE, value);
+}
+
+BlockId IrProgram::startBlock(){
+    IrBlock block;
+    block.first = size();
+    block.end = size();
+    blocks.push_back(block);
+    return current();
+}
+
+void IrProgram::clear(){
+    insts.clear();
+    blocks.clear();
+    phiArgs.clear();
+    lines.clear();
+    finished = false;
+}
+
+bool isTerminator(IrOp op){
+    return op == IrOp::JMP || op == IrOp::BR || op == IrOp::EXIT;
+}
+
+bool hasSideEffects(IrOp op){
+    return op == IrOp::STORE || isTerminator(op);
+}
+
+bool isCommutative(IrOp op){
+    return op == IrOp::ADD || op == IrOp::MUL || op == IrOp::AND || op == IrOp::OR || op == IrOp::EQ || op == IrOp::NE;
+}
+
+//wrapping arithmetic is done unsigned, where overflow is defined
+int64_t evaluate(IrOp op, int64_t a, int64_t b){
+    uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+    switch(op){
+        case IrOp::ADD: return (int64_t)(ua + ub);
+        case IrOp::SUB: return (int64_t)(ua - ub);
+        case IrOp::MUL: return (int64_t)(ua * ub);
+        case IrOp::DIV:
+            if(b == 0){ return 0; }
+            if(b == -1){ return (int64_t)(0 - ua); }
+            return a / b;
+        case IrOp::MOD:
+            if(b == 0 || b == -1){ return 0; }
+            return a % b;
+        case IrOp::AND: return a & b;
+        case IrOp::OR: return a | b;
+        case IrOp::SHL: return (int64_t)(ua << (b & 63));
+        case IrOp::SHR: return a >> (b & 63);
+        case IrOp::EQ: return a == b;
+        case IrOp::NE: return a != b;
+        case IrOp::LT: return a < b;
+        case IrOp::GT: return a > b;
+        case IrOp::LE: return a <= b;
+        case IrOp::GE: return a >= b;
+        default: return 0;
+    }
+}
+
+bool readsA(const IrInst& in){
+    switch(in.op){
+        case IrOp::CONST: case IrOp::PHI: case IrOp::JMP:
+            return false;
+        case IrOp::ADDR:
+            return in.a != NO_VALUE;
+        default:
+            return true;
+    }
+}
+
+bool readsB(const IrInst& in){
+    return in.op == IrOp::STORE || (in.op >= IrOp::ADD && in.op <= IrOp::GE);
+}
+
+static void printInst(const IrProgram& program, uint32_t i){
+    const IrInst& inst = program.insts[i];
+    std::cout << "    ";
+    if(inst.type != IrType::none){
+        std::cout << "%" << i << ":" << IrTypeStrings[(int)inst.type] << " = ";
+    }
+    std::cout << IrOpStrings[(int)inst.op];
+    switch(inst.op){
+        case IrOp::CONST:
+            std::cout << " " << inst.imm;
+            break;
+        case IrOp::ADDR:
+            std::cout << " @" << globalSymbols().name((SymbolId)inst.imm);
+            if(inst.a != NO_VALUE){ std::cout << ", %" << inst.a; }
+            break;
+        case IrOp::PHI:
+            for(uint32_t k = 0; k < inst.b; k++){
+                const PhiArg& arg = program.phiArgs[inst.a + k];
+                std::cout << (k ? ", " : " ") << "[b" << arg.block << " %" << arg.value << "]";
+            }
+            break;
+        case IrOp::JMP:
+            std::cout << " b" << inst.b;
+            break;
+        case IrOp::BR:
+            std::cout << " %" << inst.a << ", b" << inst.b << ", b" << inst.c;
+            break;
+        default:
+            if(inst.a != NO_VALUE){ std::cout << " %" << inst.a; }
+            if(inst.b != NO_VALUE){ std::cout << ", %" << inst.b; }
+            break;
+    }
+    std::cout << "\n";
+}
+
+void IrProgram::print() const{
+    size_t line = 0;
+    for(BlockId b = 0; b < blocks.size(); b++){
+        std::cout << "b" << b << ":\n";
+        for(uint32_t i = blocks[b].first; i < blocks[b].end; i++){
+            for(; line < lines.size() && lines[line].inst == i; line++){
+                if(lines[line].line >= 0){
+                    std::cout << "    # line " << lines[line].line << "\n";
+                }
+            }
+            printInst(*this, i);
+        }
+    }
+}
+
+std::vector<LiveInterval> liveIntervals(const IrProgram& program){
+    std::vector<LiveInterval> live(program.size());
+    for(uint32_t i = 0; i < program.size(); i++){
+        if(program.insts[i].type != IrType::none && program.insts[i].op != IrOp::PHI){
+            live[i].start = i;
+            live[i].end = i;
+        }
+    }
+    for(uint32_t i = 0; i < program.size(); i++){
+        const IrInst& inst = program.insts[i];
+        switch(inst.op){
+            case IrOp::CONST: case IrOp::JMP:
+                break;
+            case IrOp::PHI:
+                for(uint32_t k = 0; k < inst.b; k++){
+                    const PhiArg& arg = program.phiArgs[inst.a + k];
+                    uint32_t copy = program.blocks[arg.block].end - 1;
+                    live[arg.value].end = std::max(live[arg.value].end, copy);
+                    live[i].start = std::min(live[i].start, copy);
+                }
+                live[i].end = std::max(live[i].end, i);
+                break;
+            default:
+                //a and b are the only value operands outside phis, br's targets are in b and c
+                if(inst.a != NO_VALUE){ live[inst.a].end = std::max(live[inst.a].end, i); }
+                if(inst.b != NO_VALUE && inst.op != IrOp::BR){ live[inst.b].end = std::max(live[inst.b].end, i); }
+                break;
+        }
+    }
+    return live;
+}
+
+static bool irError(std::string& err_s, const IrProgram& program, uint32_t i, const std::string& message){
+    err_s = "%" + std::to_string(i) + " (" + IrOpStrings[(int)program.insts[i].op] + "): " + message;
+    return false;
+}
+
+//result type of op, and the type its a and b operands must have
+static void signature(IrOp op, IrType* result, IrType* a, IrType* b){
+    *result = IrType::none;
+    *a = IrType::none;
+    *b = IrType::none;
+    switch(op){
+        case IrOp::CONST: *result = IrType::i64; break;
+        case IrOp::ADDR: *result = IrType::addr; *a = IrType::i64; break;
+        case IrOp::LOAD: *result = IrType::i64; *a = IrType::addr; break;
+        case IrOp::STORE: *a = IrType::addr; *b = IrType::i64; break;
+        case IrOp::PHI: *result = IrType::i64; break;
+        case IrOp::JMP: break;
+        case IrOp::BR: case IrOp::EXIT: *a = IrType::i64; break;
+        default: *result = IrType::i64; *a = IrType::i64; *b = IrType::i64; break;
+    }
+}
+
+Dominators dominators(const std::vector<std::vector<BlockId>>& preds){
+    BlockId n = (BlockId)preds.size();
+    Dominators dom;
+    dom.idom.assign(n, NO_BLOCK);
+    dom.pre.assign(n, 0);
+    dom.size.assign(n, 1);
+    if(n == 0){ return dom; }
+    dom.idom[0] = 0;
+    for(BlockId b = 1; b < n; b++){
+        BlockId d = NO_BLOCK;
+        for(BlockId p : preds[b]){
+            if(dom.idom[p] == NO_BLOCK){ continue; }
+            if(d == NO_BLOCK){ d = p; continue; }
+            BlockId x = d, y = p;
+            while(x != y){
+                while(x > y){ x = dom.idom[x]; }
+                while(y > x){ y = dom.idom[y]; }
+            }
+            d = x;
+        }
+        dom.idom[b] = d;
+    }
+    for(BlockId b = n - 1; b > 0; b--){
+        if(dom.idom[b] != NO_BLOCK){ dom.size[dom.idom[b]] += dom.size[b]; }
+    }
+    //a parent is numbered before its children, which take consecutive ranges after it
+    std::vector<uint32_t> next(n, 1);
+    for(BlockId b = 1; b < n; b++){
+        if(dom.idom[b] == NO_BLOCK){ continue; }
+        dom.pre[b] = next[dom.idom[b]];
+        next[dom.idom[b]] += dom.size[b];
+        next[b] = dom.pre[b] + 1;
+    }
+    return dom;
+}
+
+std::vector<std::vector<BlockId>> predecessors(const IrProgram& program){
+    std::vector<std::vector<BlockId>> preds(program.blocks.size());
+    for(BlockId b = 0; b < program.blocks.size(); b++){
+        const IrBlock& block = program.blocks[b];
+        if(block.end == block.first){ continue; }
+        const IrInst& term = program.insts[block.end - 1];
+        if(term.op == IrOp::JMP || term.op == IrOp::BR){ preds[term.b].push_back(b); }
+        if(term.op == IrOp::BR){ preds[term.c].push_back(b); }
+    }
+    return preds;
+}
+
+bool verifyIr(const IrProgram& program, std::string& err_s){
+    const std::vector<IrInst>& insts = program.insts;
+    const std::vector<IrBlock>& blocks = program.blocks;
+    if(blocks.empty()){
+        if(!insts.empty()){ err_s = "instructions outside any block"; return false; }
+        return true;
+    }
+
+    //blocks tile the instructions, only the last one may be open or empty
+    std::vector<BlockId> blockOf(insts.size());
+    for(BlockId b = 0; b < blocks.size(); b++){
+        uint32_t expected = b == 0 ? 0 : blocks[b-1].end;
+        bool last = b + 1 == blocks.size();
+        if(blocks[b].first != expected || blocks[b].end < blocks[b].first || (last && blocks[b].end != insts.size())){
+            err_s = "block b" + std::to_string(b) + " does not follow the block before it";
+            return false;
+        }
+        bool terminated = blocks[b].end > blocks[b].first && isTerminator(insts[blocks[b].end - 1].op);
+        if(!terminated && (!last || program.finished)){
+            err_s = "block b" + std::to_string(b) + " has no terminator";
+            return false;
+        }
+        if(terminated && last && !program.finished){
+            err_s = "open program ends in a terminator";
+            return false;
+        }
+        for(uint32_t i = blocks[b].first; i < blocks[b].end; i++){
+            blockOf[i] = b;
+            if(isTerminator(insts[i].op) && i + 1 != blocks[b].end){
+                return irError(err_s, program, i, "terminator in the middle of b" + std::to_string(b));
+            }
+        }
+    }
+
+    std::vector<std::vector<BlockId>> preds(blocks.size());
+    for(BlockId b = 0; b < blocks.size(); b++){
+        if(blocks[b].end == blocks[b].first){ continue; }
+        uint32_t t = blocks[b].end - 1;
+        const IrInst& term = insts[t];
+        if(term.op != IrOp::JMP && term.op != IrOp::BR){ continue; }
+        BlockId targets[2] = {term.b, term.c};
+        for(int k = 0; k < (term.op == IrOp::BR ? 2 : 1); k++){
+            BlockId target = targets[k];
+            if(target <= b || target >= blocks.size()){
+                return irError(err_s, program, t, "branch target must be a later block");
+            }
+            if(std::find(preds[target].begin(), preds[target].end(), b) != preds[target].end()){
+                return irError(err_s, program, t, "both targets are b" + std::to_string(target));
+            }
+            preds[target].push_back(b);
+        }
+    }
+    Dominators dom = dominators(preds);
+
+    //operand v is a value of the given type that is available at position i of block b
+    auto available = [&](uint32_t i, BlockId b, uint32_t v, IrType type, const char* what) -> bool {
+        if(v == NO_VALUE || v >= insts.size() || insts[v].type == IrType::none){
+            return irError(err_s, program, i, std::string(what) + " is not a value");
+        }
+        if(insts[v].type != type){
+            return irError(err_s, program, i, std::string(what) + " %" + std::to_string(v) + " is " + IrTypeStrings[(int)insts[v].type] + ", expected " + IrTypeStrings[(int)type]);
+        }
+        if(blockOf[v] == b ? v >= i : !dom.dominates(blockOf[v], b)){
+            return irError(err_s, program, i, std::string(what) + " %" + std::to_string(v) + " does not dominate its use");
+        }
+        return true;
+    };
+
+    for(uint32_t i = 0; i < insts.size(); i++){
+        const IrInst& inst = insts[i];
+        BlockId b = blockOf[i];
+        IrType result, a, bt;
+        signature(inst.op, &result, &a, &bt);
+        if(inst.type != result){
+            return irError(err_s, program, i, "result is " + IrTypeStrings[(int)inst.type] + ", expected " + IrTypeStrings[(int)result]);
+        }
+        switch(inst.op){
+            case IrOp::CONST: case IrOp::JMP:
+                break;
+            case IrOp::ADDR:
+                if(inst.imm < 0 || inst.imm >= globalSymbols().size()){
+                    return irError(err_s, program, i, "unknown symbol " + std::to_string(inst.imm));
+                }
+                if(inst.a != NO_VALUE && !available(i, b, inst.a, a, "index")){ return false; }
+                break;
+            case IrOp::PHI: {
+                if(i != blocks[b].first && insts[i-1].op != IrOp::PHI){
+                    return irError(err_s, program, i, "phi after a non phi instruction");
+                }
+                if(inst.a + (size_t)inst.b > program.phiArgs.size()){
+                    return irError(err_s, program, i, "arguments out of range");
+                }
+                if(inst.b != preds[b].size()){
+                    return irError(err_s, program, i, std::to_string(inst.b) + " arguments for " + std::to_string(preds[b].size()) + " predecessors");
+                }
+                for(uint32_t k = 0; k < inst.b; k++){
+                    const PhiArg& arg = program.phiArgs[inst.a + k];
+                    if(std::find(preds[b].begin(), preds[b].end(), arg.block) == preds[b].end()){
+                        return irError(err_s, program, i, "b" + std::to_string(arg.block) + " is not a predecessor");
+                    }
+                    for(uint32_t m = 0; m < k; m++){
+                        if(program.phiArgs[inst.a + m].block == arg.block){
+                            return irError(err_s, program, i, "two arguments for b" + std::to_string(arg.block));
+                        }
+                    }
+                    //the incoming value has to be available at the end of its predecessor
+                    if(!available(blocks[arg.block].end - 1, arg.block, arg.value, IrType::i64, "argument")){ return false; }
+                }
+                break;
+            }
+            default:
+                if(a != IrType::none && !available(i, b, inst.a, a, "operand a")){ return false; }
+                if(bt != IrType::none && !available(i, b, inst.b, bt, "operand b")){ return false; }
+                break;
+        }
+    }
+    return true;
+}
+
+/*
+lowering. like the parser, nodes run on an explicit stack of frames so
+deeply nested expressions do not use native stack. a node lowers a child
+by setting the step it resumes at and pushing the child (callNode), and
+finishes by popping itself and pushing its value (returnValue). the
+frame reference a node holds is invalid after either
+*/
+
+static void callNode(IrBuilder* builder, NodeId node, bool address=false){
+    IrFrame f;
+    f.node = builder->unwrap(node);
+    f.address = address;
+    builder->frames.push_back(f);
+}
+
+static void returnValue(IrBuilder* builder, ValueId value){
+    builder->frames.pop_back();
+    builder->values.push_back(value);
+}
+
+static ValueId popValue(IrBuilder* builder){
+    ValueId v = builder->values.back();
+    builder->values.pop_back();
+    return v;
+}
+
+//the arithmetic and comparison ops, assignment operators map to the op they apply
+static bool arithmeticOp(Operator op, IrOp* out){
+    switch(op){
+        case Operator::PLUS: case Operator::PLUS_ASSIGN: *out = IrOp::ADD; return true;
+        case Operator::MINUS: case Operator::MINUS_ASSIGN: *out = IrOp::SUB; return true;
+        case Operator::STAR: case Operator::STAR_ASSIGN: *out = IrOp::MUL; return true;
+        case Operator::SLASH: case Operator::SLASH_ASSIGN: *out = IrOp::DIV; return true;
+        case Operator::PERCENT: case Operator::PERCENT_ASSIGN: *out = IrOp::MOD; return true;
+        case Operator::BIT_AND: *out = IrOp::AND; return true;
+        case Operator::BIT_OR: *out = IrOp::OR; return true;
+        case Operator::SHIFT_LEFT: *out = IrOp::SHL; return true;
+        case Operator::SHIFT_RIGHT: *out = IrOp::SHR; return true;
+        case Operator::EQUAL: *out = IrOp::EQ; return true;
+        case Operator::NOT_EQUAL: *out = IrOp::NE; return true;
+        case Operator::LESS: *out = IrOp::LT; return true;
+        case Operator::GREATER: *out = IrOp::GT; return true;
+        case Operator::LESS_EQUAL: *out = IrOp::LE; return true;
+        case Operator::GREATER_EQUAL: *out = IrOp::GE; return true;
+        default: return false;
+    }
+}
+
+static ValueId arithmetic(IrBuilder* builder, IrOp op, ValueId a, ValueId b){
+    return builder->program.add(op, IrType::i64, a, b);
+}
+
+static void lowerValue(IrBuilder* builder){
+    NodeId id = builder->frames.back().node;
+    uint32_t token = builder->arena->at(id).token;
+    if(builder->tokens->type(token) != TokenType::INT_LITERAL){
+        return builder->fail(id, "string literals are not supported");
+    }
+    returnValue(builder, builder->program.constant(builder->tokens->intValue(token)));
+}
+
+//a[i][j] folds its indices row major into one cell index
+static void lowerVariable(IrBuilder* builder){
+    IrFrame& f = builder->frames.back();
+    const Node& n = builder->arena->at(f.node);
+    IrProgram& program = builder->program;
+    int64_t symbol = builder->tokens->symbol(n.token);
+
+    //step s has the first s indices lowered, their row major sum so far below the newest on the value stack
+    if(f.step >= 2){
+        ValueId index = popValue(builder);
+        ValueId rows = popValue(builder);
+        ValueId shifted = arithmetic(builder, IrOp::SHL, rows, program.constant(__builtin_ctz(ARRAY_ROW_CELLS)));
+        builder->values.push_back(arithmetic(builder, IrOp::ADD, shifted, index));
+    }
+    if(f.step < n.childCount){
+        NodeId index = builder->arena->child(f.node, f.step);
+        f.step++;
+        return callNode(builder, index);
+    }
+
+    ValueId cell = NO_VALUE;
+    if(n.childCount > 0){
+        cell = arithmetic(builder, IrOp::AND, popValue(builder), program.constant(VARIABLE_CELLS - 1));
+    }
+    ValueId address = program.add(IrOp::ADDR, IrType::addr, cell, NO_VALUE, NO_VALUE, symbol);
+    if(f.address){
+        return returnValue(builder, address);
+    }
+    returnValue(builder, program.add(IrOp::LOAD, IrType::i64, address));
+}
+
+static void lowerAssignment(IrBuilder* builder){
+    IrFrame& f = builder->frames.back();
+    Operator op = builder->operatorOf(f.node, 1);
+    switch(f.step){
+    case 0: {
+        NodeId target = builder->unwrap(builder->arena->child(f.node, 0));
+        if(builder->arena->at(target).type != NodeType::variable){
+            return builder->fail(f.node, "left side of " + OperatorStrings[(int)op] + " must be a variable");
+        }
+        f.step = 1;
+        return callNode(builder, target, true);
+    }
+    case 1:
+        f.step = 2;
+        return callNode(builder, builder->arena->child(f.node, 2));
+    default: {
+        ValueId value = popValue(builder);
+        ValueId address = popValue(builder);
+        IrOp arith;
+        if(op != Operator::ASSIGN && arithmeticOp(op, &arith)){
+            ValueId old = builder->program.add(IrOp::LOAD, IrType::i64, address);
+            value = arithmetic(builder, arith, old, value);
+        }
+        builder->program.add(IrOp::STORE, IrType::none, address, value);
+        return returnValue(builder, value);
+    }
+    }
+}
+
+/*
+a && b branches around b when a is 0, a || b when a is not, and a phi
+picks the short circuit constant or b != 0 in the block that follows
+*/
+static void lowerLogical(IrBuilder* builder){
+    IrFrame& f = builder->frames.back();
+    IrProgram& program = builder->program;
+    bool isAnd = builder->operatorOf(f.node, 1) == Operator::AND;
+    switch(f.step){
+    case 0:
+        f.step = 1;
+        return callNode(builder, builder->arena->child(f.node, 0));
+    case 1: {
+        ValueId left = popValue(builder);
+        f.value = program.constant(isAnd ? 0 : 1);
+        f.block = program.current();
+        f.branch = program.add(IrOp::BR, IrType::none, left);
+        BlockId right = program.startBlock();
+        if(isAnd){ program.insts[f.branch].b = right; } else { program.insts[f.branch].c = right; }
+        f.step = 2;
+        return callNode(builder, builder->arena->child(f.node, 2));
+    }
+    default: {
+        ValueId right = popValue(builder);
+        ValueId truth = arithmetic(builder, IrOp::NE, right, program.constant(0));
+        BlockId rightEnd = program.current();
+        ValueId jump = program.add(IrOp::JMP, IrType::none);
+        BlockId join = program.startBlock();
+        program.insts[jump].b = join;
+        if(isAnd){ program.insts[f.branch].c = join; } else { program.insts[f.branch].b = join; }
+        uint32_t args = (uint32_t)program.phiArgs.size();
+        program.phiArgs.push_back({f.block, f.value});
+        program.phiArgs.push_back({rightEnd, truth});
+        return returnValue(builder, program.add(IrOp::PHI, IrType::i64, args, 2));
+    }
+    }
+}
+
+static void lowerBinary(IrBuilder* builder){
+    IrFrame& f = builder->frames.back();
+    Operator op = builder->operatorOf(f.node, 1);
+    switch(op){
+        case Operator::ASSIGN: case Operator::PLUS_ASSIGN: case Operator::MINUS_ASSIGN:
+        case Operator::STAR_ASSIGN: case Operator::SLASH_ASSIGN: case Operator::PERCENT_ASSIGN:
+            return lowerAssignment(builder);
+        case Operator::AND: case Operator::OR:
+            return lowerLogical(builder);
+        default:
+            break;
+    }
+    IrOp arith;
+    if(!arithmeticOp(op, &arith)){
+        return builder->fail(f.node, "operator " + OperatorStrings[(int)op] + " is not supported");
+    }
+    switch(f.step){
+    case 0:
+        f.step = 1;
+        return callNode(builder, builder->arena->child(f.node, 0));
+    case 1:
+        f.step = 2;
+        return callNode(builder, builder->arena->child(f.node, 2));
+    default: {
+        ValueId right = popValue(builder);
+        ValueId left = popValue(builder);
+        return returnValue(builder, arithmetic(builder, arith, left, right));
+    }
+    }
+}
+
+//prefix and postfix ++, -- and !, kids are (operator) (operand) or (operand) (operator)
+static void lowerUnary(IrBuilder* builder){
+    IrFrame& f = builder->frames.back();
+    IrProgram& program = builder->program;
+    bool prefix = builder->arena->at(f.node).subtype == NodeSubType::prefix_unary;
+    NodeId operand = builder->unwrap(builder->arena->child(f.node, prefix ? 1 : 0));
+    Operator op = builder->operatorOf(f.node, prefix ? 0 : 1);
+
+    if(f.step == 0){
+        if(op != Operator::NOT && builder->arena->at(operand).type != NodeType::variable){
+            return builder->fail(f.node, "operand of " + OperatorStrings[(int)op] + " must be a variable");
+        }
+        f.step = 1;
+        return callNode(builder, operand, op != Operator::NOT);
+    }
+    if(op == Operator::NOT){
+        return returnValue(builder, arithmetic(builder, IrOp::EQ, popValue(builder), program.constant(0)));
+    }
+    ValueId address = popValue(builder);
+    ValueId old = program.add(IrOp::LOAD, IrType::i64, address);
+    ValueId updated = arithmetic(builder, op == Operator::INCREMENT ? IrOp::ADD : IrOp::SUB, old, program.constant(1));
+    program.add(IrOp::STORE, IrType::none, address, updated);
+    returnValue(builder, prefix ? updated : old);
+}
+
+//exit ends the block, whatever follows a return is lowered into one nothing reaches
+static void lowerReturn(IrBuilder* builder){
+    IrFrame& f = builder->frames.back();
+    IrProgram& program = builder->program;
+    if(builder->arena->at(f.node).childCount > 0 && f.step == 0){
+        f.step = 1;
+        return callNode(builder, builder->arena->child(f.node, 0));
+    }
+    ValueId status = f.step == 0 ? program.constant(0) : popValue(builder);
+    program.add(IrOp::EXIT, IrType::none, status);
+    program.startBlock();
+    returnValue(builder, NO_VALUE);
+}
+
+void IrBuilder::statement(NodeId root){
+    frames.clear();
+    values.clear();
+    callNode(this, root);
+    while(success && !frames.empty()){
+        NodeId id = frames.back().node;
+        const Node& n = arena->at(id);
+        switch(n.type){
+            case NodeType::value:
+                lowerValue(this);
+                break;
+            case NodeType::variable:
+                lowerVariable(this);
+                break;
+            case NodeType::statement:
+                switch(n.subtype){
+                    case NodeSubType::binary_op: lowerBinary(this); break;
+                    case NodeSubType::prefix_unary: case NodeSubType::postfix_unary: lowerUnary(this); break;
+                    case NodeSubType::_return: lowerReturn(this); break;
+                    case NodeSubType::func_call: fail(id, "function calls are not supported"); break;
+                    default: fail(id, "unexpected statement"); break;
+                }
+                break;
+            default:
+                fail(id, "unexpected " + NodeTypeStrings[(int)n.type] + " node");
+                break;
+        }
+    }
+}
+
+bool IrBuilder::lower(const parseTreeReturn& parseTree, const TokenStream& _tokens){
+    tokens = &_tokens;
+    if(program.blocks.empty()){
+        program.startBlock();
+    }
+    for(const StackTrace& trace : parseTree.traces){
+        if(!success){ break; }
+        arena = &parseTree.arenaOf(trace);
+        program.lines.push_back({program.size(), nodeLine(*arena, *tokens, trace.node)});
+        statement(trace.node);
+        statements++;
+    }
+    return success;
+}
+
+void IrBuilder::finish(){
+    program.add(IrOp::EXIT, IrType::none, program.constant(0));
+    program.finished = true;
+}
+
+#endif
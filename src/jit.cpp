@@ -0,0 +1,37 @@
+#ifndef JIT_CPP
+#define JIT_CPP
+
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+
+#include "jit.h"
+
+JitProgram::~JitProgram(){
+    if(mapping != nullptr){
+        munmap(mapping, mappingSize);
+    }
+}
+
+bool JitProgram::load(const MachineCode& code){
+    mappingSize = code.dataStart + code.dataSize;
+    void* p = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED){
+        err_s = std::strerror(errno);
+        return false;
+    }
+    mapping = p;
+    std::memcpy(mapping, code.bytes.data(), code.bytes.size());
+    //never writable and executable at once
+    if(mprotect(mapping, code.dataStart, PROT_READ | PROT_EXEC) != 0){
+        err_s = std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+int64_t JitProgram::run(){
+    return reinterpret_cast<int64_t (*)()>(mapping)();
+}
+
+#endif
@@ -1,10 +1,33 @@
 //  
 
 /*
-usage: nico [source].v [target].S 
+usage: nico [source].v ([target].S | --run | --interpret[=threaded|switch|tree]) [-q|--quiet] [-j N] [--max-depth N] [--pipeline|--stream|--watch] [--cache DIR] [-O0] [--regalloc=naive|linear] [--emit-ir] [--verify-ir] [--parse-stats] [--stats]
+       nico ([source].v... | --manifest FILE) [-j N] [--max-depth N] [--cache DIR] [-O0] [--regalloc=naive|linear] [--verify-ir] [--stats]
+       nico --serve SOCKET [-j N] [--stats]
+       nico --connect SOCKET ([source].v | -) [target].S [-q|--quiet] [--max-depth N] [-O0] [--regalloc=naive|linear] [--stats]
+the target is x86-64 linux assembly, see codegen.h, --run executes the
+program in process instead and exits with its status, see jit.h, and
+--interpret runs it on the bytecode vm without generating code, see vm.h.
+--watch rebuilds the target every time the source changes, compiling
+only the statements that did, see incremental.h. --cache keeps lexed and
+parsed sources in DIR, so a run on an unchanged file does neither, see
+astCache.h.
+--stream compiles the file a chunk at a time, see stream.h. memory stays
+flat for assembly, around 100 MB from a few MB of source up on a
+generated corpus, but --run keeps the machine code and --interpret the
+bytecode of every chunk until the program runs, so with those it grows
+with the file, about 4 MB per MB of source for --interpret.
+given several sources, or a manifest of them, each [source].v is
+compiled to [source].S, -j of them at once, see build.h. nothing is
+echoed and errors are printed file by file in the order given.
+--serve keeps a compile server on a unix socket, keeping what it built
+between requests, and --connect has it compile a source, - for stdin,
+see serve.h. the server compiles the way --watch does. with NICO_SERVER
+set to a server's socket, quiet compiles of one source to assembly are
+sent to it, so build scripts use the server unchanged
 assembler:  as -o [target].o [target].S
-linker:     ld -macos_version_min 15.0.0 -o [target] [target].o -lSystem -syslibroot `xcrun -sdk macosx --show-sdk-path` -e _start -arch arm64
-running:    ./[target]
+linker:     ld -o [target] [target].o
+running:    ./[target]; echo $?
 
 
 build with cmake --build build/
@@ -12,94 +35,830 @@ when updating cmakelists use cmake -S . -B build/
 
 
 main.cpp
+  - sourceFile.h
   - tokenize.h
   - parseTree.h
-*/
-
-
-/*
-Working on:
-  * changing parse functions to return a stack trace object, 
-    that can track errors through calls.
-
-    right now if you call "return ();" it simply returns (statement) - return,
-    when it should be an error. this is because the call to find return's
-    argument fails, but not because it doesnt exist but because its not valid
-
-    adding the stack trace objects will allow this to be checked
-
-  * operator chaining doesnt work, not even (1+2)+3
-    this is because there is not check that all tokens in a line
-    are used, and a similar schema to parseArgument should be used
-    in statement
+  - pipeline.h
+  - stream.h
+  - ir.h
+  - optimize.h
+  - codegen.h
+    - regalloc.h
+    - x86.h
+  - jit.h
+  - bytecode.h
+  - vm.h
+  - incremental.h
+  - astCache.h
+  - build.h
+  - serve.h
+  - timing.h
 */
 
 #include <iostream>
 #include <vector>
+#include <cstdlib>
+#include <utility>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <thread>
+#include <iterator>
+#include <csignal>
+#include <climits>
+#include <unistd.h>
+#include <sys/stat.h>
 
 //used for reading source file
-#include <fstream> 
-#include <sstream>
+#include "sourceFile.h"
+
+//phase timings and peak memory for --stats
+#include <chrono>
+#include <sys/resource.h>
 
 #include "token.h"
 #include "tokenize.h"
 #include "parseTree.h"
+#include "pipeline.h"
+#include "stream.h"
+#include "ir.h"
+#include "optimize.h"
+#include "codegen.h"
+#include "jit.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "incremental.h"
+#include "astCache.h"
+#include "build.h"
+#include "serve.h"
+#include "timing.h"
+
+//polling interval of --watch
+#define WATCH_POLL_MS 50
 
 std::ostream& operator<<(std::ostream& out, TokenType t){ return out << TokenTypeStrings[(int)t]; }
 std::ostream& operator<<(std::ostream& out, NodeType t){ return out << NodeTypeStrings[(int)t]; }
 std::ostream& operator<<(std::ostream& out, NodeSubType t){ return out << NodeSubTypeStrings[(int)t]; };
 
+//peak resident set size of the process so far
+double peakMemoryMB(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); //bytes
+#else
+    return usage.ru_maxrss / 1024.0;            //kilobytes
+#endif
+}
+
+//flags that change what main prints or checks, not what it compiles
+struct DriverOptions{
+    bool quiet = false;     //skips echoing the source, tokens, parse tree and assembly
+    bool stats = false;
+    bool parseStats = false;
+    bool emitIr = false;
+    bool verifyIr = false;  //checks the IR before code is generated from it, and after every pass
+    bool optimize = true;   //-O0 generates code straight from the lowered IR
+    RegisterAllocator allocator = RegisterAllocator::linear;
+    bool run = false;       //executes the machine code in process instead of writing assembly
+    bool interpret = false; //runs the parse trees on the vm instead of lowering them to IR
+    VmDispatch dispatch = VmDispatch::threaded;
+};
+
+/*
+--interpret: parse trees are compiled to bytecode as they come and the
+program runs once the last one is in, with --interpret=tree they are
+evaluated as they come instead. nothing is assembled, the status is the
+exit code as it would be for the executable
+*/
+struct Interpreter{
+    VmDispatch dispatch = VmDispatch::threaded;
+    BytecodeBuilder builder;
+    TreeWalker walker;
+    double compileTime = 0;     //compiling bytecode, or walking trees
+
+    void add(const parseTreeReturn& parseTree, const TokenStream& tokens){
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if(dispatch == VmDispatch::tree){
+            walker.run(parseTree, tokens);
+        } else if(builder.success){
+            builder.lower(parseTree, tokens);
+        }
+        compileTime += millisecondsSince(start);
+    }
+
+    int finish(const char* fname, const DriverOptions& driver){
+        if(dispatch == VmDispatch::tree){
+            if(!walker.success){
+                std::cerr << fname << ":" << walker.lineNumber << ": " << walker.err_s << "\n";
+                return EXIT_FAILURE;
+            }
+            if(driver.stats){
+                double rate = walker.result.instructions / (compileTime / 1000.0) / 1e6;
+                std::cout << "tree: " << walker.result.instructions << " nodes in " << compileTime << " ms (" << rate << " M nodes/s), returned " << walker.result.status << "\n";
+            }
+            return (int)(walker.result.status & 0xff);
+        }
+        if(!builder.success){
+            std::cerr << fname << ":" << builder.lineNumber << ": " << builder.err_s << "\n";
+            return EXIT_FAILURE;
+        }
+        builder.finish();
+        const Bytecode& program = builder.program;
+        if(driver.emitIr){
+            std::cout << "bytecode:\n-----------------------------\n";
+            program.print();
+            std::cout << "\n-----------------------------\n";
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<int64_t> cells(program.variables.size() * VARIABLE_CELLS, 0);
+        VmResult result = runBytecode(program, cells.data(), dispatch);
+        double time = millisecondsSince(start);
+        if(driver.stats){
+            VmDispatch used = threadedDispatchAvailable() ? dispatch : VmDispatch::switched;
+            std::cout << "bytecode: " << program.code.size() << " instructions, " << program.registers << " registers, compiled in " << compileTime << " ms\n";
+            std::cout << "vm: " << result.instructions << " instructions in " << time << " ms (" << result.instructions / (time / 1000.0) / 1e6;
+            std::cout << " M/s, " << VmDispatchStrings[(int)used] << "), returned " << result.status << "\n";
+        }
+        return (int)(result.status & 0xff);
+    }
+};
+
+void printCodegenStats(const CodeGenerator& codegen){
+    std::cout << "regalloc: " << codegen.values << " values, " << codegen.spilled << " spilled to " << codegen.slots << " slots (";
+    std::cout << RegisterAllocatorStrings[(int)codegen.allocator] << "), " << codegen.instructions << " instructions\n";
+}
+
+//--run: loads what codegen encoded and runs it, the status is the process exit code as it would be for the executable
+int runProgram(const CodeGenerator& codegen, const DriverOptions& driver){
+    JitProgram program;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if(!program.load(codegen.code)){
+        std::cerr << "Failed to map machine code: " << program.err_s << "\n";
+        return EXIT_FAILURE;
+    }
+    int64_t status = program.run();
+    if(driver.stats){
+        std::cout << "run: " << codegen.code.bytes.size() / 1024.0 << " KB of machine code, returned " << status << " in " << millisecondsSince(start) << " ms\n";
+    }
+    return (int)(status & 0xff);
+}
+
+bool writeTarget(const char* path, const std::string& text){
+    std::ofstream out(path, std::ios::binary);
+    out.write(text.data(), text.size());
+    out.close();
+    if(!out){
+        std::cerr << "Failed to write file \"" << path << "\"\n";
+        return false;
+    }
+    return true;
+}
+
+/*
+--stream: the file is compiled chunk by chunk and each chunk's trees are
+printed as soon as it is parsed, so unlike the default path statements
+before an error have already been written out. assembly is written to
+target chunk by chunk as well, and the file is removed if anything fails.
+--emit-ir prints each chunk's IR after its trees, block numbers restart
+with every chunk. with --run and --interpret chunks are encoded one after
+another and run once the last one is in, so only the trees are freed
+chunk by chunk and the encoded program grows with the file
+*/
+int streamMain(const char* fname, const char* target, const DriverOptions& driver, const ParseOptions& parseOptions){
+    std::ofstream out;
+    bool writes = !driver.run && !driver.interpret;
+    if(writes){
+        out.open(target, std::ios::binary);
+        if(!out){
+            std::cerr << "Failed to write file \"" << target << "\"\n";
+            return EXIT_FAILURE;
+        }
+    }
+    IrBuilder builder;
+    CodeGenerator codegen;
+    codegen.allocator = driver.allocator;
+    codegen.machineCode = driver.run;
+    codegen.begin(fname);
+    double codegenTime = 0;
+    bool irValid = true;
+    std::string irErr_s;
+    OptimizeStats optimizeStats;
+    Interpreter interpreter;
+    interpreter.dispatch = driver.dispatch;
+    //checks, optimizes and emits what builder holds, then frees it
+    auto emitChunk = [&](){
+        if(irValid && driver.verifyIr){
+            irValid = verifyIr(builder.program, irErr_s);
+        }
+        if(irValid && driver.optimize){
+            irValid = optimizeIr(builder.program, optimizeStats, driver.verifyIr, irErr_s);
+        }
+        if(driver.emitIr){
+            builder.program.print();
+        }
+        if(irValid){
+            codegen.emit(builder.program);
+            if(writes){
+                out.write(codegen.text.data(), codegen.text.size());
+            }
+        }
+        codegen.text.clear();
+        builder.program.clear();
+    };
+
+    if(!driver.quiet){
+        std::cout << "parse tree:\n-----------------------------\n";
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    StreamResult result = compileStream(fname, parseOptions, [&](const TokenStream& tokens, const parseTreeReturn& parseTree){
+        if(!parseTree.success){ return; }
+        if(!driver.quiet){
+            for(const StackTrace& trace : parseTree.traces){
+                parseTree.arenaOf(trace).at(trace.node).print(parseTree.arenaOf(trace), tokens);
+                std::cout << "\n";
+            }
+        }
+        if(driver.interpret){
+            return interpreter.add(parseTree, tokens);
+        }
+        if(!builder.success){ return; }
+        std::chrono::steady_clock::time_point codegenStart = std::chrono::steady_clock::now();
+        if(builder.lower(parseTree, tokens)){
+            emitChunk();
+        }
+        codegenTime += millisecondsSince(codegenStart);
+    });
+    if(builder.success && !driver.interpret){
+        builder.finish();
+        emitChunk();
+    }
+    std::string linkErr_s;
+    bool linked = codegen.finish(linkErr_s);
+    if(writes){
+        out.write(codegen.text.data(), codegen.text.size());
+        out.close();
+    }
+    double time = millisecondsSince(start) - codegenTime - interpreter.compileTime;
+    if(!driver.quiet){
+        std::cout << "\n-----------------------------\n";
+    }
+
+    bool written = !!out;
+    if(writes && (!result.success || !builder.success || !irValid || !written)){
+        std::remove(target);
+    }
+    if(!result.err_s.empty()){
+        std::cerr << "Failed to read file \"" << fname << "\": " << result.err_s << "\n";
+        return EXIT_FAILURE;
+    }
+    if(result.delimiterError){
+        std::cerr << fname << ":" << result.delimiterLine << ": " << result.delimiterErr_s;
+        std::cerr << " [" << result.delimiterToken << "]\n";
+        return EXIT_FAILURE;
+    }
+    if(driver.stats){
+        double megabytes = result.bytes / (1024.0 * 1024.0);
+        std::cout << "stats:\n-----------------------------\n";
+        std::cout << "source: " << megabytes << " MB in " << result.chunks << " chunks, largest " << result.largestChunk / 1024.0 << " KB\n";
+        std::cout << "lex + parse: " << result.tokens << " tokens, " << result.statements << " statements in " << time << " ms (streamed)\n";
+        if(!driver.interpret){
+            std::cout << "ir + codegen: " << builder.statements << " statements in " << codegenTime << " ms\n";
+            if(driver.optimize){
+                optimizeStats.print();
+            }
+            printCodegenStats(codegen);
+        }
+        std::cout << "peak memory: " << peakMemoryMB() << " MB\n";
+        std::cout << "-----------------------------\n";
+    }
+    if(driver.parseStats){
+        std::cout << "parse stats:\n-----------------------------\n";
+        result.stats.print();
+        std::cout << "-----------------------------\n";
+    }
+    if(!result.success){
+        std::cout << "Errors in creating parse tree\n";
+        for(int i = 0; i < (int)result.diagnostics.size(); i++){
+            result.diagnostics.at(i).print();
+        }
+        return EXIT_FAILURE;
+    }
+    if(driver.interpret){
+        return interpreter.finish(fname, driver);
+    }
+    if(!builder.success){
+        std::cerr << fname << ":" << builder.lineNumber << ": " << builder.err_s << "\n";
+        return EXIT_FAILURE;
+    }
+    if(!irValid){
+        std::cerr << fname << ": invalid IR: " << irErr_s << "\n";
+        return EXIT_FAILURE;
+    }
+    if(!written){
+        std::cerr << "Failed to write file \"" << target << "\"\n";
+        return EXIT_FAILURE;
+    }
+    if(!linked){
+        std::cerr << fname << ": " << linkErr_s << "\n";
+        return EXIT_FAILURE;
+    }
+    if(driver.run){
+        return runProgram(codegen, driver);
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+--watch: builds target, then polls fname and builds it again every time
+it changes, until the process is interrupted. only statements whose
+tokens changed are compiled again, see incremental.h. a build with
+errors reports them like the default path and leaves target as it was
+*/
+int watchMain(const char* fname, const char* target, const DriverOptions& driver, const ParseOptions& parseOptions){
+    IncrementalBuild build;
+    build.optimize = driver.optimize;
+    build.allocator = driver.allocator;
+    build.parse = parseOptions;
+    struct timespec seen = {-1, 0};
+    off_t seenSize = -1;
+    while(true){
+        struct stat info;
+        bool found = stat(fname, &info) == 0;
+#ifdef __APPLE__
+        struct timespec modified = found ? info.st_mtimespec : seen;
+#else
+        struct timespec modified = found ? info.st_mtim : seen;
+#endif
+        bool changed = found && (modified.tv_sec != seen.tv_sec || modified.tv_nsec != seen.tv_nsec || info.st_size != seenSize);
+        if(!changed){
+            std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_POLL_MS));
+            continue;
+        }
+        seen = modified;
+        seenSize = info.st_size;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        SourceFile source;
+        if(!source.open(fname)){
+            std::cerr << "Failed to open file \"" << fname << "\": " << source.err_s << "\n";
+            continue;
+        }
+        bool built = build.update(source.text, fname);
+        bool written = built && writeTarget(target, build.assembly);
+        double time = millisecondsSince(start);
+        if(driver.stats){
+            std::cout << "stats:\n-----------------------------\n";
+            std::cout << "source: " << source.text.size() / (1024.0 * 1024.0) << " MB\n";
+            build.stats.print();
+            if(driver.optimize){
+                build.stats.optimize.print();
+            }
+            std::cout << "peak memory: " << peakMemoryMB() << " MB\n";
+            std::cout << "-----------------------------\n";
+        }
+        if(build.delimiterError){
+            std::cerr << fname << ":" << build.delimiterLine << ": " << build.delimiterErr_s;
+            std::cerr << " [" << build.delimiterToken << "]\n";
+        } else if(!build.diagnostics.empty()){
+            std::cout << "Errors in creating parse tree\n";
+            for(int i = 0; i < (int)build.diagnostics.size(); i++){
+                build.diagnostics.at(i).print();
+            }
+        } else if(!build.success){
+            std::cerr << fname << ":" << build.lineNumber << ": " << build.err_s << "\n";
+        } else if(written){
+            std::cout << fname << ": wrote " << target << " in " << time << " ms, ";
+            std::cout << build.stats.reused << " of " << build.stats.statements << " statements reused\n";
+        }
+        std::cout.flush();
+    }
+}
+
+/*
+several sources or --manifest, see build.h. the files are compiled on
+options.threads threads, then what each one reported is printed file by
+file in the order given
+*/
+int buildMain(std::vector<BuildJob>& jobs, const DriverOptions& driver, const BuildOptions& options){
+    BuildStats stats = buildFiles(jobs, options);
+    for(const BuildJob& job : jobs){
+        std::cout << job.out;
+        if(!job.err.empty()){
+            std::cout.flush();
+            std::cerr << job.err;
+        }
+    }
+    if(driver.stats){
+        std::cout << "stats:\n-----------------------------\n";
+        stats.print();
+        std::cout << "peak memory: " << peakMemoryMB() << " MB\n";
+        std::cout << "-----------------------------\n";
+    }
+    return stats.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//socket removed when the server is stopped
+static char servedSocket[PATH_MAX];
+
+static void stopServing(int){
+    unlink(servedSocket);
+    _exit(EXIT_SUCCESS);
+}
+
+//--serve: see serve.h, runs until the process is interrupted or terminated
+int serveMain(const char* socketPath, int threads, const DriverOptions& driver){
+    CompileServer server;
+    server.socketPath = socketPath;
+    server.threads = threads;
+    server.log = driver.stats;
+    if(!server.listen()){
+        std::cerr << "Failed to serve on \"" << socketPath << "\": " << server.err_s << "\n";
+        return EXIT_FAILURE;
+    }
+    std::snprintf(servedSocket, sizeof(servedSocket), "%s", socketPath);
+    std::signal(SIGINT, stopServing);
+    std::signal(SIGTERM, stopServing);
+    std::cout << "serving on " << socketPath << " with " << threads << " threads\n";
+    std::cout.flush();
+    server.run();
+    return EXIT_SUCCESS;
+}
+
+/*
+--connect, or NICO_SERVER: the server at socketPath compiles fname and
+this prints what it reported and writes target, so the exit status and
+the files are those of compiling here. a path is sent made absolute,
+the server reads the file itself
+*/
+int connectMain(const char* socketPath, const char* fname, const char* target, const DriverOptions& driver, const ParseOptions& parseOptions){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ServeRequest request;
+    request.name = fname;
+    request.optimize = driver.optimize;
+    request.allocator = driver.allocator;
+    request.maxDepth = parseOptions.maxDepth;
+    if(request.name == "-"){
+        request.text.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    } else if(fname[0] == '/'){
+        request.path = fname;
+    } else {
+        char cwd[PATH_MAX];
+        if(getcwd(cwd, sizeof(cwd)) == nullptr){
+            std::cerr << "Failed to open file \"" << fname << "\": working directory unknown\n";
+            return EXIT_FAILURE;
+        }
+        request.path = std::string(cwd) + "/" + fname;
+    }
+    ServeResponse response;
+    std::string err_s;
+    if(!requestCompile(socketPath, request, response, err_s)){
+        std::cerr << "Failed to reach compile server \"" << socketPath << "\": " << err_s << "\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << response.out;
+    if(!response.err.empty()){
+        std::cout.flush();
+        std::cerr << response.err;
+    }
+    if(response.status == EXIT_SUCCESS && !writeTarget(target, response.assembly)){
+        return EXIT_FAILURE;
+    }
+    if(driver.stats){
+        std::cout << "serve: " << response.assembly.size() / 1024.0 << " KB of assembly in " << millisecondsSince(start) << " ms\n";
+    }
+    return response.status;
+}
+
 int main(int argc, const char * argv[]) {
-    if(argc < 3){
+    std::vector<std::string> positional;
+    DriverOptions driver;
+    ParseOptions parseOptions;
+    bool pipeline = false; //lexes on a second thread while parsing, ignores -j
+    bool stream = false;   //constant memory, chunk by chunk
+    bool watch = false;    //rebuilds on every change, never returns
+    std::string cacheDir;  //--cache, where lexed and parsed sources are kept between runs
+    std::string manifest;  //--manifest, a list of sources to build
+    bool threadsGiven = false;
+    std::string serveSocket;   //--serve
+    std::string connectSocket; //--connect
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if(arg == "--parse-stats"){ driver.parseStats = true; }
+        else if(arg == "-q" || arg == "--quiet"){ driver.quiet = true; }
+        else if(arg == "--stats"){ driver.stats = true; }
+        else if(arg == "--emit-ir"){ driver.emitIr = true; }
+        else if(arg == "--verify-ir"){ driver.verifyIr = true; }
+        else if(arg == "-O0"){ driver.optimize = false; }
+        else if(arg == "--regalloc=naive"){ driver.allocator = RegisterAllocator::naive; }
+        else if(arg == "--regalloc=linear"){ driver.allocator = RegisterAllocator::linear; }
+        else if(arg == "--run"){ driver.run = true; }
+        else if(arg == "--interpret" || arg == "--interpret=threaded"){ driver.interpret = true; driver.dispatch = VmDispatch::threaded; }
+        else if(arg == "--interpret=switch"){ driver.interpret = true; driver.dispatch = VmDispatch::switched; }
+        else if(arg == "--interpret=tree"){ driver.interpret = true; driver.dispatch = VmDispatch::tree; }
+        else if(arg == "--pipeline"){ pipeline = true; }
+        else if(arg == "--stream"){ stream = true; }
+        else if(arg == "--watch"){ watch = true; }
+        else if(arg == "--cache" && i + 1 < argc){ cacheDir = argv[++i]; }
+        else if(arg == "--manifest" && i + 1 < argc){ manifest = argv[++i]; }
+        else if(arg == "--serve" && i + 1 < argc){ serveSocket = argv[++i]; }
+        else if(arg == "--connect" && i + 1 < argc){ connectSocket = argv[++i]; }
+        else if(arg == "-j" && i + 1 < argc){ parseOptions.threads = std::atoi(argv[++i]); threadsGiven = true; }
+        else if(arg.rfind("-j", 0) == 0 && arg.size() > 2){ parseOptions.threads = std::atoi(arg.c_str() + 2); threadsGiven = true; }
+        else if(arg == "--max-depth" && i + 1 < argc){ parseOptions.maxDepth = std::atoi(argv[++i]); }
+        else { positional.push_back(arg); }
+    }
+
+    bool executes = driver.run || driver.interpret;
+    //several sources build each one to its own target, a lone source is followed by its target
+    bool sources = positional.size() > 1;
+    for(const std::string& arg : positional){
+        sources = sources && arg.size() > 2 && arg.compare(arg.size() - 2, 2, ".v") == 0;
+    }
+    bool building = sources || !manifest.empty();
+    if(!building && serveSocket.empty() && positional.size() < (executes ? 1u : 2u)){
         std::cerr << "Incorrect usage. Correct usage is...\n";
-        std::cerr << "nicotine [source].v [target].S\n";
+        std::cerr << "nicotine [source].v ([target].S | --run | --interpret[=threaded|switch|tree]) [-q|--quiet] [-j N] [--max-depth N] [--pipeline|--stream|--watch] [--cache DIR] [-O0] [--regalloc=naive|linear] [--emit-ir] [--verify-ir] [--parse-stats] [--stats]\n";
+        std::cerr << "nicotine ([source].v... | --manifest FILE) [-j N] [--max-depth N] [--cache DIR] [-O0] [--regalloc=naive|linear] [--verify-ir] [--stats]\n";
+        std::cerr << "nicotine --serve SOCKET [-j N] [--stats]\n";
+        std::cerr << "nicotine --connect SOCKET ([source].v | -) [target].S [-q|--quiet] [--max-depth N] [-O0] [--regalloc=naive|linear] [--stats]\n";
+        return EXIT_FAILURE;
+    }
+    if(parseOptions.threads < 1){
+        std::cerr << "-j expects a thread count of at least 1\n";
+        return EXIT_FAILURE;
+    }
+    if(parseOptions.maxDepth < 1){
+        std::cerr << "--max-depth expects a limit of at least 1\n";
         return EXIT_FAILURE;
     }
 
-    std::string source_str;
-    const char* fname = argv[1];
-    
-    std::ifstream file;
-    file.open(fname);
-    if(!file.is_open()){
-        std::cerr << "Failed to open file \"" << fname << "\"\n";
+    if(!cacheDir.empty() && (stream || watch)){
+        std::cerr << "--cache can not be combined with --stream or --watch\n";
+        return EXIT_FAILURE;
+    }
+    if(watch && (executes || stream || pipeline)){
+        std::cerr << "--watch writes assembly, it can not be combined with --run, --interpret, --stream or --pipeline\n";
+        return EXIT_FAILURE;
+    }
+
+    if(!serveSocket.empty()){
+        if(!positional.empty() || !manifest.empty() || !connectSocket.empty()){
+            std::cerr << "--serve takes its sources from requests, not from the command line\n";
+            return EXIT_FAILURE;
+        }
+        return serveMain(serveSocket.c_str(), threadsGiven ? parseOptions.threads : std::max(1u, std::thread::hardware_concurrency()), driver);
+    }
+    //one source to assembly with nothing the server leaves out, see serve.h
+    bool servable = !building && positional.size() == 2 && !executes && !stream && !pipeline && !watch && cacheDir.empty();
+    servable = servable && !driver.emitIr && !driver.verifyIr && !driver.parseStats;
+    if(!connectSocket.empty()){
+        if(!servable){
+            std::cerr << "--connect compiles one source to assembly, it can not be combined with several sources, --run, --interpret, ";
+            std::cerr << "--stream, --pipeline, --watch, --cache, --emit-ir, --verify-ir or --parse-stats\n";
+            return EXIT_FAILURE;
+        }
+        return connectMain(connectSocket.c_str(), positional.at(0).c_str(), positional.at(1).c_str(), driver, parseOptions);
+    }
+    //nothing is echoed by the server, so only quiet compiles go to it
+    const char* server = std::getenv("NICO_SERVER");
+    if(server != nullptr && server[0] != '\0' && servable && driver.quiet){
+        return connectMain(server, positional.at(0).c_str(), positional.at(1).c_str(), driver, parseOptions);
+    }
+
+    if(building){
+        if(executes || stream || pipeline || watch || driver.emitIr || driver.parseStats){
+            std::cerr << "several sources are built to assembly file by file, which can not be combined with ";
+            std::cerr << "--run, --interpret, --stream, --pipeline, --watch, --emit-ir or --parse-stats\n";
+            return EXIT_FAILURE;
+        }
+        std::vector<BuildJob> jobs;
+        std::string manifestErr_s;
+        if(!manifest.empty() && !readManifest(manifest.c_str(), jobs, manifestErr_s)){
+            std::cerr << manifestErr_s << "\n";
+            return EXIT_FAILURE;
+        }
+        for(const std::string& arg : positional){
+            BuildJob job;
+            job.source = arg;
+            job.target = defaultTarget(arg);
+            jobs.push_back(std::move(job));
+        }
+        BuildOptions options;
+        options.threads = threadsGiven ? parseOptions.threads : std::max(1u, std::thread::hardware_concurrency());
+        options.parse = parseOptions;
+        options.optimize = driver.optimize;
+        options.verifyIr = driver.verifyIr;
+        options.allocator = driver.allocator;
+        options.cacheDir = cacheDir;
+        return buildMain(jobs, driver, options);
+    }
+
+    const char* fname = positional.at(0).c_str();
+    const char* target = executes ? nullptr : positional.at(1).c_str();
+    if(watch){
+        return watchMain(fname, target, driver, parseOptions);
+    }
+    if(stream){
+        return streamMain(fname, target, driver, parseOptions);
+    }
+
+    std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+    SourceFile source;
+    if(!source.open(fname)){
+        std::cerr << "Failed to open file \"" << fname << "\": " << source.err_s << "\n";
         return 1;
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    source_str = buffer.str();
-    file.close();
-    std::cout << "input source (" << fname << "):\n-----------------------------\n";
-    std::cout << source_str;
-    std::cout << "\n-----------------------------\n";
-    
-    std::vector<Token> tokens = tokenize(source_str);
+    double loadTime = millisecondsSince(loadStart);
+    if(!driver.quiet){
+        std::cout << "input source (" << fname << "):\n-----------------------------\n";
+        std::cout << source.text;
+        std::cout << "\n-----------------------------\n";
+    }
+
+    TokenStream tokens;
+    DelimiterMatch delimiters;
+    parseTreeReturn parseTree;
+    double lexTime = 0;
+    double parseTime = 0;
+    double pipelineTime = 0;
+    AstCache cache;
+    cache.dir = cacheDir;
+    cache.maxDepth = parseOptions.maxDepth;
+    bool cached = false;
+    double cacheTime = 0;
+    if(!cache.dir.empty()){
+        std::chrono::steady_clock::time_point cacheStart = std::chrono::steady_clock::now();
+        cached = cache.load(source.text, tokens, parseTree);
+        cacheTime = millisecondsSince(cacheStart);
+    }
+    if(cached){
+        //lexed and parsed by an earlier run
+    } else if(pipeline){
+        //lexing and parsing overlap, so only their total is timed
+        std::chrono::steady_clock::time_point pipelineStart = std::chrono::steady_clock::now();
+        PipelineResult result = lexAndParse(source.text, parseOptions);
+        pipelineTime = millisecondsSince(pipelineStart);
+        tokens = std::move(result.tokens);
+        delimiters = std::move(result.delimiters);
+        parseTree = std::move(result.parseTree);
+    } else {
+        std::chrono::steady_clock::time_point lexStart = std::chrono::steady_clock::now();
+        tokens = tokenize(source.text);
+        lexTime = millisecondsSince(lexStart);
+    }
 
-    std::cout << "tokens:\n-----------------------------\n";
-    printTokens(tokens);
-    std::cout << "\n-----------------------------\n";
+    if(!driver.quiet){
+        std::cout << "tokens:\n-----------------------------\n";
+        printTokens(tokens);
+        std::cout << "\n-----------------------------\n";
+    }
 
+    if(!pipeline && !cached){
+        delimiters = matchDelimiters(tokens);
+    }
+    if(!delimiters.success){
+        std::cerr << fname << ":" << tokens.lineNumber(delimiters.errIndex) << ": " << delimiters.err_s;
+        std::cerr << " [" << tokens.type(delimiters.errIndex) << "]\n";
+        return EXIT_FAILURE;
+    }
 
+    if(!pipeline && !cached){
+        std::chrono::steady_clock::time_point parseStart = std::chrono::steady_clock::now();
+        parseTree = createParseTree(tokens, delimiters.match, parseOptions);
+        parseTime = millisecondsSince(parseStart);
+    }
+    double storeTime = 0;
+    if(!cached && !cache.dir.empty() && parseTree.success){
+        std::chrono::steady_clock::time_point storeStart = std::chrono::steady_clock::now();
+        if(!cache.store(source.text, tokens, parseTree)){
+            std::cerr << "Failed to write cache entry \"" << cache.path() << "\": " << cache.err_s << "\n";
+        }
+        storeTime = millisecondsSince(storeStart);
+    }
 
-    parseTreeReturn parseTree = createParseTree(tokens); 
-    std::cout << "parse tree:\n-----------------------------\n";
-    std::cout << "(" << parseTree.traces.size() << ")\n";
+    IrBuilder builder;
+    CodeGenerator codegen;
+    codegen.allocator = driver.allocator;
+    codegen.machineCode = driver.run;
+    std::string linkErr_s;
+    bool linked = true;
+    double lowerTime = 0;
+    double codegenTime = 0;
+    bool irValid = true;
+    std::string irErr_s;
+    OptimizeStats optimizeStats;
+    uint32_t loweredSize = 0;
+    if(parseTree.success && !driver.interpret){
+        std::chrono::steady_clock::time_point lowerStart = std::chrono::steady_clock::now();
+        builder.lower(parseTree, tokens);
+        builder.finish();
+        lowerTime = millisecondsSince(lowerStart);
+        loweredSize = builder.program.size();
+        if(builder.success && driver.verifyIr){
+            irValid = verifyIr(builder.program, irErr_s);
+        }
+        if(builder.success && irValid && driver.optimize){
+            irValid = optimizeIr(builder.program, optimizeStats, driver.verifyIr, irErr_s);
+        }
+    }
+    if(builder.success && irValid && !driver.interpret){
+        std::chrono::steady_clock::time_point codegenStart = std::chrono::steady_clock::now();
+        codegen.begin(fname);
+        codegen.emit(builder.program);
+        linked = codegen.finish(linkErr_s);
+        codegenTime = millisecondsSince(codegenStart);
+    }
+    if(driver.stats){
+        double megabytes = source.text.size() / (1024.0 * 1024.0);
+        std::cout << "stats:\n-----------------------------\n";
+        std::cout << "source: " << megabytes << " MB\n";
+        std::cout << "load: " << loadTime << " ms (" << (source.mapped ? "mmap" : "read") << ")\n";
+        if(cached){
+            std::cout << "cache: hit, " << tokens.size() << " tokens, " << parseTree.traces.size() << " statements loaded in " << cacheTime;
+            std::cout << " ms (" << cache.bytes / 1024.0 << " KB entry)\n";
+        } else if(pipeline){
+            std::cout << "lex + parse: " << tokens.size() << " tokens, " << parseTree.traces.size() << " statements in " << pipelineTime << " ms (pipelined)\n";
+        } else {
+            std::cout << "lex: " << tokens.size() << " tokens in " << lexTime << " ms (" << megabytes / (lexTime / 1000.0) << " MB/s)\n";
+            std::cout << "parse: " << parseTree.traces.size() << " statements in " << parseTime << " ms (" << parseTree.arenas.size() << " threads)\n";
+        }
+        if(!cached && !cache.dir.empty()){
+            std::cout << "cache: miss, stored " << cache.bytes / 1024.0 << " KB in " << storeTime << " ms\n";
+        }
+        if(!driver.interpret){
+            std::cout << "ir: " << loweredSize << " instructions lowered in " << lowerTime << " ms\n";
+            if(driver.optimize){
+                optimizeStats.print();
+            }
+            std::cout << "ir: " << builder.program.size() << " instructions in " << builder.program.blocks.size() << " blocks\n";
+            if(driver.run){
+                std::cout << "codegen: " << codegen.code.bytes.size() / 1024.0 << " KB of machine code in " << codegenTime << " ms\n";
+            } else {
+                std::cout << "codegen: " << codegen.text.size() / 1024.0 << " KB of assembly in " << codegenTime << " ms\n";
+            }
+            printCodegenStats(codegen);
+        }
+        std::cout << "peak memory: " << peakMemoryMB() << " MB\n";
+        std::cout << "-----------------------------\n";
+    }
+    if(driver.parseStats){
+        std::cout << "parse stats:\n-----------------------------\n";
+        parseTree.stats.print();
+        std::cout << "-----------------------------\n";
+    }
+    if(!driver.quiet || !parseTree.success){
+        std::cout << "parse tree:\n-----------------------------\n";
+        std::cout << "(" << parseTree.traces.size() << ")\n";
+    }
     if(parseTree.success == false){
         std::cout << "Errors in creating parse tree\n";
+        for(int i = 0; i < (int)parseTree.diagnostics.size(); i++){
+            parseTree.diagnostics.at(i).print();
+        }
         return EXIT_FAILURE;
-    } else {
-        for(int i = 0; i < parseTree.traces.size(); i++){
-            parseTree.traces.at(i).node->print(0);
+    } else if(!driver.quiet){
+        for(int i = 0; i < (int)parseTree.traces.size(); i++){
+            const StackTrace& trace = parseTree.traces.at(i);
+            parseTree.arenaOf(trace).at(trace.node).print(parseTree.arenaOf(trace), tokens);
             std::cout << "\n";
         }
+        std::cout << "\n-----------------------------\n";
     }
-    std::cout << "\n-----------------------------\n";
 
-    /*
-    std::cout << "assembly:\n-----------------------------\n";
-    std::cout << compile(tokens);
-    std::cout << "\n-----------------------------\n";
-    */
-    
+    if(driver.interpret){
+        Interpreter interpreter;
+        interpreter.dispatch = driver.dispatch;
+        interpreter.add(parseTree, tokens);
+        return interpreter.finish(fname, driver);
+    }
+    if(!builder.success){
+        std::cerr << fname << ":" << builder.lineNumber << ": " << builder.err_s << "\n";
+        return EXIT_FAILURE;
+    }
+    if(driver.emitIr){
+        std::cout << "ir:\n-----------------------------\n";
+        builder.program.print();
+        std::cout << "\n-----------------------------\n";
+    }
+    if(!irValid){
+        std::cerr << fname << ": invalid IR: " << irErr_s << "\n";
+        return EXIT_FAILURE;
+    }
+    if(!linked){
+        std::cerr << fname << ": " << linkErr_s << "\n";
+        return EXIT_FAILURE;
+    }
+    if(driver.run){
+        return runProgram(codegen, driver);
+    }
+    if(!driver.quiet){
+        std::cout << "assembly:\n-----------------------------\n";
+        std::cout << codegen.text;
+        std::cout << "\n-----------------------------\n";
+    }
+    if(!writeTarget(target, codegen.text)){
+        return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,707 @@
+#ifndef OPTIMIZE_CPP
+#define OPTIMIZE_CPP
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <bit>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+
+#include "optimize.h"
+
+void OptimizeStats::print() const{
+    std::cout << "opt: " << before << " -> " << after << " instructions in " << time << " ms (";
+    std::cout << folded << " folded, " << simplified << " simplified, " << branches << " branches, " << reused << " reused, " << removed << " removed)\n";
+}
+
+//what an instruction of the old program became
+struct Folded{
+    bool known = false;         //a constant, only materialized where something uses it
+    int64_t imm = 0;
+    ValueId value = NO_VALUE;   //otherwise its value in the new program
+};
+
+//a constant phi argument, materialized at the end of its predecessor
+struct EdgeConstant{
+    ValueId phi;    //old
+    BlockId pred;   //old
+    ValueId value;  //new
+};
+
+struct FoldState{
+    const IrProgram* old = nullptr;
+    IrProgram* program = nullptr;
+    OptimizeStats* stats = nullptr;
+    std::vector<Folded> folded;                 //indexed by old ValueId
+    std::vector<uint8_t> boolean;               //indexed by new ValueId, the value is 0 or 1
+    std::vector<std::vector<BlockId>> incoming; //indexed by old BlockId, predecessors that still branch to it
+    std::vector<BlockId> blockMap;              //old block to the new block it starts in
+    std::vector<BlockId> endBlock;              //old block to the new block its terminator ended up in
+    std::vector<EdgeConstant> edgeConstants;
+    std::vector<ValueId> fixups;                //new branches whose targets are still old blocks
+    BlockId pendingJump = NO_BLOCK;             //old target of a jump, emitted or merged away when the next block starts
+};
+
+static bool isComparison(IrOp op){
+    return op >= IrOp::EQ && op <= IrOp::GE;
+}
+
+//the comparison that gives the same result with its operands swapped
+static IrOp mirrored(IrOp op){
+    switch(op){
+        case IrOp::LT: return IrOp::GT;
+        case IrOp::GT: return IrOp::LT;
+        case IrOp::LE: return IrOp::GE;
+        case IrOp::GE: return IrOp::LE;
+        default: return op;
+    }
+}
+
+static ValueId emit(FoldState* s, IrOp op, IrType type, uint32_t a=NO_VALUE, uint32_t b=NO_VALUE, uint32_t c=NO_VALUE, int64_t imm=0){
+    s->boolean.push_back(isComparison(op) || (op == IrOp::CONST && (imm == 0 || imm == 1)));
+    return s->program->add(op, type, a, b, c, imm);
+}
+
+static ValueId constant(FoldState* s, int64_t value){
+    return emit(s, IrOp::CONST, IrType::i64, NO_VALUE, NO_VALUE, NO_VALUE, value);
+}
+
+static ValueId materialize(FoldState* s, const Folded& f){
+    return f.known ? constant(s, f.imm) : f.value;
+}
+
+static void setKnown(FoldState* s, ValueId old, int64_t value){
+    s->folded[old].known = true;
+    s->folded[old].imm = value;
+}
+
+static void setValue(FoldState* s, ValueId old, ValueId value){
+    s->folded[old].value = value;
+}
+
+static bool isConstant(FoldState* s, ValueId v, int64_t value){
+    const IrInst& in = s->program->insts[v];
+    return in.op == IrOp::CONST && in.imm == value;
+}
+
+/*
+x op c where x is not known. the result is known, is x itself, or is one
+cheaper instruction, false when none of the identities apply
+*/
+static bool simplifyConstant(FoldState* s, ValueId i, IrOp op, ValueId x, int64_t c){
+    uint64_t u = (uint64_t)c;
+    switch(op){
+        case IrOp::ADD:
+            if(c == 0){ setValue(s, i, x); return true; }
+            return false;
+        case IrOp::MUL:
+            if(c == 0){ setKnown(s, i, 0); return true; }
+            if(c == 1){ setValue(s, i, x); return true; }
+            if(c == -1){ setValue(s, i, emit(s, IrOp::SUB, IrType::i64, constant(s, 0), x)); return true; }
+            if(u > 1 && (u & (u - 1)) == 0){
+                setValue(s, i, emit(s, IrOp::SHL, IrType::i64, x, constant(s, std::countr_zero(u))));
+                return true;
+            }
+            return false;
+        case IrOp::DIV:
+            if(c == 0){ setKnown(s, i, 0); return true; }
+            if(c == 1){ setValue(s, i, x); return true; }
+            if(c == -1){ setValue(s, i, emit(s, IrOp::SUB, IrType::i64, constant(s, 0), x)); return true; }
+            return false;
+        case IrOp::MOD:
+            if(c == 0 || c == 1 || c == -1){ setKnown(s, i, 0); return true; }
+            return false;
+        case IrOp::AND:
+            if(c == 0){ setKnown(s, i, 0); return true; }
+            if(c == -1){ setValue(s, i, x); return true; }
+            return false;
+        case IrOp::OR:
+            if(c == 0){ setValue(s, i, x); return true; }
+            if(c == -1){ setKnown(s, i, -1); return true; }
+            return false;
+        case IrOp::SHL: case IrOp::SHR:
+            if((c & 63) == 0){ setValue(s, i, x); return true; }
+            return false;
+        case IrOp::EQ:
+            if(c == 1 && s->boolean[x]){ setValue(s, i, x); return true; }
+            return false;
+        case IrOp::NE:
+            if(c == 0 && s->boolean[x]){ setValue(s, i, x); return true; }
+            return false;
+        case IrOp::LT:
+            if(c == INT64_MIN){ setKnown(s, i, 0); return true; }
+            return false;
+        case IrOp::GE:
+            if(c == INT64_MIN){ setKnown(s, i, 1); return true; }
+            return false;
+        case IrOp::GT:
+            if(c == INT64_MAX){ setKnown(s, i, 0); return true; }
+            return false;
+        case IrOp::LE:
+            if(c == INT64_MAX){ setKnown(s, i, 1); return true; }
+            return false;
+        default:
+            return false;
+    }
+}
+
+static void foldBinary(FoldState* s, ValueId i){
+    const IrInst& in = s->old->insts[i];
+    IrOp op = in.op;
+    Folded x = s->folded[in.a];
+    Folded y = s->folded[in.b];
+    if(x.known && y.known){
+        s->stats->folded++;
+        return setKnown(s, i, evaluate(op, x.imm, y.imm));
+    }
+
+    //constants go right, where the backend takes them as immediates
+    if(x.known && (isCommutative(op) || mirrored(op) != op)){
+        std::swap(x, y);
+        op = mirrored(op);
+    }
+    if(y.known){
+        //x - c is x + -c, so it chains with other additions
+        if(op == IrOp::SUB){
+            op = IrOp::ADD;
+            y.imm = (int64_t)(0 - (uint64_t)y.imm);
+        }
+        ValueId value = x.value;
+        int64_t c = y.imm;
+        bool changed = false;
+        for(;;){
+            if(simplifyConstant(s, i, op, value, c)){
+                s->stats->simplified++;
+                return;
+            }
+            //(x op c1) op c2 is x op (c1 op c2) for the associative ops
+            if(op != IrOp::ADD && op != IrOp::MUL && op != IrOp::AND && op != IrOp::OR){ break; }
+            IrInst def = s->program->insts[value];
+            if(def.op != op || s->program->insts[def.b].op != IrOp::CONST){ break; }
+            c = evaluate(op, s->program->insts[def.b].imm, c);
+            value = def.a;
+            changed = true;
+        }
+        if(changed){ s->stats->simplified++; }
+        return setValue(s, i, emit(s, op, IrType::i64, value, constant(s, c)));
+    }
+    if(x.known){
+        //sub, div, mod and shifts with a known left operand
+        bool zero = (x.imm == 0 && op != IrOp::SUB) || (x.imm == -1 && op == IrOp::SHR);
+        if(zero){
+            s->stats->simplified++;
+            return setKnown(s, i, x.imm);
+        }
+        return setValue(s, i, emit(s, op, IrType::i64, constant(s, x.imm), y.value));
+    }
+    if(x.value == y.value){
+        switch(op){
+            case IrOp::SUB: case IrOp::MOD: case IrOp::NE: case IrOp::LT: case IrOp::GT:
+                s->stats->simplified++;
+                return setKnown(s, i, 0);
+            case IrOp::EQ: case IrOp::LE: case IrOp::GE:
+                s->stats->simplified++;
+                return setKnown(s, i, 1);
+            case IrOp::AND: case IrOp::OR:
+                s->stats->simplified++;
+                return setValue(s, i, x.value);
+            default:
+                break;
+        }
+    }
+    setValue(s, i, emit(s, op, IrType::i64, x.value, y.value));
+}
+
+//a phi left with one incoming value, or the same one from everywhere, is that value
+static void foldPhi(FoldState* s, BlockId b, ValueId i){
+    const IrInst& in = s->old->insts[i];
+    const std::vector<BlockId>& preds = s->incoming[b];
+    IrProgram& program = *s->program;
+    uint32_t first = (uint32_t)program.phiArgs.size();
+    Folded common;
+    bool same = true;
+    bool boolean = true;
+    for(uint32_t k = 0; k < in.b; k++){
+        const PhiArg& arg = s->old->phiArgs[in.a + k];
+        if(std::find(preds.begin(), preds.end(), arg.block) == preds.end()){ continue; }
+        const Folded& f = s->folded[arg.value];
+        ValueId value = f.value;
+        if(f.known){
+            for(const EdgeConstant& edge : s->edgeConstants){
+                if(edge.phi == i && edge.pred == arg.block){ value = edge.value; }
+            }
+        }
+        if(program.phiArgs.size() == first){
+            common = f;
+        } else if(f.known != common.known || (f.known ? f.imm != common.imm : f.value != common.value)){
+            same = false;
+        }
+        boolean = boolean && s->boolean[value];
+        program.phiArgs.push_back({s->endBlock[arg.block], value});
+    }
+    uint32_t count = (uint32_t)program.phiArgs.size() - first;
+    if(same){
+        if(in.b > 1){ s->stats->simplified++; }
+        program.phiArgs.resize(first);
+        s->folded[i] = common;
+        return;
+    }
+    setValue(s, i, emit(s, IrOp::PHI, IrType::i64, first, count));
+    s->boolean.back() = boolean;
+}
+
+static void branchTo(FoldState* s, BlockId from, BlockId target){
+    s->incoming[target].push_back(from);
+    //constant arguments for the target's phis have to exist before the branch
+    const IrBlock& block = s->old->blocks[target];
+    for(ValueId p = block.first; p < block.end && s->old->insts[p].op == IrOp::PHI; p++){
+        const IrInst& phi = s->old->insts[p];
+        for(uint32_t k = 0; k < phi.b; k++){
+            const PhiArg& arg = s->old->phiArgs[phi.a + k];
+            if(arg.block == from && s->folded[arg.value].known){
+                s->edgeConstants.push_back({p, from, constant(s, s->folded[arg.value].imm)});
+            }
+        }
+    }
+}
+
+static void jumpTo(FoldState* s, BlockId from, BlockId target){
+    branchTo(s, from, target);
+    s->endBlock[from] = s->program->current();
+    s->pendingJump = target;
+}
+
+static void foldTerminator(FoldState* s, BlockId b, ValueId t){
+    const IrInst& in = s->old->insts[t];
+    IrProgram& program = *s->program;
+    if(in.op == IrOp::EXIT){
+        ValueId status = materialize(s, s->folded[in.a]);
+        s->endBlock[b] = program.current();
+        emit(s, IrOp::EXIT, IrType::none, status);
+        return;
+    }
+    if(in.op == IrOp::JMP){
+        return jumpTo(s, b, in.b);
+    }
+    const Folded& condition = s->folded[in.a];
+    if(condition.known){
+        s->stats->branches++;
+        return jumpTo(s, b, condition.imm != 0 ? in.b : in.c);
+    }
+    //branching on x != 0 is branching on x, on x == 0 the targets swap
+    ValueId value = condition.value;
+    BlockId taken = in.b;
+    BlockId notTaken = in.c;
+    for(;;){
+        const IrInst& def = program.insts[value];
+        if((def.op != IrOp::EQ && def.op != IrOp::NE) || !isConstant(s, def.b, 0)){ break; }
+        if(def.op == IrOp::EQ){ std::swap(taken, notTaken); }
+        value = def.a;
+        s->stats->simplified++;
+    }
+    branchTo(s, b, taken);
+    branchTo(s, b, notTaken);
+    s->endBlock[b] = program.current();
+    s->fixups.push_back(emit(s, IrOp::BR, IrType::none, value, taken, notTaken));
+}
+
+static void foldInst(FoldState* s, BlockId b, ValueId i){
+    const IrInst& in = s->old->insts[i];
+    switch(in.op){
+        case IrOp::CONST:
+            return setKnown(s, i, in.imm);
+        case IrOp::ADDR: {
+            //a known cell is a fixed address, cell 0 is written like a plain name
+            ValueId index = NO_VALUE;
+            if(in.a != NO_VALUE){
+                const Folded& f = s->folded[in.a];
+                if(f.known && f.imm == 0){
+                    s->stats->simplified++;
+                } else {
+                    index = materialize(s, f);
+                }
+            }
+            return setValue(s, i, emit(s, IrOp::ADDR, IrType::addr, index, NO_VALUE, NO_VALUE, in.imm));
+        }
+        case IrOp::LOAD:
+            return setValue(s, i, emit(s, IrOp::LOAD, IrType::i64, s->folded[in.a].value));
+        case IrOp::STORE: {
+            ValueId value = materialize(s, s->folded[in.b]);
+            emit(s, IrOp::STORE, IrType::none, s->folded[in.a].value, value);
+            return;
+        }
+        case IrOp::PHI:
+            return foldPhi(s, b, i);
+        case IrOp::JMP: case IrOp::BR: case IrOp::EXIT:
+            return foldTerminator(s, b, i);
+        default:
+            return foldBinary(s, i);
+    }
+}
+
+//a block reached only by the jump that ended the block before it continues that block
+static void beginBlock(FoldState* s, BlockId b){
+    if(s->pendingJump == b && s->incoming[b].size() == 1){
+        s->pendingJump = NO_BLOCK;
+        return;
+    }
+    if(s->pendingJump != NO_BLOCK){
+        s->fixups.push_back(emit(s, IrOp::JMP, IrType::none, NO_VALUE, s->pendingJump));
+        s->pendingJump = NO_BLOCK;
+    }
+    s->program->startBlock();
+}
+
+void foldConstants(IrProgram& program, OptimizeStats& stats){
+    if(program.blocks.empty()){
+        return;
+    }
+    IrProgram old = std::move(program);
+    program.clear();
+    program.finished = old.finished;
+
+    FoldState state;
+    state.old = &old;
+    state.program = &program;
+    state.stats = &stats;
+    state.folded.resize(old.size());
+    state.boolean.reserve(old.size());
+    state.incoming.resize(old.blocks.size());
+    state.blockMap.resize(old.blocks.size(), NO_BLOCK);
+    state.endBlock.resize(old.blocks.size(), NO_BLOCK);
+
+    program.insts.reserve(old.size());
+    program.startBlock();
+    size_t line = 0;
+    for(BlockId b = 0; b < old.blocks.size(); b++){
+        const IrBlock& block = old.blocks[b];
+        if(b > 0 && state.incoming[b].empty()){
+            //nothing branches here, it is only laid out after a terminator
+            stats.removed += block.end - block.first;
+            for(; line < old.lines.size() && old.lines[line].inst < block.end; line++){}
+            continue;
+        }
+        if(b > 0){
+            beginBlock(&state, b);
+        }
+        state.blockMap[b] = program.current();
+        for(ValueId i = block.first; i < block.end; i++){
+            for(; line < old.lines.size() && old.lines[line].inst == i; line++){
+                program.lines.push_back({program.size(), old.lines[line].line});
+            }
+            foldInst(&state, b, i);
+        }
+        std::erase_if(state.edgeConstants, [&](const EdgeConstant& edge){ return edge.phi < block.end; });
+    }
+    for(; line < old.lines.size(); line++){
+        program.lines.push_back({program.size(), old.lines[line].line});
+    }
+
+    //an open program whose tail was unreachable still needs an open block for the next chunk
+    const IrBlock& last = program.blocks.back();
+    if(!program.finished && last.end > last.first && isTerminator(program.insts[last.end - 1].op)){
+        program.startBlock();
+    }
+    for(ValueId branch : state.fixups){
+        IrInst& in = program.insts[branch];
+        in.b = state.blockMap[in.b];
+        if(in.op == IrOp::BR){
+            in.c = state.blockMap[in.c];
+        }
+    }
+}
+
+//what makes two instructions compute the same value, operands are already numbered
+struct ValueKey{
+    IrOp op;
+    uint32_t a = NO_VALUE;
+    uint32_t b = NO_VALUE;
+    int64_t imm = 0;
+
+    bool operator==(const ValueKey&) const = default;
+};
+
+static uint64_t hashKey(const ValueKey& key){
+    uint64_t h = (uint64_t)key.imm * 0x9e3779b97f4a7c15ull;
+    h ^= ((uint64_t)key.a << 32 | key.b) + 0x632be59bd9b4e019ull + (h << 6) + (h >> 2);
+    h ^= (uint64_t)key.op * 0xff51afd7ed558ccdull;
+    return h ^ (h >> 29);
+}
+
+//a store is keyed as the load it makes redundant
+static ValueKey keyOf(const IrInst& in){
+    ValueKey key;
+    key.op = in.op == IrOp::STORE ? IrOp::LOAD : in.op;
+    key.a = in.a;
+    key.b = in.op == IrOp::STORE ? NO_VALUE : in.b;
+    if(in.op == IrOp::CONST || in.op == IrOp::ADDR){
+        key.imm = in.imm;
+    }
+    //a op b and b op a, or a < b and b > a, get the same key
+    if(key.op >= IrOp::ADD && key.a > key.b && (isCommutative(in.op) || mirrored(in.op) != in.op)){
+        std::swap(key.a, key.b);
+        key.op = mirrored(in.op);
+    }
+    return key;
+}
+
+struct NumberState{
+    IrProgram* program = nullptr;
+    OptimizeStats* stats = nullptr;
+    Dominators dom;
+    std::vector<BlockId> blockOf;
+    std::vector<ValueId> number;    //indexed by ValueId, the earlier value it was found equal to
+    /*
+    open addressing over instructions, each key maps to the latest
+    instruction with it, which is usable where its block dominates. keys
+    are read back from the instructions, so a slot is only an index
+    */
+    std::vector<ValueId> table;
+    uint64_t mask = 0;
+    /*
+    stores counted per variable and per constant cell, in layout order.
+    every path between two positions only runs blocks laid out between
+    them, so a count that has not moved means no store on any path.
+    stamp holds the counts a load or store saw, see memoryStamp
+    */
+    std::vector<uint64_t> stamp;                //indexed by ValueId
+    std::vector<uint32_t> stores;               //indexed by SymbolId, every store to the variable
+    std::vector<uint32_t> indexedStores;        //indexed by SymbolId, stores through a computed cell
+    std::unordered_map<uint64_t, uint32_t> cellStores;  //symbol << 32 | cell, stores to a constant cell
+};
+
+//the variable and cell an address names, false when the cell is computed at run time
+static bool constantCell(const IrProgram& program, ValueId address, SymbolId* symbol, int64_t* cell){
+    const IrInst& in = program.insts[address];
+    *symbol = (SymbolId)in.imm;
+    *cell = 0;
+    if(in.a == NO_VALUE){ return true; }
+    if(program.insts[in.a].op != IrOp::CONST){ return false; }
+    *cell = program.insts[in.a].imm;
+    return true;
+}
+
+static uint64_t cellKey(SymbolId symbol, int64_t cell){
+    return (uint64_t)symbol << 32 | (uint32_t)cell;
+}
+
+/*
+the store counts a load from address depends on: any store to the
+variable for a computed cell, stores through computed cells and stores
+to the same cell for a constant one
+*/
+static uint64_t memoryStamp(NumberState* s, ValueId address){
+    SymbolId symbol;
+    int64_t cell;
+    bool fixed = constantCell(*s->program, address, &symbol, &cell);
+    if(symbol >= s->stores.size()){
+        s->stores.resize(symbol + 1, 0);
+        s->indexedStores.resize(symbol + 1, 0);
+    }
+    if(!fixed){
+        return s->stores[symbol];
+    }
+    auto found = s->cellStores.find(cellKey(symbol, cell));
+    uint32_t cellStores = found == s->cellStores.end() ? 0 : found->second;
+    return (uint64_t)s->indexedStores[symbol] << 32 | cellStores;
+}
+
+static void countStore(NumberState* s, ValueId address){
+    SymbolId symbol;
+    int64_t cell;
+    bool fixed = constantCell(*s->program, address, &symbol, &cell);
+    if(symbol >= s->stores.size()){
+        s->stores.resize(symbol + 1, 0);
+        s->indexedStores.resize(symbol + 1, 0);
+    }
+    s->stores[symbol]++;
+    if(fixed){
+        s->cellStores[cellKey(symbol, cell)]++;
+    } else {
+        s->indexedStores[symbol]++;
+    }
+}
+
+//the table slot holding key, or the empty slot it would go in
+static ValueId& slotOf(NumberState* s, const ValueKey& key){
+    uint64_t h = hashKey(key) & s->mask;
+    while(s->table[h] != NO_VALUE && !(keyOf(s->program->insts[s->table[h]]) == key)){
+        h = (h + 1) & s->mask;
+    }
+    return s->table[h];
+}
+
+//i gets the number of an equal value available in block b, or becomes the one for its key
+static void numberValue(NumberState* s, BlockId b, ValueId i){
+    const IrInst& in = s->program->insts[i];
+    if(in.op == IrOp::LOAD){
+        s->stamp[i] = memoryStamp(s, in.a);
+    }
+    ValueId& slot = slotOf(s, keyOf(in));
+    if(slot != NO_VALUE && s->dom.dominates(s->blockOf[slot], b)){
+        const IrInst& found = s->program->insts[slot];
+        bool current = in.op != IrOp::LOAD || s->stamp[slot] == s->stamp[i];
+        if(current){
+            s->number[i] = found.op == IrOp::STORE ? found.b : slot;
+            s->stats->reused++;
+            return;
+        }
+    }
+    slot = i;
+}
+
+void numberValues(IrProgram& program, OptimizeStats& stats){
+    NumberState state;
+    state.program = &program;
+    state.stats = &stats;
+    state.dom = dominators(predecessors(program));
+    state.blockOf.resize(program.size());
+    state.number.resize(program.size());
+    state.stamp.resize(program.size(), 0);
+    uint64_t capacity = 16;
+    while(capacity < 2 * (uint64_t)program.size()){
+        capacity *= 2;
+    }
+    state.table.assign(capacity, NO_VALUE);
+    state.mask = capacity - 1;
+    std::vector<ValueId>& number = state.number;
+    for(BlockId b = 0; b < program.blocks.size(); b++){
+        for(ValueId i = program.blocks[b].first; i < program.blocks[b].end; i++){
+            state.blockOf[i] = b;
+            number[i] = i;
+        }
+    }
+
+    for(BlockId b = 0; b < program.blocks.size(); b++){
+        for(ValueId i = program.blocks[b].first; i < program.blocks[b].end; i++){
+            IrInst& in = program.insts[i];
+            if(readsA(in)){ in.a = number[in.a]; }
+            if(readsB(in)){ in.b = number[in.b]; }
+            switch(in.op){
+                case IrOp::STORE: {
+                    //the next load of the address reads the stored value
+                    countStore(&state, in.a);
+                    state.stamp[i] = memoryStamp(&state, in.a);
+                    slotOf(&state, keyOf(in)) = i;
+                    continue;
+                }
+                case IrOp::PHI: {
+                    bool same = true;
+                    for(uint32_t k = 0; k < in.b; k++){
+                        PhiArg& arg = program.phiArgs[in.a + k];
+                        arg.value = number[arg.value];
+                        same = same && arg.value == program.phiArgs[in.a].value;
+                    }
+                    if(same){
+                        number[i] = program.phiArgs[in.a].value;
+                        stats.reused++;
+                    }
+                    continue;
+                }
+                case IrOp::JMP: case IrOp::BR: case IrOp::EXIT:
+                    continue;
+                case IrOp::CONST: case IrOp::ADDR: case IrOp::LOAD:
+                    break;
+                default:
+                    //forwarded stores can leave both operands known
+                    if(program.insts[in.a].op == IrOp::CONST && program.insts[in.b].op == IrOp::CONST){
+                        in.imm = evaluate(in.op, program.insts[in.a].imm, program.insts[in.b].imm);
+                        in.op = IrOp::CONST;
+                        in.a = in.b = NO_VALUE;
+                        stats.folded++;
+                    }
+                    break;
+            }
+            numberValue(&state, b, i);
+        }
+    }
+}
+
+void eliminateDeadCode(IrProgram& program, OptimizeStats& stats){
+    std::vector<IrInst>& insts = program.insts;
+    std::vector<uint32_t> uses(insts.size(), 0);
+    for(const IrInst& in : insts){
+        if(readsA(in)){ uses[in.a]++; }
+        if(readsB(in)){ uses[in.b]++; }
+        if(in.op == IrOp::PHI){
+            for(uint32_t k = 0; k < in.b; k++){ uses[program.phiArgs[in.a + k].value]++; }
+        }
+    }
+
+    //operands come before their users, so one pass backwards finds everything dead
+    std::vector<ValueId> renamed(insts.size(), NO_VALUE);
+    for(ValueId i = (ValueId)insts.size(); i-- > 0;){
+        const IrInst& in = insts[i];
+        if(hasSideEffects(in.op) || uses[i] > 0){
+            renamed[i] = i;
+            continue;
+        }
+        if(readsA(in)){ uses[in.a]--; }
+        if(readsB(in)){ uses[in.b]--; }
+        if(in.op == IrOp::PHI){
+            for(uint32_t k = 0; k < in.b; k++){ uses[program.phiArgs[in.a + k].value]--; }
+        }
+    }
+
+    std::vector<PhiArg> phiArgs;
+    uint32_t n = 0;
+    size_t line = 0;
+    for(IrBlock& block : program.blocks){
+        uint32_t first = n;
+        for(ValueId i = block.first; i < block.end; i++){
+            for(; line < program.lines.size() && program.lines[line].inst == i; line++){
+                program.lines[line].inst = n;
+            }
+            if(renamed[i] == NO_VALUE){ continue; }
+            IrInst in = insts[i];
+            if(readsA(in)){ in.a = renamed[in.a]; }
+            if(readsB(in)){ in.b = renamed[in.b]; }
+            if(in.op == IrOp::PHI){
+                uint32_t start = (uint32_t)phiArgs.size();
+                for(uint32_t k = 0; k < in.b; k++){
+                    const PhiArg& arg = program.phiArgs[in.a + k];
+                    phiArgs.push_back({arg.block, renamed[arg.value]});
+                }
+                in.a = start;
+            }
+            renamed[i] = n;
+            insts[n++] = in;
+        }
+        block.first = first;
+        block.end = n;
+    }
+    for(; line < program.lines.size(); line++){
+        program.lines[line].inst = n;
+    }
+    stats.removed += insts.size() - n;
+    insts.resize(n);
+    program.phiArgs = std::move(phiArgs);
+}
+
+bool optimizeIr(IrProgram& program, OptimizeStats& stats, bool verify, std::string& err_s){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    stats.before += program.size();
+    foldConstants(program, stats);
+    if(verify && !verifyIr(program, err_s)){
+        err_s = "after constant folding: " + err_s;
+        return false;
+    }
+    numberValues(program, stats);
+    if(verify && !verifyIr(program, err_s)){
+        err_s = "after value numbering: " + err_s;
+        return false;
+    }
+    eliminateDeadCode(program, stats);
+    if(verify && !verifyIr(program, err_s)){
+        err_s = "after dead code elimination: " + err_s;
+        return false;
+    }
+    stats.after += program.size();
+    stats.time += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+#endif
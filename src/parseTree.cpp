@@ -4,18 +4,21 @@
 #include <vector>
 #include <iostream>
 #include <memory>
+#include <algorithm>
+#include <utility>
 
 #include "token.h"
+#include "operators.h"
 //#include "syntaxDefinitions.h"
 #include "parseTree.h"
+#include "threadPool.h"
 
-#define MAX_PARSE_DEPTH 10
-#define PARSE_TREE_DEBUG_PRINT
+//#define PARSE_TREE_DEBUG_PRINT
 
 
 Node::Node(NodeType _type) : type(_type) {}
-Node::Node(NodeType _type, std::shared_ptr<Token> _token) : type(_type), token(_token) {}
-void Node::print(int depth){
+Node::Node(NodeType _type, uint32_t _token) : type(_type), token(_token) {}
+void Node::printLine(const TokenStream& tokens, int depth) const{
     if(depth > 0) std::cout << "└";
     for(int i = 0; i < depth; i++){
         std::cout << " -";
@@ -24,436 +27,780 @@ void Node::print(int depth){
     if(subtype != NodeSubType::none){
         std::cout << " - " << subtype;
     }
-    if(token != nullptr){
-        std::cout << " : " << token->type;
-        if(token->has_i_val){
-            std::cout << "(" << token->i_value << ")";
+    if(token != NO_TOKEN){
+        TokenType t = tokens.type(token);
+        std::cout << " : " << t;
+        if(t == TokenType::INT_LITERAL){
+            std::cout << "(" << tokens.intValue(token) << ")";
         }
-        if(token->has_s_val){
-            std::cout << "(\"" << token->s_value << "\")";
+        if(t == TokenType::IDENTIFIER){
+            std::cout << "(\"" << globalSymbols().name(tokens.symbol(token)) << "\")";
+        }
+        if(t == TokenType::BINARY_OPERATOR || t == TokenType::UNARY_OPERATOR){
+            std::cout << "(\"" << tokens.text(token) << "\")";
         }
     }
     std::cout << "\n";
-    for(int i = 0; i < children.size(); i++){
-        children.at(i)->print(depth+1);
+}
+
+//depth first with an explicit stack, trees can be nested far deeper than the native stack allows
+void Node::print(const NodeArena& arena, const TokenStream& tokens, int depth) const{
+    std::vector<std::pair<const Node*, int>> pending = {{this, depth}};
+    while(!pending.empty()){
+        const Node* n = pending.back().first;
+        int d = pending.back().second;
+        pending.pop_back();
+        n->printLine(tokens, d);
+        for(uint32_t i = n->childCount; i > 0; i--){
+            pending.push_back({&arena.at(arena.children[n->firstChild + i - 1]), d+1});
+        }
     }
 }
 
-StackTrace::StackTrace() {
-    node = nullptr;
-    success = false;
+NodeId NodeArena::add(NodeType type, uint32_t token){
+    nodes.emplace_back(type, token);
+    return (NodeId)(nodes.size() - 1);
 }
 
-StackTrace::StackTrace(ErrorType et, std::string em){
-    node = nullptr;
+NodeId NodeArena::add(NodeType type, NodeSubType subtype, uint32_t token, const NodeId* kids, uint32_t count){
+    Node n(type, token);
+    n.subtype = subtype;
+    n.firstChild = (uint32_t)children.size();
+    n.childCount = count;
+    children.insert(children.end(), kids, kids + count);
+    nodes.push_back(n);
+    return (NodeId)(nodes.size() - 1);
+}
+
+void NodeArena::reserve(size_t n){
+    nodes.reserve(n);
+    children.reserve(n);
+}
+
+void NodeArena::clear(){
+    nodes.clear();
+    children.clear();
+}
+
+StackTrace::StackTrace() {
+    node = NO_NODE;
     success = false;
-    errType = et;
-    err_s = em;
 }
 
-StackTrace::StackTrace(std::shared_ptr<Node> _node){
+StackTrace::StackTrace(NodeId _node){
     node = _node;
     success = true;
 }
 
-StackTrace parseParentheses(std::vector<Token>::iterator*, std::vector<Token>::iterator, int);
-StackTrace parseOperand(std::vector<Token>::iterator*, std::vector<Token>::iterator, int);
-StackTrace parseValue(std::vector<Token>::iterator*, std::vector<Token>::iterator, int);
-StackTrace parseVariable(std::vector<Token>::iterator*, std::vector<Token>::iterator, int);
-StackTrace parseArgument(std::vector<Token>::iterator*, std::vector<Token>::iterator, int);
-
-StackTrace parseStatement(std::vector<Token>::iterator* it, std::vector<Token>::iterator end, int depth){
-#ifdef PARSE_TREE_DEBUG_PRINT
-    for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-    std::cout << "statement | [" << (*it)->type << "] - [" << end->type << "] |\n";
-#endif
-    if(depth > MAX_PARSE_DEPTH || (*it) == end){ return StackTrace(ErrorType::MAX_DEPTH, ""); }
-    std::vector<Token>::iterator prevPosition = (*it);
-
-    if((*it)->type == TokenType::RESERVED && (*it)->s_value == "return"){
-        StackTrace returnStatement = StackTrace(std::make_shared<Node>(NodeType::statement));
-        returnStatement.node->subtype = NodeSubType::_return;
+//records a failure and returns the trace pointing at it, cause is the sub rule error being wrapped
+StackTrace parseError(ParseState* state, ParseRule rule, ErrorType type, ParseMessage message, uint32_t at, uint32_t cause=NO_ERROR){
+    ParseError err;
+    err.type = type;
+    err.message = message;
+    err.rule = rule;
+    err.token = at;
+    err.cause = cause;
+    state->errors.push_back(err);
+
+    StackTrace trace;
+    trace.error = (uint32_t)(state->errors.size() - 1);
+    return trace;
+}
 
-        ++(*it);
-        StackTrace retStateSearch = parseStatement(it, end, depth+1);
-        if(retStateSearch.success){
-            returnStatement.node->children.push_back(std::move(retStateSearch.node));
-        } else { 
-            (*it) = prevPosition + 1;
-            StackTrace retOpSearch = parseOperand(it, end, depth+1);
-            if(retOpSearch.success){
-                returnStatement.node->children.push_back(std::move(retOpSearch.node));
-            }
-        }
-#ifdef PARSE_TREE_DEBUG_PRINT
-        for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-        std::cout << "found return\n";
-#endif
-        return returnStatement;
+//one diagnostic for a single record, without its cause
+ParseDiagnostic describeError(const ParseError& err, const TokenStream& tokens){
+    ParseDiagnostic ret;
+    ret.errType = err.type;
+    ret.err_s = ParseMessageStrings[(int)err.message] + " (" + ParseRuleStrings[(int)err.rule] + ")";
+    if(err.token < tokens.size()){
+        ret.lineNumber = tokens.lineNumber(err.token);
+        ret.err_s += " at [" + TokenTypeStrings[(int)tokens.type(err.token)] + "]";
     }
+    return ret;
+}
 
-    //parentheses
-    if((*it)->type == TokenType::OPEN_PARENTH){
-        StackTrace parenthSearch = parseParentheses(it, end, depth+1);
-        if(parenthSearch.success){
+//cause chains are as long as the nesting that failed, so they are walked rather than recursed
+ParseDiagnostic buildDiagnostic(const std::vector<ParseError>& errors, uint32_t index, const TokenStream& tokens){
+    std::vector<uint32_t> chain;
+    for(uint32_t i = index; i != NO_ERROR; i = errors.at(i).cause){
+        chain.push_back(i);
+    }
+    ParseDiagnostic ret = describeError(errors.at(chain.back()), tokens);
+    for(size_t i = chain.size() - 1; i > 0; i--){
+        ParseDiagnostic outer = describeError(errors.at(chain[i-1]), tokens);
+        outer.children.push_back(std::move(ret));
+        ret = std::move(outer);
+    }
+    return ret;
+}
 
-#ifdef PARSE_TREE_DEBUG_PRINT
-            for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-            std::cout << "found parentheses\n";
-#endif
-            return parenthSearch;
-        }
-        return StackTrace(ErrorType::INVALID_ARGUMENT, "bad inside of parentheses");
+int nodeLine(const NodeArena& arena, const TokenStream& tokens, NodeId id){
+    while(arena.at(id).token == NO_TOKEN){
+        if(arena.at(id).childCount == 0){ return -1; }
+        id = arena.child(id, 0);
     }
-    (*it) = prevPosition; 
+    return tokens.lineNumber(arena.at(id).token);
+}
 
-    //implement function call
+NodeId unwrapOperand(const NodeArena& arena, NodeId id){
+    while(arena.at(id).type == NodeType::operand){
+        id = arena.child(id, 0);
+    }
+    return id;
+}
 
-    //prefix unary
-    if((*it)->type == TokenType::UNARY_OPERATOR){
-        ++(*it);
-        StackTrace operandSearch = parseOperand(it, end, depth+1);
-        if(operandSearch.success){
-            std::shared_ptr<Node> ret = std::make_shared<Node>(NodeType::statement);
-            ret->subtype = NodeSubType::prefix_unary;
-            ret->children.push_back(std::make_shared<Node>(NodeType::_operator, std::make_shared<Token>(*prevPosition)));
-            ret->children.push_back(std::move(operandSearch.node));
+Operator childOperator(const NodeArena& arena, const TokenStream& tokens, NodeId node, uint32_t kid){
+    return tokens.op(arena.at(arena.child(node, kid)).token);
+}
 
-#ifdef PARSE_TREE_DEBUG_PRINT
-            for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-            std::cout << "found prefix unary\n";
-#endif
+ParseDiagnostic::~ParseDiagnostic(){
+    //unlinks the children first so a long chain is not destroyed recursively
+    std::vector<ParseDiagnostic> pending = std::move(children);
+    while(!pending.empty()){
+        ParseDiagnostic d = std::move(pending.back());
+        pending.pop_back();
+        for(ParseDiagnostic& c : d.children){
+            pending.push_back(std::move(c));
+        }
+        d.children.clear();
+    }
+}
 
-            return StackTrace(ret);
+void ParseDiagnostic::print(int depth, std::ostream& out) const{
+    std::vector<std::pair<const ParseDiagnostic*, int>> pending = {{this, depth}};
+    while(!pending.empty()){
+        const ParseDiagnostic* d = pending.back().first;
+        int level = pending.back().second;
+        pending.pop_back();
+        if(level > 0) out << "└";
+        for(int i = 0; i < level; i++){
+            out << " -";
+        }
+        out << "line " << d->lineNumber << ": " << ErrorTypeStrings[(int)d->errType] << " - " << d->err_s << "\n";
+        for(size_t i = d->children.size(); i > 0; i--){
+            pending.push_back({&d->children[i-1], level+1});
         }
-        (*it) = prevPosition; 
     }
+}
 
-    //binary or postfix operator
-    StackTrace operandSearch = parseOperand(it, end, depth+1);
-    if(operandSearch.success){
-        std::vector<Token>::iterator op1endPosition = (*it);
+/*
+precedence climbing over the BINARY_OPERATOR set, lowest binds loosest.
+prefix unary binds tighter than any binary operator, postfix unary and
+array indexing bind tighter than prefix unary.
+returns -1 for tokens that are not binary operators
+*/
+int binaryPrecedence(ParseState* state, uint32_t t){
+    if(state->tokens->type(t) != TokenType::BINARY_OPERATOR){ return -1; }
+    switch(state->tokens->op(t)){
+        case Operator::ASSIGN: case Operator::PLUS_ASSIGN: case Operator::MINUS_ASSIGN:
+        case Operator::STAR_ASSIGN: case Operator::SLASH_ASSIGN: case Operator::PERCENT_ASSIGN:
+            return 1;
+        case Operator::OR: return 2;
+        case Operator::AND: return 3;
+        case Operator::BIT_OR: return 4;
+        case Operator::BIT_AND: return 5;
+        case Operator::EQUAL: case Operator::NOT_EQUAL: return 6;
+        case Operator::LESS: case Operator::GREATER: case Operator::LESS_EQUAL: case Operator::GREATER_EQUAL: return 7;
+        case Operator::SHIFT_LEFT: case Operator::SHIFT_RIGHT: return 8;
+        case Operator::PLUS: case Operator::MINUS: return 9;
+        case Operator::STAR: case Operator::SLASH: case Operator::PERCENT: return 10;
+        default: break;
+    }
+    return -1;
+}
 
-        //binary op
-        if((*it)->type == TokenType::BINARY_OPERATOR){
-            ++(*it);
-            StackTrace op2Search = parseOperand(it, end, depth+1);
-            if(op2Search.success){
-                std::shared_ptr<Node> ret = std::make_shared<Node>(NodeType::statement);
-                ret->subtype = NodeSubType::binary_op;
-                ret->children.push_back(std::move(operandSearch.node));
-                ret->children.push_back(std::make_shared<Node>(NodeType::_operator, std::make_shared<Token>(*op1endPosition)));
-                ret->children.push_back(std::move(op2Search.node));
+//assignment operators group right to left, everything else left to right
+bool rightAssociative(ParseState* state, uint32_t t){
+    return binaryPrecedence(state, t) == 1;
+}
 
-#ifdef PARSE_TREE_DEBUG_PRINT
-                for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-                std::cout << "found binary op\n";
-#endif
+/*
+parse functions hand back bare statement/variable/value nodes, they are
+wrapped when they become an operand of something, so binary_op children
+are (operand) (operator) (operand)
+*/
+NodeId wrapOperand(ParseState* state, NodeId inner){
+    return state->arena->add(NodeType::operand, NodeSubType::none, NO_TOKEN, &inner, 1);
+}
 
-                return StackTrace(ret);
-            }
+NodeId operatorNode(ParseState* state, uint32_t it){
+    return state->arena->add(NodeType::_operator, it);
+}
 
-            return StackTrace(ErrorType::INVALID_ARGUMENT, "bad 2nd operand of binary operator");
-        }
-        (*it) = op1endPosition;
-        //postfix unary
-        if((*it)->type == TokenType::UNARY_OPERATOR){
-            std::shared_ptr<Node> ret = std::make_shared<Node>(NodeType::statement);
-            ret->subtype = NodeSubType::postfix_unary;
-            ret->children.push_back(std::move(operandSearch.node));
-            ret->children.push_back(std::make_shared<Node>(NodeType::_operator, std::make_shared<Token>(**it)));
-            ++(*it);
+//creates a node from the top of the scratch stack down to base, and pops them
+NodeId addFromScratch(ParseState* state, NodeType type, NodeSubType subtype, uint32_t token, size_t base){
+    NodeId ret = state->arena->add(type, subtype, token, state->scratch.data() + base, (uint32_t)(state->scratch.size() - base));
+    state->scratch.resize(base);
+    return ret;
+}
 
-#ifdef PARSE_TREE_DEBUG_PRINT
-            for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-            std::cout << "found postfix unary\n";
-#endif
+//matching close delimiter of the open delimiter at open, end if it is not inside [open, end)
+uint32_t matchingClose(ParseState* state, uint32_t open, uint32_t end){
+    int close = state->match->at(open);
+    if(close < 0 || (uint32_t)close >= end){ return end; }
+    return (uint32_t)close;
+}
 
-            return ret;
-        }
+/*
+the rules below run on an explicit stack of ParseFrames instead of native
+recursion, so nesting depth costs heap memory (one frame per open rule)
+rather than machine stack. a rule calls another by setting the step it
+resumes at and pushing the callee (callRule), and finishes by popping
+itself and leaving its StackTrace in result (returnRule). the frame
+reference a rule holds is invalid after either, so both end the step
+*/
+static void callRule(ParseState* state, ParseRule rule, uint32_t end, int minPrec=0){
+    ParseFrame f;
+    f.rule = rule;
+    f.end = end;
+    f.minPrec = minPrec;
+    state->frames.push_back(f);
+}
+
+static void returnRule(ParseState* state, StackTrace* result, StackTrace trace){
+    *result = trace;
+    state->frames.pop_back();
+}
+
+static void parseStatement(ParseState*, uint32_t*, StackTrace*);
+static void parseExpression(ParseState*, uint32_t*, StackTrace*);
+static void parseUnary(ParseState*, uint32_t*, StackTrace*);
+static void parseOperand(ParseState*, uint32_t*, StackTrace*);
+static void parseArgument(ParseState*, uint32_t*, StackTrace*);
+static void parseVariable(ParseState*, uint32_t*, StackTrace*);
+static void parseValue(ParseState*, uint32_t*, StackTrace*);
+
+/*
+pushes a callee and runs its first step at once instead of going back
+through parseStatementRange. only used along statement -> argument ->
+expression -> unary -> operand -> value/variable, which never leads back
+into itself, so the native stack stays a handful of calls deep however
+deep the nesting. true when the callee already returned and the caller
+should resume straight away
+*/
+static bool runRule(ParseState* state, ParseRule rule, uint32_t end, uint32_t* it, StackTrace* result){
+    size_t caller = state->frames.size();
+    callRule(state, rule, end);
+    switch(rule){
+        case ParseRule::argument: parseArgument(state, it, result); break;
+        case ParseRule::expression: parseExpression(state, it, result); break;
+        case ParseRule::unary: parseUnary(state, it, result); break;
+        case ParseRule::operand: parseOperand(state, it, result); break;
+        case ParseRule::variable: parseVariable(state, it, result); break;
+        case ParseRule::value: parseValue(state, it, result); break;
+        default: break;
     }
+    return state->frames.size() == caller;
+}
 
-    return StackTrace(ErrorType::EXPECTED_STATEMENT, "bad statement");
+//records a failure of the current rule and returns it
+static void failRule(ParseState* state, StackTrace* result, ErrorType type, ParseMessage message, uint32_t at, uint32_t cause=NO_ERROR){
+    returnRule(state, result, parseError(state, state->frames.back().rule, type, message, at, cause));
 }
 
-StackTrace parseParentheses(std::vector<Token>::iterator* it, std::vector<Token>::iterator end, int depth){
+//counts the call and enforces the depth limit, false when the rule already failed
+static bool enterRule(ParseState* state, uint32_t it, StackTrace* result){
+    ParseFrame& f = state->frames.back();
+    state->stats.calls[(int)f.rule]++;
+    int depth = (int)state->frames.size() - 1;
 #ifdef PARSE_TREE_DEBUG_PRINT
     for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-    std::cout << "parentheses | [" << (*it)->type << "] - [" << end->type << "] |\n";
+    std::cout << ParseRuleStrings[(int)f.rule] << " | [" << state->tokens->type(it) << "] - [" << state->tokens->type(f.end) << "] |\n";
 #endif
-    if(depth > MAX_PARSE_DEPTH){ return StackTrace(ErrorType::MAX_DEPTH, ""); }
-    if((*it) == end){ return StackTrace(ErrorType::UNEXPECTED_EOF, ""); }
-    std::vector<Token>::iterator startPosition = (*it);
-
-    if((*it)->type != TokenType::OPEN_PARENTH){
-        return StackTrace(ErrorType::INVALID_ARGUMENT, "No open parenth");
+    if(depth > state->maxDepth){
+        failRule(state, result, ErrorType::MAX_DEPTH, ParseMessage::MAX_DEPTH, it);
+        return false;
     }
-    ++(*it);
-    int parenthCount = 1;
+    return true;
+}
 
-    while((*it) != end){
-        if((*it)->type == TokenType::OPEN_PARENTH){
-            parenthCount++;
-        }
-        if((*it)->type == TokenType::CLOSE_PARENTH){
-            parenthCount--;
-            if(parenthCount == 0){
-                break;
+#ifdef PARSE_TREE_DEBUG_PRINT
+void debugFound(ParseState* state, const char* what){
+    for(size_t i = 1; i < state->frames.size(); i++){ std::cout << ".  "; }
+    std::cout << "found " << what << "\n";
+}
+#endif
+
+static void parseStatement(ParseState* state, uint32_t* it, StackTrace* result){
+    ParseFrame& f = state->frames.back();
+    switch(f.step){
+    case 0:
+        if(!enterRule(state, *it, result)){ return; }
+        if((*it) == f.end){ return failRule(state, result, ErrorType::EXPECTED_STATEMENT, ParseMessage::EMPTY_STATEMENT, *it); }
+
+        if(state->tokens->type(*it) == TokenType::RESERVED && state->tokens->keyword(*it) == Keyword::RETURN){
+            ++(*it);
+            //RETURN <?operand>
+            if((*it) != f.end){
+                f.step = 1;
+                if(runRule(state, ParseRule::argument, f.end, it, result)){ return parseStatement(state, it, result); }
+                return;
             }
+            f.node = NO_NODE;
+            f.step = 2;
+            return parseStatement(state, it, result);
         }
-        ++(*it);
+        f.step = 3;
+        if(runRule(state, ParseRule::argument, f.end, it, result)){ return parseStatement(state, it, result); }
+        return;
+    case 1:
+        if(!result->success){
+            return failRule(state, result, ErrorType::INVALID_ARGUMENT, ParseMessage::BAD_RETURN_VALUE, *it, result->error);
+        }
+        f.node = wrapOperand(state, result->node);
+        [[fallthrough]];
+    case 2: {
+        if((*it) != f.end){
+            return failRule(state, result, ErrorType::SYNTAX_ERROR, ParseMessage::TOKEN_AFTER_RETURN, *it);
+        }
+        NodeId value = f.node;
+        NodeId ret = state->arena->add(NodeType::statement, NodeSubType::_return, NO_TOKEN, &value, value == NO_NODE ? 0 : 1);
+#ifdef PARSE_TREE_DEBUG_PRINT
+        debugFound(state, "return");
+#endif
+        return returnRule(state, result, StackTrace(ret));
     }
-    if(*it == end){
-        return StackTrace(ErrorType::SYNTAX_ERROR, "Missing closing parenthesis");
+    case 3:
+        if(!result->success){
+            return returnRule(state, result, *result);
+        }
+        if((*it) != f.end){
+            return failRule(state, result, ErrorType::SYNTAX_ERROR, ParseMessage::EXPECTED_SEMI, *it);
+        }
+        return returnRule(state, result, *result);
     }
-    ++(*it);
+}
 
-    std::vector<Token>::iterator subIt = startPosition + 1;
-    std::vector<Token>::iterator subEnd = (*it)-1;
-    StackTrace argSearch = parseArgument(&subIt, subEnd, depth+1);
-    if(argSearch.success){
-        return argSearch;
+/*
+single pass over [it, end): parse a prefix/postfix operand, then fold in
+binary operators whose precedence is at least minPrec. the iterator only
+moves forward, nothing is ever re-parsed
+*/
+static void parseExpression(ParseState* state, uint32_t* it, StackTrace* result){
+    ParseFrame& f = state->frames.back();
+    switch(f.step){
+    case 0:
+        if(!enterRule(state, *it, result)){ return; }
+        f.step = 1;
+        if(runRule(state, ParseRule::unary, f.end, it, result)){ return parseExpression(state, it, result); }
+        return;
+    case 1:
+        if(!result->success){
+            return returnRule(state, result, *result);
+        }
+        f.node = result->node;
+        break;
+    case 2: {
+        if(!result->success){
+            return failRule(state, result, ErrorType::INVALID_ARGUMENT, ParseMessage::BAD_BINARY_OPERAND, *it, result->error);
+        }
+        NodeId kids[3] = {wrapOperand(state, f.node), operatorNode(state, f.position), wrapOperand(state, result->node)};
+        f.node = state->arena->add(NodeType::statement, NodeSubType::binary_op, NO_TOKEN, kids, 3);
+#ifdef PARSE_TREE_DEBUG_PRINT
+        debugFound(state, "binary op");
+#endif
+        break;
+    }
     }
 
-    (*it) = startPosition;
-    StackTrace trace(ErrorType::INVALID_ARGUMENT, "Bad inner parentheses statement");
-    trace.children.push_back(std::make_shared<StackTrace>(argSearch));
-    return trace;
+    //the operator loop, each right hand side is a call that resumes at step 2
+    if((*it) != f.end){
+        int prec = binaryPrecedence(state, *it);
+        if(prec >= 0 && prec >= f.minPrec){
+            f.position = (*it);
+            ++(*it);
+            f.step = 2;
+            return callRule(state, ParseRule::expression, f.end, rightAssociative(state, f.position) ? prec : prec+1);
+        }
+    }
+    return returnRule(state, result, StackTrace(f.node));
 }
 
-StackTrace parseOperand(std::vector<Token>::iterator* it, std::vector<Token>::iterator end, int depth){
+//UNARY_OPERATOR <operand> | <operand> UNARY_OPERATOR
+static void parseUnary(ParseState* state, uint32_t* it, StackTrace* result){
+    ParseFrame& f = state->frames.back();
+    switch(f.step){
+    case 0:
+        if(!enterRule(state, *it, result)){ return; }
+        if((*it) == f.end){ return failRule(state, result, ErrorType::UNEXPECTED_EOF, ParseMessage::EXPECTED_OPERAND, *it); }
+
+        //prefix unary
+        if(state->tokens->type(*it) == TokenType::UNARY_OPERATOR){
+            f.position = (*it);
+            ++(*it);
+            f.step = 1;
+            return callRule(state, ParseRule::unary, f.end);
+        }
+        f.step = 2;
+        if(runRule(state, ParseRule::operand, f.end, it, result)){ return parseUnary(state, it, result); }
+        return;
+    case 1: {
+        if(!result->success){
+            return failRule(state, result, ErrorType::INVALID_ARGUMENT, ParseMessage::BAD_PREFIX_OPERAND, *it, result->error);
+        }
+        NodeId kids[2] = {operatorNode(state, f.position), wrapOperand(state, result->node)};
+        NodeId ret = state->arena->add(NodeType::statement, NodeSubType::prefix_unary, NO_TOKEN, kids, 2);
 #ifdef PARSE_TREE_DEBUG_PRINT
-    for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-    std::cout << "operand | [" << (*it)->type << "] - [" << end->type << "] |\n";
+        debugFound(state, "prefix unary");
 #endif
-    if(depth > MAX_PARSE_DEPTH){ return StackTrace(ErrorType::MAX_DEPTH, ""); }
-    if((*it) == end){ return StackTrace(ErrorType::UNEXPECTED_EOF, ""); }
-    std::vector<Token>::iterator prevPosition = (*it);
-    StackTrace valSearch = parseValue(it, end, depth+1);
-    if(valSearch.success){ //value
-        std::shared_ptr<Node> ret = std::make_shared<Node>(NodeType::operand);
-        ret->children.push_back(std::move(valSearch.node));
+        return returnRule(state, result, StackTrace(ret));
+    }
+    case 2: {
+        if(!result->success){
+            return returnRule(state, result, *result);
+        }
+        NodeId operand = result->node;
 
+        //postfix unary, only ++ and -- can follow an operand
+        while((*it) != f.end && state->tokens->type(*it) == TokenType::UNARY_OPERATOR && state->tokens->op(*it) != Operator::NOT){
+            NodeId kids[2] = {wrapOperand(state, operand), operatorNode(state, *it)};
+            operand = state->arena->add(NodeType::statement, NodeSubType::postfix_unary, NO_TOKEN, kids, 2);
+            ++(*it);
 #ifdef PARSE_TREE_DEBUG_PRINT
-        for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-        std::cout << "found value\n";
+            debugFound(state, "postfix unary");
 #endif
+        }
+        return returnRule(state, result, StackTrace(operand));
+    }
+    }
+}
 
-        return StackTrace(ret);
+//<value> | <variable> | IDENTIFIER(...) | <parentheses>, decided by the first token
+static void parseOperand(ParseState* state, uint32_t* it, StackTrace* result){
+    ParseFrame& f = state->frames.back();
+    if(f.step == 1){
+        return returnRule(state, result, *result);
+    }
+    if(!enterRule(state, *it, result)){ return; }
+    if((*it) == f.end){ return failRule(state, result, ErrorType::UNEXPECTED_EOF, ParseMessage::EXPECTED_OPERAND, *it); }
+
+    f.step = 1;
+    switch(state->tokens->type(*it)){
+        case TokenType::INT_LITERAL:
+            if(runRule(state, ParseRule::value, f.end, it, result)){ return parseOperand(state, it, result); }
+            return;
+        case TokenType::IDENTIFIER:
+            if((*it)+1 != f.end && state->tokens->type((*it)+1) == TokenType::OPEN_PARENTH){
+                return callRule(state, ParseRule::function_call, f.end);
+            }
+            if(runRule(state, ParseRule::variable, f.end, it, result)){ return parseOperand(state, it, result); }
+            return;
+        case TokenType::OPEN_PARENTH:
+            return callRule(state, ParseRule::parentheses, f.end);
+        default:
+            return failRule(state, result, ErrorType::EXPECTED_STATEMENT, ParseMessage::NO_OPERAND, *it);
     }
-    (*it) = prevPosition;
+}
 
-    StackTrace varSearch = parseVariable(it, end, depth+1);
-    if(varSearch.success){ //variable
-        std::shared_ptr<Node> ret = std::make_shared<Node>(NodeType::operand);
-        ret->children.push_back(std::move(varSearch.node));
+static void parseParentheses(ParseState* state, uint32_t* it, StackTrace* result){
+    ParseFrame& f = state->frames.back();
+    if(f.step == 0){
+        if(!enterRule(state, *it, result)){ return; }
+        if((*it) == f.end){ return failRule(state, result, ErrorType::UNEXPECTED_EOF, ParseMessage::UNEXPECTED_EOF, *it); }
+        if(state->tokens->type(*it) != TokenType::OPEN_PARENTH){
+            return failRule(state, result, ErrorType::INVALID_ARGUMENT, ParseMessage::NO_OPEN_PARENTH, *it);
+        }
+        f.close = matchingClose(state, *it, f.end);
+        if(f.close == f.end){
+            return failRule(state, result, ErrorType::SYNTAX_ERROR, ParseMessage::MISSING_CLOSE_PARENTH, *it);
+        }
+        ++(*it);
+        if((*it) == f.close){
+            return failRule(state, result, ErrorType::INVALID_ARGUMENT, ParseMessage::EMPTY_PARENTHESES, *it);
+        }
+        f.step = 1;
+        return callRule(state, ParseRule::argument, f.close);
+    }
 
+    if(!result->success){
+        return failRule(state, result, ErrorType::INVALID_ARGUMENT, ParseMessage::BAD_PARENTHESES, *it, result->error);
+    }
+    if((*it) != f.close){
+        return failRule(state, result, ErrorType::SYNTAX_ERROR, ParseMessage::TOKEN_IN_PARENTHESES, *it);
+    }
+    (*it) = f.close + 1;
 #ifdef PARSE_TREE_DEBUG_PRINT
-        for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-        std::cout << "found variable\n";
+    debugFound(state, "parentheses");
 #endif
+    return returnRule(state, result, *result);
+}
 
-        return StackTrace(ret);
+//IDENTIFIER (?<operand> ?, ?<operand>)
+static void parseFunctionCall(ParseState* state, uint32_t* it, StackTrace* result){
+    ParseFrame& f = state->frames.back();
+    if(f.step == 0){
+        if(!enterRule(state, *it, result)){ return; }
+        if((*it) == f.end){ return failRule(state, result, ErrorType::UNEXPECTED_EOF, ParseMessage::UNEXPECTED_EOF, *it); }
+
+        f.position = (*it);
+        f.base = (uint32_t)state->scratch.size();
+        ++(*it); //identifier
+        f.close = matchingClose(state, *it, f.end);
+        if(f.close == f.end){
+            return failRule(state, result, ErrorType::SYNTAX_ERROR, ParseMessage::MISSING_CLOSE_PARENTH, *it);
+        }
+        ++(*it); //open parenth
+    } else {
+        if(!result->success){
+            state->scratch.resize(f.base);
+            return failRule(state, result, ErrorType::INVALID_ARGUMENT, ParseMessage::BAD_ARGUMENT, *it, result->error);
+        }
+        NodeId arg = wrapOperand(state, result->node);
+        state->scratch.push_back(arg);
     }
-    (*it) = prevPosition;
-
-    StackTrace stateSearch = parseStatement(it, end, depth+1);
-    if(stateSearch.success){ //statement
-        std::shared_ptr<Node> ret = std::make_shared<Node>(NodeType::statement);
-        ret->children.push_back(std::move(stateSearch.node));
 
+    if((*it) != f.close){
+        if(state->scratch.size() > f.base){
+            if(state->tokens->type(*it) != TokenType::COMMA){
+                state->scratch.resize(f.base);
+                return failRule(state, result, ErrorType::SYNTAX_ERROR, ParseMessage::EXPECTED_COMMA, *it);
+            }
+            ++(*it);
+        }
+        f.step = 1;
+        return callRule(state, ParseRule::argument, f.close);
+    }
+    (*it) = f.close + 1;
+    NodeId ret = addFromScratch(state, NodeType::statement, NodeSubType::func_call, f.position, f.base);
 #ifdef PARSE_TREE_DEBUG_PRINT
-        for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-        std::cout << "found statement\n";
+    debugFound(state, "function call");
 #endif
+    return returnRule(state, result, StackTrace(ret));
+}
 
-        return StackTrace(ret);
+//a full expression, handed back without its operand wrapper
+static void parseArgument(ParseState* state, uint32_t* it, StackTrace* result){
+    ParseFrame& f = state->frames.back();
+    if(f.step == 1){
+        return returnRule(state, result, *result);
     }
-    (*it) = prevPosition;
-    StackTrace trace(ErrorType::INVALID_ARGUMENT, "No valid operand found");
-    trace.children.push_back(std::make_shared<StackTrace>(valSearch));
-    trace.children.push_back(std::make_shared<StackTrace>(varSearch));
-    trace.children.push_back(std::make_shared<StackTrace>(stateSearch));
-    return trace;
+    if(!enterRule(state, *it, result)){ return; }
+    if((*it) == f.end){ return failRule(state, result, ErrorType::UNEXPECTED_EOF, ParseMessage::UNEXPECTED_EOF, *it); }
+    f.step = 1;
+    if(runRule(state, ParseRule::expression, f.end, it, result)){ return parseArgument(state, it, result); }
 }
 
-StackTrace parseArgument(std::vector<Token>::iterator* it, std::vector<Token>::iterator end, int depth){
+static void parseVariable(ParseState* state, uint32_t* it, StackTrace* result){
+    ParseFrame& f = state->frames.back();
+    if(f.step == 0){
+        if(!enterRule(state, *it, result)){ return; }
+        if((*it) == f.end){ return failRule(state, result, ErrorType::UNEXPECTED_EOF, ParseMessage::UNEXPECTED_EOF, *it); }
+        if(state->tokens->type(*it) != TokenType::IDENTIFIER){
+            return failRule(state, result, ErrorType::EXPECTED_STATEMENT, ParseMessage::EXPECTED_IDENTIFIER, *it);
+        }
+        f.position = (*it);
+        f.base = (uint32_t)state->scratch.size();
+        ++(*it);
+    } else {
+        if(!result->success){
+            state->scratch.resize(f.base);
+            return failRule(state, result, ErrorType::INVALID_ARGUMENT, ParseMessage::BAD_INDEX, *it, result->error);
+        }
+        if((*it) != f.close){
+            state->scratch.resize(f.base);
+            return failRule(state, result, ErrorType::SYNTAX_ERROR, ParseMessage::TOKEN_IN_INDEX, *it);
+        }
+        (*it) = f.close + 1;
+        state->scratch.push_back(result->node);
 #ifdef PARSE_TREE_DEBUG_PRINT
-    for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-    std::cout << "argument | [" << (*it)->type << "] - [" << end->type << "] |\n";
+        debugFound(state, "index");
 #endif
-    if(depth > MAX_PARSE_DEPTH){ return StackTrace(ErrorType::MAX_DEPTH, ""); }
-    if((*it) == end){ return StackTrace(ErrorType::UNEXPECTED_EOF, ""); }
+    }
 
-    if(end - (*it) < 1){
-        return StackTrace(ErrorType::SYNTAX_ERROR, "Argument with size <0");
+    //check for a[b] notation
+    if((*it) != f.end && state->tokens->type(*it) == TokenType::OPEN_BRACKET){
+        f.close = matchingClose(state, *it, f.end);
+        if(f.close == f.end){
+            state->scratch.resize(f.base);
+            return failRule(state, result, ErrorType::SYNTAX_ERROR, ParseMessage::MISSING_CLOSE_BRACKET, *it);
+        }
+        ++(*it);
+        f.step = 1;
+        return callRule(state, ParseRule::argument, f.close);
     }
 
-    std::vector<Token>::iterator startPosition = (*it);
+    NodeSubType subtype = state->scratch.size() > f.base ? NodeSubType::array_access : NodeSubType::none;
+    return returnRule(state, result, StackTrace(addFromScratch(state, NodeType::variable, subtype, f.position, f.base)));
+}
 
-    //this has additional check to make sure that all tokens in parentheses are used
-    StackTrace valSearch = parseValue(it, end, depth+1);
-    if(valSearch.success && (*it) == end){
+static void parseValue(ParseState* state, uint32_t* it, StackTrace* result){
+    ParseFrame& f = state->frames.back();
+    if(!enterRule(state, *it, result)){ return; }
+    if((*it) == f.end){ return failRule(state, result, ErrorType::UNEXPECTED_EOF, ParseMessage::UNEXPECTED_EOF, *it); }
 
+    if(state->tokens->type(*it) == TokenType::INT_LITERAL){
+        NodeId ret = state->arena->add(NodeType::value, (*it));
+        ++(*it);
 #ifdef PARSE_TREE_DEBUG_PRINT
-        for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-        std::cout << "found value\n";
+        debugFound(state, "int literal");
 #endif
-
-        return valSearch;
+        return returnRule(state, result, StackTrace(ret));
     }
-    (*it) = startPosition;
-
-    StackTrace varSearch = parseVariable(it, end, depth+1);
-    if(varSearch.success && (*it) == end){
-
-#ifdef PARSE_TREE_DEBUG_PRINT
-        for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-        std::cout << "found variable\n";
-#endif
+    return failRule(state, result, ErrorType::EXPECTED_STATEMENT, ParseMessage::EXPECTED_INT_LITERAL, *it);
+}
 
-        return varSearch;
+//runs the statement rule over [start, end) until its frame returns
+StackTrace parseStatementRange(ParseState* state, uint32_t start, uint32_t end){
+    state->frames.clear();
+    callRule(state, ParseRule::statement, end);
+    uint32_t it = start;
+    StackTrace result;
+    while(!state->frames.empty()){
+        switch(state->frames.back().rule){
+            case ParseRule::statement: parseStatement(state, &it, &result); break;
+            case ParseRule::expression: parseExpression(state, &it, &result); break;
+            case ParseRule::unary: parseUnary(state, &it, &result); break;
+            case ParseRule::operand: parseOperand(state, &it, &result); break;
+            case ParseRule::parentheses: parseParentheses(state, &it, &result); break;
+            case ParseRule::function_call: parseFunctionCall(state, &it, &result); break;
+            case ParseRule::argument: parseArgument(state, &it, &result); break;
+            case ParseRule::variable: parseVariable(state, &it, &result); break;
+            case ParseRule::value: parseValue(state, &it, &result); break;
+            default: break;
+        }
     }
-    (*it) = startPosition;
-    
-    StackTrace opSearch = parseOperand(it, end, depth+1);
-    if(opSearch.success && (*it) == end){
-
-#ifdef PARSE_TREE_DEBUG_PRINT
-        for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-        std::cout << "found operand\n";
-#endif
+    return result;
+}
 
-        return opSearch;
+long long ParseStats::totalCalls() const{
+    long long total = 0;
+    for(int i = 0; i < (int)ParseRule::COUNT; i++){
+        total += calls[i];
     }
-    (*it) = startPosition;
+    return total;
+}
 
-    StackTrace stateSearch = parseStatement(it, end, depth+1);
-    if(stateSearch.success && *it == end){
+void ParseStats::add(const ParseStats& other){
+    for(int i = 0; i < (int)ParseRule::COUNT; i++){
+        calls[i] += other.calls[i];
+    }
+    tokens += other.tokens;
+}
 
-#ifdef PARSE_TREE_DEBUG_PRINT
-        for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-        std::cout << "found statement\n";
-#endif
+void ParseStats::print() const{
+    for(int i = 0; i < (int)ParseRule::COUNT; i++){
+        std::cout << ParseRuleStrings[i] << ": " << calls[i] << "\n";
+    }
+    std::cout << "rule invocations: " << totalCalls() << "\n";
+    std::cout << "tokens: " << tokens << "\n";
+    if(tokens > 0){
+        std::cout << "invocations per token: " << (double)totalCalls() / tokens << "\n";
+    }
+}
 
-        return stateSearch;
+//parses the statement [lineStart, semi), only a failed statement keeps its error records
+StackTrace parseOneStatement(ParseState* state, uint32_t lineStart, uint32_t semi, uint32_t arena){
+    size_t errorMark = state->errors.size();
+    StackTrace trace = parseStatementRange(state, lineStart, semi);
+    trace.arena = arena;
+    if(trace.success){
+        state->errors.resize(errorMark);
     }
-    (*it) = startPosition;
-    StackTrace trace(ErrorType::INVALID_ARGUMENT, "No valid operand found");
-    trace.children.push_back(std::make_shared<StackTrace>(valSearch));
-    trace.children.push_back(std::make_shared<StackTrace>(varSearch));
-    trace.children.push_back(std::make_shared<StackTrace>(opSearch));
-    trace.children.push_back(std::make_shared<StackTrace>(stateSearch));
     return trace;
 }
 
-StackTrace parseVariable(std::vector<Token>::iterator* it, std::vector<Token>::iterator end, int depth){
-#ifdef PARSE_TREE_DEBUG_PRINT
-    for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-    std::cout << "variable | [" << (*it)->type << "] - [" << end->type << "] |\n";
-#endif
-    if(depth > MAX_PARSE_DEPTH){ return StackTrace(ErrorType::MAX_DEPTH, ""); }
-    if((*it) == end){ return StackTrace(ErrorType::UNEXPECTED_EOF, ""); }
-    
-    std::vector<Token>::iterator prevPosition = (*it);
-    if((*it)->type == TokenType::IDENTIFIER){ //x
-        std::shared_ptr<Node> ret = std::make_shared<Node>(NodeType::variable, std::make_shared<Token>(**it));
-        ++(*it);
-
-        std::vector<Token>::iterator identifierEndPosition = (*it);
-
-        //check for a[b] notation
-        while((*it) != end && (*it)->type == TokenType::OPEN_BRACKET){
-            bool bracketFound = false;
-            ++(*it);
-            int bracketCount = 1;
-            for(; (*it) != end; ++(*it)){
-                if((*it)->type == TokenType::OPEN_BRACKET){
-                    bracketCount++;
-                }
-                if((*it)->type == TokenType::CLOSE_BRACKET){
-                    bracketCount--;
-                    if(bracketCount == 0){
-                        bracketFound = true;
-                        break;
-                    }
-                }
-            }
-            if(!bracketFound){ //malformed brackets
-                return StackTrace(ErrorType::SYNTAX_ERROR, "Missing Closing Bracket");
-            }
+//parses the statements ending at the SEMI tokens semis[first, last)
+void parseStatements(ParseState* state, std::vector<StackTrace>& traces, const std::vector<uint32_t>& semis, uint32_t first, uint32_t last, uint32_t arena){
+    for(uint32_t i = first; i < last; i++){
+        traces[i] = parseOneStatement(state, (i == 0) ? 0 : semis[i-1] + 1, semis[i], arena);
+    }
+}
 
-            std::vector<Token>::iterator subIt = identifierEndPosition + 1;
-            std::vector<Token>::iterator subEnd = *it;
-            StackTrace argSearch = parseArgument(&subIt, subEnd, depth+1);
-            if(argSearch.success){
-#ifdef PARSE_TREE_DEBUG_PRINT
-                for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-                std::cout << "found index\n";
-#endif  
-                ret->children.push_back(std::move(argSearch.node));
-                ++(*it);
-                identifierEndPosition = (*it);
-            } else {
-                StackTrace trace(ErrorType::INVALID_ARGUMENT, "Malformed array index"); //malformed argument
-                trace.children.push_back(std::make_shared<StackTrace>(argSearch));
-                return trace;
-            }
-        }
+//sums the workers' stats and builds diagnostics for failed statements in statement order
+void finishParseTree(parseTreeReturn& ret, const std::vector<ParseState>& states, const TokenStream& tokens){
+    for(const ParseState& state : states){
+        ret.stats.add(state.stats);
+    }
+    ret.stats.tokens = tokens.size();
 
-#ifdef PARSE_TREE_DEBUG_PRINT
-        for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-        std::cout << "found " << ((ret->children.size() > 1) ? "a[b]" : "x") << "\n";
-#endif
-        if(ret->children.size() > 1){
-            ret->subtype = NodeSubType::array_access;
+    for(int i = 0; i < (int)ret.traces.size(); i++){
+        if(!ret.traces[i].success){
+            ret.success = false;
+            ret.diagnostics.push_back(buildDiagnostic(states[ret.traces[i].arena].errors, ret.traces[i].error, tokens));
         }
-
-        return StackTrace(ret);
     }
-    (*it) = prevPosition;
-    return StackTrace(ErrorType::EXPECTED_STATEMENT, "Expected Identifier");
 }
 
-StackTrace parseValue(std::vector<Token>::iterator* it, std::vector<Token>::iterator end, int depth){
-#ifdef PARSE_TREE_DEBUG_PRINT
-    for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-    std::cout << "value | [" << (*it)->type << "] - [" << end->type << "] |\n";
-#endif
-    if(depth > MAX_PARSE_DEPTH){ return StackTrace(ErrorType::MAX_DEPTH, ""); }
-    if((*it) == end){ return StackTrace(ErrorType::UNEXPECTED_EOF, ""); }
+/*
+statements are independent, so with threads > 1 they are parsed in
+blocks on a work stealing pool. every worker has its own ParseState and
+arena so nothing is shared while parsing, and each trace is written to
+its statement's slot so the output order does not depend on scheduling
+*/
+parseTreeReturn createParseTree(const TokenStream& tokens, const std::vector<int>& match, const ParseOptions& options){
+    int threads = options.threads;
+    parseTreeReturn ret;
+    std::vector<uint32_t> semis;
+    for(uint32_t it = 0; it != tokens.size(); ++it){
+        if(tokens.type(it) == TokenType::SEMI){
+            semis.push_back(it);
+        }
+    }
+    ret.traces.resize(semis.size());
 
-    if((*it)->type == TokenType::INT_LITERAL){
-        std::shared_ptr<Node> ret = std::make_shared<Node>(NodeType::value, std::make_shared<Token>(**it));
-        ++(*it);
+    //a block below this many statements costs more to schedule than to parse
+    const uint32_t minBlock = 256;
+    if(threads > 1 && semis.size() < (size_t)minBlock * 2){
+        threads = 1;
+    }
+    if(threads < 1){
+        threads = 1;
+    }
 
-#ifdef PARSE_TREE_DEBUG_PRINT
-        for(int i = 0; i < depth; i++){ std::cout << ".  "; }
-        std::cout << "found int literal\n";
-#endif
+    ret.arenas.resize(threads);
+    std::vector<ParseState> states(threads);
+    for(int w = 0; w < threads; w++){
+        states[w].tokens = &tokens;
+        states[w].match = &match;
+        states[w].arena = &ret.arenas[w];
+        states[w].maxDepth = options.maxDepth;
+        //roughly one leaf and one operand wrapper per token
+        ret.arenas[w].reserve(tokens.size() * 2 / threads);
+    }
 
-        return ret;
+    if(threads == 1){
+        parseStatements(&states[0], ret.traces, semis, 0, semis.size(), 0);
+    } else {
+        //several blocks per worker so stealing can even out slow ones
+        uint32_t blockSize = std::max<uint32_t>(minBlock, (uint32_t)(semis.size() / (threads * 16)));
+        uint32_t blocks = (uint32_t)((semis.size() + blockSize - 1) / blockSize);
+        ThreadPool pool(threads);
+        pool.parallelFor(blocks, [&](int worker, uint32_t block){
+            uint32_t first = block * blockSize;
+            uint32_t last = std::min<uint32_t>(first + blockSize, semis.size());
+            parseStatements(&states[worker], ret.traces, semis, first, last, worker);
+        });
     }
-    return StackTrace(ErrorType::EXPECTED_STATEMENT, "Expected INT_LITERAL");
+
+    finishParseTree(ret, states, tokens);
+    return ret;
 }
 
-parseTreeReturn createParseTree(std::vector<Token>& tokens){
-    parseTreeReturn ret;
-    std::vector<Token>::iterator lineStart = tokens.begin();
-    std::vector<Token>::iterator lineEnd;
-    for(std::vector<Token>::iterator it = tokens.begin(); it != tokens.end(); ++it){
-        if(it->type == TokenType::SEMI){
-            lineEnd = it;
-
-            ret.traces.push_back(parseStatement(&lineStart, lineEnd, 0));
-            if(!ret.traces.back().success){
-                ret.success = false;
-            }
+void ParseStream::begin(const TokenStream* tokens, const std::vector<int>* match, int maxDepth){
+    ret = parseTreeReturn();
+    ret.arenas.resize(1);
+    states.assign(1, ParseState());
+    states[0].tokens = tokens;
+    states[0].match = match;
+    states[0].arena = &ret.arenas[0];
+    states[0].maxDepth = maxDepth;
+    lineStart = 0;
+    scanned = 0;
+}
 
-            lineStart = it+1;
+void ParseStream::advance(){
+    const TokenStream& tokens = *states[0].tokens;
+    for(; scanned < tokens.size(); scanned++){
+        if(tokens.type(scanned) == TokenType::SEMI){
+            ret.traces.push_back(parseOneStatement(&states[0], lineStart, scanned, 0));
+            lineStart = scanned + 1;
         }
     }
-    return ret;
 }
 
-#endif
\ No newline at end of file
+parseTreeReturn ParseStream::finish(){
+    finishParseTree(ret, states, *states[0].tokens);
+    return std::move(ret);
+}
+
+#endif
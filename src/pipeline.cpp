@@ -0,0 +1,78 @@
+#ifndef PIPELINE_CPP
+#define PIPELINE_CPP
+
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <thread>
+
+#include "pipeline.h"
+#include "spscRing.h"
+
+//source bytes lexed per batch, extended to the next ';' so a batch holds whole statements
+#define PIPELINE_BATCH_BYTES (64 * 1024)
+#define PIPELINE_RING_SLOTS 8
+
+struct TokenBatch{
+    TokenStream tokens;
+    bool last = false;
+};
+
+/*
+the lexer runs on its own thread and hands batches of whole statements
+through a ring of reusable TokenStreams. this thread appends each batch
+to the full stream, extends the delimiter match and parses the new
+statements while the lexer works on the next batch.
+line numbers need nothing extra, the lexer records newline offsets as it
+goes and batches carry them over
+*/
+PipelineResult lexAndParse(std::string_view source, const ParseOptions& options){
+    PipelineResult ret;
+    ret.tokens.source = source;
+    ret.tokens.reserve(source.size() / 2);
+
+    SpscRing<TokenBatch, PIPELINE_RING_SLOTS> ring;
+    SymbolTable* symbols = &globalSymbols();
+    std::thread lexer([&ring, source, symbols]{
+        SymbolScope scope(*symbols);
+        size_t from = 0;
+        do{
+            size_t to = std::min(source.size(), from + PIPELINE_BATCH_BYTES);
+            if(to < source.size()){
+                const void* semi = std::memchr(source.data() + to, ';', source.size() - to);
+                to = (semi == nullptr) ? source.size() : (const char*)semi - source.data() + 1;
+            }
+            TokenBatch* batch = ring.acquire();
+            batch->tokens.clear();
+            batch->tokens.source = source;
+            tokenizeRange(batch->tokens, from, to);
+            batch->last = (to == source.size());
+            ring.publish();
+            from = to;
+        } while(from < source.size());
+    });
+
+    DelimiterMatcher matcher;
+    ParseStream parser;
+    parser.begin(&ret.tokens, &matcher.result.match, options.maxDepth);
+    bool last = false;
+    while(!last){
+        TokenBatch* batch = ring.front();
+        ret.tokens.append(batch->tokens);
+        last = batch->last;
+        ring.release();
+        matcher.extend(ret.tokens);
+        //after a delimiter error the tree is thrown away, only the tokens are still needed
+        if(matcher.result.success){
+            parser.advance();
+        }
+    }
+    lexer.join();
+
+    matcher.finish();
+    ret.delimiters = std::move(matcher.result);
+    ret.parseTree = parser.finish();
+    return ret;
+}
+
+#endif
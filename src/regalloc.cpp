@@ -0,0 +1,228 @@
+#ifndef REGALLOC_CPP
+#define REGALLOC_CPP
+
+#include <vector>
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include <bit>
+
+#include "regalloc.h"
+
+/*
+slots are handed out in order of interval start and freed once the
+interval has ended, strictly before the next one starts, so a phi
+never shares a slot with a value read by the branch it is copied at.
+values is sorted by start
+*/
+static uint32_t assignSlots(const std::vector<LiveInterval>& live, const std::vector<ValueId>& values, std::vector<uint32_t>& slot){
+    uint32_t count = 0;
+    std::vector<uint32_t> free;
+    std::priority_queue<std::pair<uint32_t, uint32_t>, std::vector<std::pair<uint32_t, uint32_t>>, std::greater<>> active;
+    for(ValueId v : values){
+        while(!active.empty() && active.top().first < live[v].start){
+            free.push_back(active.top().second);
+            active.pop();
+        }
+        uint32_t s;
+        if(free.empty()){
+            s = count++;
+        } else {
+            s = free.back();
+            free.pop_back();
+        }
+        slot[v] = s;
+        active.push({live[v].end, s});
+    }
+    return count;
+}
+
+static void sortByStart(const std::vector<LiveInterval>& live, std::vector<ValueId>& values){
+    std::sort(values.begin(), values.end(), [&](ValueId x, ValueId y){
+        return live[x].start != live[y].start ? live[x].start < live[y].start : x < y;
+    });
+}
+
+Allocation allocateNaive(const IrProgram& program, const std::vector<uint8_t>& needs){
+    Allocation allocation;
+    std::vector<LiveInterval> live = liveIntervals(program);
+    std::vector<ValueId> values;
+    for(ValueId v = 0; v < program.size(); v++){
+        if(needs[v]){ values.push_back(v); }
+    }
+    sortByStart(live, values);
+    allocation.reg.assign(program.size(), NO_REGISTER);
+    allocation.slot.assign(program.size(), 0);
+    allocation.slots = assignSlots(live, values, allocation.slot);
+    allocation.values = values.size();
+    allocation.spilled = values.size();
+    return allocation;
+}
+
+struct ScanInterval{
+    uint32_t start;
+    uint32_t end;
+    ValueId value;
+    float weight;   //uses per instruction of the interval, the cheapest to spill is the lowest
+};
+
+//an interval that held a register, kept per register in order of start
+struct Assignment{
+    uint32_t start;
+    uint32_t end;
+    ValueId value;
+};
+
+struct ScanState{
+    const IrProgram* program = nullptr;
+    Allocation* allocation = nullptr;
+    std::vector<ScanInterval> active;
+    uint32_t free = 0;  //bit per register
+    std::vector<std::vector<Assignment>> history;
+};
+
+/*
+whether reg holds no value at the copy at position t that matters after
+it. a value whose last use is the copy into the phi itself, or the test
+of the branch, which comes before the copies, does not
+*/
+static bool freeAtCopy(ScanState* s, uint8_t reg, uint32_t t, ValueId own){
+    const std::vector<Assignment>& history = s->history[reg];
+    auto after = std::upper_bound(history.begin(), history.end(), t, [](uint32_t t, const Assignment& a){ return t < a.start; });
+    const IrInst& term = s->program->insts[t];
+    ValueId condition = term.op == IrOp::BR ? term.a : NO_VALUE;
+    //assignments still holding the register never overlap, ones evicted since are skipped
+    while(after != history.begin()){
+        const Assignment& a = *--after;
+        if(s->allocation->reg[a.value] != reg){ continue; }
+        if(a.end < t){ return true; }
+        return a.end == t && (a.value == own || a.value == condition);
+    }
+    return true;
+}
+
+//registers a phi can take, given the ones free at the top of its block
+static uint32_t phiCandidates(ScanState* s, ValueId phi, uint32_t free){
+    const IrProgram& program = *s->program;
+    const IrInst& in = program.insts[phi];
+    uint32_t candidates = 0;
+    for(uint32_t bits = free; bits; bits &= bits - 1){
+        uint8_t reg = (uint8_t)std::countr_zero(bits);
+        bool ok = true;
+        for(uint32_t k = 0; k < in.b && ok; k++){
+            const PhiArg& arg = program.phiArgs[in.a + k];
+            ok = freeAtCopy(s, reg, program.blocks[arg.block].end - 1, arg.value);
+        }
+        if(ok){ candidates |= 1u << reg; }
+    }
+    return candidates;
+}
+
+//the register of the value an interval would rather share, NO_REGISTER without one
+static uint8_t hint(ScanState* s, ValueId v, uint32_t candidates){
+    const IrProgram& program = *s->program;
+    const IrInst& in = program.insts[v];
+    const std::vector<uint8_t>& reg = s->allocation->reg;
+    if(in.op == IrOp::PHI){
+        for(uint32_t k = 0; k < in.b; k++){
+            uint8_t r = reg[program.phiArgs[in.a + k].value];
+            if(r != NO_REGISTER && (candidates >> r & 1)){ return r; }
+        }
+        return NO_REGISTER;
+    }
+    if(readsA(in) && reg[in.a] != NO_REGISTER && (candidates >> reg[in.a] & 1)){
+        return reg[in.a];
+    }
+    return NO_REGISTER;
+}
+
+static void assign(ScanState* s, const ScanInterval& interval, uint8_t reg){
+    s->allocation->reg[interval.value] = reg;
+    s->free &= ~(1u << reg);
+    s->active.push_back(interval);
+    s->history[reg].push_back({interval.start, interval.end, interval.value});
+}
+
+Allocation allocateLinear(const IrProgram& program, const std::vector<uint8_t>& needs, uint8_t registers){
+    Allocation allocation;
+    allocation.reg.assign(program.size(), NO_REGISTER);
+    allocation.slot.assign(program.size(), 0);
+    std::vector<LiveInterval> live = liveIntervals(program);
+
+    std::vector<uint32_t> uses(program.size(), 0);
+    for(const IrInst& in : program.insts){
+        if(readsA(in)){ uses[in.a]++; }
+        if(readsB(in)){ uses[in.b]++; }
+        if(in.op == IrOp::PHI){
+            for(uint32_t k = 0; k < in.b; k++){ uses[program.phiArgs[in.a + k].value]++; }
+        }
+    }
+    std::vector<ScanInterval> intervals;
+    for(BlockId b = 0; b < program.blocks.size(); b++){
+        for(ValueId v = program.blocks[b].first; v < program.blocks[b].end; v++){
+            if(!needs[v]){ continue; }
+            uint32_t start = program.insts[v].op == IrOp::PHI ? program.blocks[b].first : live[v].start;
+            uint32_t end = std::max(live[v].end, start);
+            intervals.push_back({start, end, v, (uses[v] + 1.0f) / (end - start + 1)});
+        }
+    }
+    //phis start at their block, ahead of everything else in it
+    std::stable_sort(intervals.begin(), intervals.end(), [](const ScanInterval& x, const ScanInterval& y){ return x.start < y.start; });
+
+    ScanState state;
+    state.program = &program;
+    state.allocation = &allocation;
+    state.free = registers >= 32 ? UINT32_MAX : (1u << registers) - 1;
+    state.history.resize(registers);
+    std::vector<ValueId> spilled;
+    for(const ScanInterval& interval : intervals){
+        bool phi = program.insts[interval.value].op == IrOp::PHI;
+        //an operand is free at the instruction that last reads it, a phi's copies happen earlier
+        for(size_t k = 0; k < state.active.size();){
+            const ScanInterval& a = state.active[k];
+            if(a.end < interval.start || (a.end == interval.start && !phi)){
+                state.free |= 1u << allocation.reg[a.value];
+                state.active[k] = state.active.back();
+                state.active.pop_back();
+            } else {
+                k++;
+            }
+        }
+
+        uint32_t candidates = phi ? phiCandidates(&state, interval.value, state.free) : state.free;
+        if(candidates){
+            uint8_t reg = hint(&state, interval.value, candidates);
+            assign(&state, interval, reg != NO_REGISTER ? reg : (uint8_t)std::countr_zero(candidates));
+            continue;
+        }
+        //a phi's register has to be free at its copies too, so it never takes one from an active interval
+        size_t victim = state.active.size();
+        if(!phi){
+            for(size_t k = 0; k < state.active.size(); k++){
+                if(state.active[k].weight < interval.weight && (victim == state.active.size() || state.active[k].weight < state.active[victim].weight)){
+                    victim = k;
+                }
+            }
+        }
+        if(victim == state.active.size()){
+            spilled.push_back(interval.value);
+            continue;
+        }
+        ValueId evicted = state.active[victim].value;
+        uint8_t reg = allocation.reg[evicted];
+        allocation.reg[evicted] = NO_REGISTER;
+        spilled.push_back(evicted);
+        state.active[victim] = state.active.back();
+        state.active.pop_back();
+        state.free |= 1u << reg;
+        assign(&state, interval, reg);
+    }
+
+    sortByStart(live, spilled);
+    allocation.slots = assignSlots(live, spilled, allocation.slot);
+    allocation.values = intervals.size();
+    allocation.spilled = spilled.size();
+    return allocation;
+}
+
+#endif
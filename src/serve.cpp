@@ -0,0 +1,389 @@
+#ifndef SERVE_CPP
+#define SERVE_CPP
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "serve.h"
+#include "sourceFile.h"
+#include "timing.h"
+
+//sources kept warm, the least recently built is dropped past this
+#define SERVE_MAX_SESSIONS 1024
+//longest source, assembly or diagnostics either end accepts
+#define SERVE_MAX_FIELD (1u << 30)
+//longest path, name or other small field
+#define SERVE_MAX_SMALL_FIELD 65536
+//a field is read this much at a time, so memory follows the bytes that arrived rather than the length claimed
+#define SERVE_READ_CHUNK 65536
+#define SERVE_BACKLOG 128
+//a connection that sends nothing for this long is dropped, so it can not hold a thread
+#define SERVE_TIMEOUT_S 30
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//fields of one message by tag, has tells an empty field from a missing one
+struct ServeMessage{
+    std::string fields[(int)ServeField::COUNT];
+    bool has[(int)ServeField::COUNT] = {};
+};
+
+static void appendField(std::string& message, ServeField tag, const void* data, uint32_t length){
+    uint32_t head[2] = {(uint32_t)tag, length};
+    message.append((const char*)head, sizeof(head));
+    message.append((const char*)data, length);
+}
+
+static void appendField(std::string& message, ServeField tag, const std::string& value){
+    appendField(message, tag, value.data(), (uint32_t)value.size());
+}
+
+static bool writeAll(int fd, const char* data, size_t size){
+    while(size > 0){
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR){ continue; }
+        if(n <= 0){ return false; }
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char* data, size_t size){
+    while(size > 0){
+        ssize_t n = recv(fd, data, size, 0);
+        if(n < 0 && errno == EINTR){ continue; }
+        if(n <= 0){ return false; }
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static uint32_t fieldLimit(ServeField tag){
+    switch(tag){
+        case ServeField::text:
+        case ServeField::out:
+        case ServeField::err:
+        case ServeField::assembly:
+            return SERVE_MAX_FIELD;
+        default:
+            return SERVE_MAX_SMALL_FIELD;
+    }
+}
+
+/*
+false on a short read, an unknown tag or a field over its limit. err_s
+says which of the last two it was, the rest of the message is not read
+*/
+static bool readMessage(int fd, ServeMessage& message, std::string& err_s){
+    while(true){
+        uint32_t head[2];
+        if(!readAll(fd, (char*)head, sizeof(head))){ return false; }
+        if(head[0] == (uint32_t)ServeField::end){ return true; }
+        if(head[0] >= (uint32_t)ServeField::COUNT){
+            err_s = "field with unknown tag " + std::to_string(head[0]);
+            return false;
+        }
+        if(head[1] > fieldLimit((ServeField)head[0])){
+            err_s = "field larger than " + std::to_string(fieldLimit((ServeField)head[0])) + " bytes";
+            return false;
+        }
+        std::string& field = message.fields[head[0]];
+        field.clear();
+        while(field.size() < head[1]){
+            size_t at = field.size();
+            size_t chunk = std::min<size_t>(head[1] - at, SERVE_READ_CHUNK);
+            field.resize(at + chunk);
+            if(!readAll(fd, field.data() + at, chunk)){ return false; }
+        }
+        message.has[head[0]] = true;
+    }
+}
+
+static bool socketAddress(const char* path, sockaddr_un& address, std::string& err_s){
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(std::strlen(path) >= sizeof(address.sun_path)){
+        err_s = "socket path longer than " + std::to_string(sizeof(address.sun_path) - 1) + " bytes";
+        return false;
+    }
+    std::strcpy(address.sun_path, path);
+    return true;
+}
+
+bool CompileServer::listen(){
+    sockaddr_un address;
+    if(!socketAddress(socketPath.c_str(), address, err_s)){
+        return false;
+    }
+    //a socket left by a server that is gone is replaced, a live one or any other file is not
+    struct stat info;
+    if(lstat(socketPath.c_str(), &info) == 0){
+        if(!S_ISSOCK(info.st_mode)){
+            err_s = "exists and is not a socket";
+            return false;
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool live = probe >= 0 && connect(probe, (const sockaddr*)&address, sizeof(address)) == 0;
+        if(probe >= 0){ close(probe); }
+        if(live){
+            err_s = "a server is already listening on it";
+            return false;
+        }
+        unlink(socketPath.c_str());
+    }
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listenFd < 0 || bind(listenFd, (const sockaddr*)&address, sizeof(address)) != 0 || ::listen(listenFd, SERVE_BACKLOG) != 0){
+        err_s = std::strerror(errno);
+        if(listenFd >= 0){ close(listenFd); }
+        listenFd = -1;
+        return false;
+    }
+    return true;
+}
+
+//the session for key built with request's options, replacing one built with others
+static std::shared_ptr<ServeSession> findSession(CompileServer* server, const std::string& key, const ServeRequest& request){
+    std::lock_guard<std::mutex> guard(server->lock);
+    std::shared_ptr<ServeSession>& session = server->sessions[key];
+    bool same = session != nullptr && session->build.optimize == request.optimize && session->build.allocator == request.allocator;
+    if(!same || session->build.parse.maxDepth != request.maxDepth){
+        session = std::make_shared<ServeSession>();
+        session->build.optimize = request.optimize;
+        session->build.allocator = request.allocator;
+        session->build.parse.maxDepth = request.maxDepth;
+    }
+    session->used = ++server->requests;
+    std::shared_ptr<ServeSession> found = session;
+    //a session dropped while it builds lives on until that request is done
+    if(server->sessions.size() > SERVE_MAX_SESSIONS){
+        auto oldest = server->sessions.begin();
+        for(auto it = server->sessions.begin(); it != server->sessions.end(); ++it){
+            if(it->second->used < oldest->second->used){ oldest = it; }
+        }
+        server->sessions.erase(oldest);
+    }
+    return found;
+}
+
+/*
+builds the source and reports what the default path reports with -q,
+the parse tree header and its statement count included when parsing
+fails
+*/
+ServeResponse CompileServer::handle(const ServeRequest& request){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ServeResponse response;
+    bool sent = request.path.empty();
+    std::string name = request.name.empty() ? request.path : request.name;
+    std::shared_ptr<ServeSession> session = findSession(this, (sent ? "text:" : "path:") + (sent ? name : request.path), request);
+    std::lock_guard<std::mutex> guard(session->lock);
+
+    SourceFile source;
+    std::string_view text = request.text;
+    if(!sent){
+        if(!source.open(request.path.c_str())){
+            response.err = "Failed to open file \"" + name + "\": " + source.err_s + "\n";
+            return response;
+        }
+        text = source.text;
+    }
+    SymbolScope scope(session->symbols);
+    IncrementalBuild& build = session->build;
+    bool built = build.update(text, name);
+    if(build.delimiterError){
+        response.err = name + ":" + std::to_string(build.delimiterLine) + ": " + build.delimiterErr_s;
+        response.err += std::string(" [") + TokenTypeStrings[(int)build.delimiterToken] + "]\n";
+    } else if(!build.diagnostics.empty()){
+        std::ostringstream out;
+        out << "parse tree:\n-----------------------------\n(" << build.statements.size() << ")\n";
+        out << "Errors in creating parse tree\n";
+        for(int i = 0; i < (int)build.diagnostics.size(); i++){
+            build.diagnostics.at(i).print(0, out);
+        }
+        response.out = out.str();
+    } else if(!built){
+        response.err = name + ":" + std::to_string(build.lineNumber) + ": " + build.err_s + "\n";
+    } else {
+        response.status = 0;
+        response.assembly = build.assembly;
+    }
+    if(log){
+        std::lock_guard<std::mutex> logGuard(lock);
+        std::cout << name << ": " << (built ? "built" : "failed") << " in " << millisecondsSince(start) << " ms, ";
+        std::cout << build.stats.reused << " of " << build.stats.statements << " statements reused\n";
+        std::cout.flush();
+    }
+    return response;
+}
+
+static void sendResponse(int fd, const ServeResponse& response){
+    std::string reply;
+    int32_t status = response.status;
+    appendField(reply, ServeField::status, &status, sizeof(status));
+    appendField(reply, ServeField::out, response.out);
+    appendField(reply, ServeField::err, response.err);
+    if(response.status == 0){
+        appendField(reply, ServeField::assembly, response.assembly);
+    }
+    appendField(reply, ServeField::end, nullptr, 0);
+    writeAll(fd, reply.data(), reply.size());
+}
+
+/*
+reads and drops what the client is still sending, up to a field's worth.
+closing with unread bytes resets the connection, which loses the answer
+before the client reads it
+*/
+static void drain(int fd){
+    shutdown(fd, SHUT_WR);
+    char buffer[SERVE_READ_CHUNK];
+    size_t dropped = 0;
+    while(dropped <= SERVE_MAX_FIELD){
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if(n < 0 && errno == EINTR){ continue; }
+        if(n <= 0){ return; }
+        dropped += (size_t)n;
+    }
+}
+
+/*
+one request and its response per connection. a request that can not be
+read for its size or tag is answered with why before the connection is
+closed, a short one is only closed
+*/
+static void serveConnection(CompileServer* server, int fd){
+    struct timeval timeout = {SERVE_TIMEOUT_S, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ServeMessage message;
+    ServeResponse response;
+    std::string readErr_s;
+    if(!readMessage(fd, message, readErr_s)){
+        if(!readErr_s.empty()){
+            response.err = "compile request " + readErr_s + "\n";
+            sendResponse(fd, response);
+            drain(fd);
+        }
+        return;
+    }
+    uint32_t protocol = 0;
+    const std::string& version = message.fields[(int)ServeField::protocol];
+    if(version.size() == sizeof(protocol)){
+        std::memcpy(&protocol, version.data(), sizeof(protocol));
+    }
+    if(protocol != SERVE_PROTOCOL){
+        response.err = "compile server speaks protocol " + std::to_string(SERVE_PROTOCOL) + ", not " + std::to_string(protocol) + "\n";
+    } else if(!message.has[(int)ServeField::path] && !message.has[(int)ServeField::text]){
+        response.err = "compile request without a source\n";
+    } else {
+        ServeRequest request;
+        request.path = message.fields[(int)ServeField::path];
+        request.text = std::move(message.fields[(int)ServeField::text]);
+        request.name = message.fields[(int)ServeField::name];
+        const std::string& options = message.fields[(int)ServeField::options];
+        if(options.size() == 2 + sizeof(request.maxDepth)){
+            request.optimize = options[0] != 0;
+            request.allocator = options[1] == (char)RegisterAllocator::naive ? RegisterAllocator::naive : RegisterAllocator::linear;
+            std::memcpy(&request.maxDepth, options.data() + 2, sizeof(request.maxDepth));
+        }
+        if(request.maxDepth < 1){
+            response.err = "--max-depth expects a limit of at least 1\n";
+        } else {
+            response = server->handle(request);
+        }
+    }
+    sendResponse(fd, response);
+}
+
+//every thread accepts on the one socket, the kernel hands each connection to one of them
+static void acceptConnections(CompileServer* server){
+    while(true){
+        int fd = accept(server->listenFd, nullptr, nullptr);
+        if(fd < 0){
+            //out of descriptors or the like, waiting beats spinning on it
+            if(errno != EINTR && errno != ECONNABORTED){
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            continue;
+        }
+        serveConnection(server, fd);
+        close(fd);
+    }
+}
+
+void CompileServer::run(){
+    std::vector<std::thread> workers;
+    for(int i = 1; i < threads; i++){
+        workers.emplace_back(acceptConnections, this);
+    }
+    acceptConnections(this);
+}
+
+bool requestCompile(const char* socketPath, const ServeRequest& request, ServeResponse& response, std::string& err_s){
+    sockaddr_un address;
+    if(!socketAddress(socketPath, address, err_s)){
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (const sockaddr*)&address, sizeof(address)) != 0){
+        err_s = std::strerror(errno);
+        if(fd >= 0){ close(fd); }
+        return false;
+    }
+    if(request.text.size() > SERVE_MAX_FIELD){
+        err_s = "source larger than " + std::to_string(SERVE_MAX_FIELD) + " bytes, the most one request carries";
+        close(fd);
+        return false;
+    }
+    std::string message;
+    uint32_t protocol = SERVE_PROTOCOL;
+    appendField(message, ServeField::protocol, &protocol, sizeof(protocol));
+    if(request.path.empty()){
+        appendField(message, ServeField::text, request.text);
+    } else {
+        appendField(message, ServeField::path, request.path);
+    }
+    appendField(message, ServeField::name, request.name);
+    char options[2 + sizeof(request.maxDepth)] = {(char)request.optimize, (char)request.allocator};
+    std::memcpy(options + 2, &request.maxDepth, sizeof(request.maxDepth));
+    appendField(message, ServeField::options, options, sizeof(options));
+    appendField(message, ServeField::end, nullptr, 0);
+
+    //a server refusing the request answers before reading all of it, so a failed write may still get a response
+    ServeMessage reply;
+    std::string readErr_s;
+    writeAll(fd, message.data(), message.size());
+    bool received = readMessage(fd, reply, readErr_s);
+    close(fd);
+    const std::string& status = reply.fields[(int)ServeField::status];
+    if(!readErr_s.empty()){
+        err_s = "response " + readErr_s;
+        return false;
+    }
+    if(!received || status.size() != sizeof(int32_t)){
+        err_s = "the server closed the connection without a response";
+        return false;
+    }
+    int32_t value;
+    std::memcpy(&value, status.data(), sizeof(value));
+    response.status = value;
+    response.out = std::move(reply.fields[(int)ServeField::out]);
+    response.err = std::move(reply.fields[(int)ServeField::err]);
+    response.assembly = std::move(reply.fields[(int)ServeField::assembly]);
+    return true;
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef SOURCEFILE_CPP
+#define SOURCEFILE_CPP
+
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sourceFile.h"
+
+SourceFile::~SourceFile(){
+    if(mapping != nullptr){
+        munmap(mapping, mappingSize);
+    }
+}
+
+//reads fd to the end into buffer, for anything that cannot be mapped
+static bool readAll(int fd, std::string& buffer, size_t sizeHint){
+    buffer.clear();
+    //one byte past the hint so a file of exactly that size ends without growing
+    buffer.resize(sizeHint > 0 ? sizeHint + 1 : 65536);
+    size_t used = 0;
+    while(true){
+        if(used == buffer.size()){
+            buffer.resize(buffer.size() * 2);
+        }
+        ssize_t n = read(fd, buffer.data() + used, buffer.size() - used);
+        if(n < 0){
+            if(errno == EINTR){ continue; }
+            return false;
+        }
+        if(n == 0){ break; }
+        used += (size_t)n;
+    }
+    buffer.resize(used);
+    return true;
+}
+
+bool SourceFile::open(const char* path){
+    int fd = ::open(path, O_RDONLY);
+    if(fd < 0){
+        success = false;
+        err_s = std::strerror(errno);
+        return false;
+    }
+
+    struct stat info;
+    bool regular = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+    if(regular && info.st_size == 0){
+        close(fd);
+        text = std::string_view();
+        return true;
+    }
+    if(regular){
+        void* p = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED){
+            //the lexer reads front to back exactly once
+            madvise(p, (size_t)info.st_size, MADV_SEQUENTIAL);
+            madvise(p, (size_t)info.st_size, MADV_WILLNEED);
+            mapping = p;
+            mappingSize = (size_t)info.st_size;
+            mapped = true;
+            close(fd);
+            text = std::string_view((const char*)mapping, mappingSize);
+            return true;
+        }
+    }
+
+    if(!readAll(fd, buffer, regular ? (size_t)info.st_size : 0)){
+        success = false;
+        err_s = std::strerror(errno);
+        close(fd);
+        return false;
+    }
+    close(fd);
+    text = buffer;
+    return true;
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef STREAM_CPP
+#define STREAM_CPP
+
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "stream.h"
+#include "tokenize.h"
+
+//bytes read per step, a chunk grows past this only for a statement that does not fit
+#define STREAM_CHUNK_BYTES (1024 * 1024)
+
+/*
+offset just past the last SEMI of tokens that is outside every bracket,
+0 if there is none. cutting there keeps every delimiter pair in one
+chunk, so matching chunk by chunk agrees with matching the whole file
+*/
+static size_t lastStatementEnd(const TokenStream& tokens){
+    size_t cut = 0;
+    int depth = 0;
+    for(uint32_t i = 0; i < tokens.size(); i++){
+        switch(tokens.type(i)){
+            case TokenType::OPEN_PARENTH: case TokenType::OPEN_BRACKET: case TokenType::OPEN_CURLY:
+                depth++;
+                break;
+            case TokenType::CLOSE_PARENTH: case TokenType::CLOSE_BRACKET: case TokenType::CLOSE_CURLY:
+                depth--;
+                break;
+            case TokenType::SEMI:
+                if(depth <= 0){ cut = tokens.offsets[i] + 1; }
+                break;
+            default:
+                break;
+        }
+    }
+    return cut;
+}
+
+StreamResult compileStream(const char* path, const ParseOptions& options, const ChunkEmitter& emit){
+    StreamResult ret;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        ret.success = false;
+        ret.err_s = std::strerror(errno);
+        return ret;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    std::string buffer;
+    size_t filled = 0;
+    int lineBase = 0;
+    bool eof = false;
+    while(true){
+        //top up to one read step past what is still pending from the last chunk
+        if(!eof){
+            buffer.resize(filled + STREAM_CHUNK_BYTES);
+            ssize_t n;
+            do{
+                n = read(fd, buffer.data() + filled, STREAM_CHUNK_BYTES);
+            } while(n < 0 && errno == EINTR);
+            if(n < 0){
+                ret.success = false;
+                ret.err_s = std::strerror(errno);
+                break;
+            }
+            if(n == 0){ eof = true; }
+            filled += (size_t)n;
+            ret.bytes += (size_t)n;
+        }
+        if(filled == 0){ break; }
+
+        std::string_view text(buffer.data(), filled);
+        size_t cut = filled;
+        TokenStream tokens;
+        if(!eof){
+            //only whole statements, the rest waits for more input
+            size_t semi = text.rfind(';');
+            if(semi == std::string_view::npos){ continue; }
+            cut = semi + 1;
+            tokens = tokenize(text.substr(0, cut));
+            size_t statementEnd = lastStatementEnd(tokens);
+            if(statementEnd == 0){ continue; }
+            if(statementEnd != cut){
+                cut = statementEnd;
+                tokens = tokenize(text.substr(0, cut));
+            }
+        } else {
+            tokens = tokenize(text);
+        }
+        tokens.lineBase = lineBase;
+
+        DelimiterMatch delimiters = matchDelimiters(tokens);
+        if(!delimiters.success){
+            ret.success = false;
+            ret.delimiterError = true;
+            ret.delimiterErr_s = delimiters.err_s;
+            ret.delimiterLine = tokens.lineNumber(delimiters.errIndex);
+            ret.delimiterToken = tokens.type(delimiters.errIndex);
+            break;
+        }
+
+        parseTreeReturn parseTree = createParseTree(tokens, delimiters.match, options);
+        if(!parseTree.success){
+            ret.success = false;
+            for(ParseDiagnostic& d : parseTree.diagnostics){
+                ret.diagnostics.push_back(std::move(d));
+            }
+        }
+        ret.stats.add(parseTree.stats);
+        ret.tokens += tokens.size();
+        ret.statements += parseTree.traces.size();
+        ret.chunks++;
+        ret.largestChunk = std::max(ret.largestChunk, cut);
+        emit(tokens, parseTree);
+
+        //keep the unlexed tail for the next chunk, tokens and nodes go out of scope here
+        lineBase += (int)tokens.newlines.size();
+        std::memmove(buffer.data(), buffer.data() + cut, filled - cut);
+        filled -= cut;
+        if(eof){ break; }
+        //a statement far larger than a read step can leave the buffer oversized
+        if(buffer.capacity() > 4 * (size_t)STREAM_CHUNK_BYTES && filled < STREAM_CHUNK_BYTES){
+            buffer.resize(filled);
+            buffer.shrink_to_fit();
+        }
+    }
+    close(fd);
+    return ret;
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef SYMBOLTABLE_CPP
+#define SYMBOLTABLE_CPP
+
+#include <cstring>
+
+#include "symbolTable.h"
+
+#define SYMBOL_BLOCK_SIZE 65536
+#define SYMBOL_INITIAL_SLOTS 1024
+
+//FNV-1a
+uint32_t hashName(std::string_view s){
+    uint32_t h = 2166136261u;
+    for(char c : s){
+        h ^= (unsigned char)c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+//slot holding the name, or the empty slot it would go in
+size_t findSlot(const SymbolTable& table, std::string_view s, uint32_t h){
+    size_t mask = table.slots.size() - 1;
+    size_t i = h & mask;
+    while(table.slots[i] != NO_SYMBOL){
+        SymbolId id = table.slots[i];
+        if(table.hashes[id] == h && table.names[id] == s){
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+//doubles the slot array, kept at most half full
+void growSlots(SymbolTable& table){
+    size_t size = table.slots.empty() ? SYMBOL_INITIAL_SLOTS : table.slots.size() * 2;
+    table.slots.assign(size, NO_SYMBOL);
+    for(SymbolId id = 0; id < table.names.size(); id++){
+        size_t i = table.hashes[id] & (size - 1);
+        while(table.slots[i] != NO_SYMBOL){
+            i = (i + 1) & (size - 1);
+        }
+        table.slots[i] = id;
+    }
+}
+
+//copies s into the arena, names longer than a block get a block of their own
+std::string_view storeName(SymbolTable& table, std::string_view s){
+    if(table.blocks.empty() || table.blockUsed + s.size() > table.blockSize){
+        table.blockSize = s.size() > SYMBOL_BLOCK_SIZE ? s.size() : SYMBOL_BLOCK_SIZE;
+        table.blocks.push_back(std::make_unique<char[]>(table.blockSize));
+        table.blockUsed = 0;
+    }
+    char* dest = table.blocks.back().get() + table.blockUsed;
+    std::memcpy(dest, s.data(), s.size());
+    table.blockUsed += s.size();
+    return std::string_view(dest, s.size());
+}
+
+SymbolId SymbolTable::intern(std::string_view s){
+    if((names.size() + 1) * 2 > slots.size()){
+        growSlots(*this);
+    }
+    uint32_t h = hashName(s);
+    size_t i = findSlot(*this, s, h);
+    if(slots[i] != NO_SYMBOL){
+        return slots[i];
+    }
+    SymbolId id = (SymbolId)names.size();
+    names.push_back(storeName(*this, s));
+    hashes.push_back(h);
+    slots[i] = id;
+    return id;
+}
+
+SymbolId SymbolTable::find(std::string_view s) const{
+    if(slots.empty()){ return NO_SYMBOL; }
+    return slots[findSlot(*this, s, hashName(s))];
+}
+
+static thread_local SymbolTable* scopedTable = nullptr;
+
+SymbolTable& globalSymbols(){
+    static SymbolTable table;
+    return scopedTable != nullptr ? *scopedTable : table;
+}
+
+SymbolScope::SymbolScope(SymbolTable& table){
+    previous = scopedTable;
+    scopedTable = &table;
+}
+
+SymbolScope::~SymbolScope(){
+    scopedTable = previous;
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef THREADPOOL_CPP
+#define THREADPOOL_CPP
+
+#include "threadPool.h"
+
+void WorkQueue::push(uint32_t task){
+    std::lock_guard<std::mutex> guard(lock);
+    tasks.push_back(task);
+}
+
+bool WorkQueue::pop(uint32_t* task){
+    std::lock_guard<std::mutex> guard(lock);
+    if(tasks.empty()){ return false; }
+    *task = tasks.back();
+    tasks.pop_back();
+    return true;
+}
+
+bool WorkQueue::steal(uint32_t* task){
+    std::lock_guard<std::mutex> guard(lock);
+    if(tasks.empty()){ return false; }
+    *task = tasks.front();
+    tasks.pop_front();
+    return true;
+}
+
+ThreadPool::ThreadPool(int workers){
+    if(workers < 1){ workers = 1; }
+    for(int i = 0; i < workers; i++){
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for(int i = 1; i < workers; i++){
+        threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& t : threads){
+        t.join();
+    }
+}
+
+void ThreadPool::workerLoop(int worker){
+    uint64_t seen = 0;
+    while(true){
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&]{ return stopping || generation != seen; });
+            if(stopping){ return; }
+            seen = generation;
+        }
+        work(worker);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            running--;
+        }
+        finished.notify_all();
+    }
+}
+
+//own tasks newest first, then the oldest task of every other worker in turn
+void ThreadPool::work(int worker){
+    int n = workers();
+    uint32_t task;
+    while(true){
+        bool found = queues[worker]->pop(&task);
+        for(int i = 1; !found && i < n; i++){
+            found = queues[(worker + i) % n]->steal(&task);
+        }
+        //nothing left anywhere, and no task adds more
+        if(!found){ return; }
+        (*job)(worker, task);
+    }
+}
+
+void ThreadPool::parallelFor(uint32_t taskCount, const std::function<void(int, uint32_t)>& _job){
+    int n = workers();
+    //contiguous blocks keep neighbouring tasks on one worker, pushed in reverse so pop() runs them in order
+    for(int w = 0; w < n; w++){
+        uint32_t first = (uint32_t)((uint64_t)taskCount * w / n);
+        uint32_t last = (uint32_t)((uint64_t)taskCount * (w + 1) / n);
+        for(uint32_t t = last; t > first; t--){
+            queues[w]->push(t - 1);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        job = &_job;
+        running = n - 1;
+        generation++;
+    }
+    wake.notify_all();
+    work(0);
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [&]{ return running == 0; });
+    job = nullptr;
+}
+
+#endif
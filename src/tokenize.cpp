@@ -3,132 +3,387 @@
 
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <utility>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "token.h"
+#include "tokenize.h"
+#include "operators.h"
 
-void cleanTokens(std::vector<Token> &tokens){
-    int lineNo = 1;
+void TokenStream::push(TokenType type, uint32_t offset, uint32_t length, uint32_t payload){
+    types.push_back((uint8_t)type);
+    offsets.push_back(offset);
+    lengths.push_back(length);
+    payloads.push_back(payload);
+}
+
+void TokenStream::reserve(size_t n){
+    types.reserve(n);
+    offsets.reserve(n);
+    lengths.reserve(n);
+    payloads.reserve(n);
+}
 
-    for(std::vector<Token>::iterator it = tokens.begin(); it != tokens.end(); ++it){
-        if(it->type == TokenType::NEWLINE){
-            lineNo++;
+void TokenStream::append(const TokenStream& other){
+    uint32_t first = size();
+    uint32_t literalBase = (uint32_t)intLiterals.size();
+    types.insert(types.end(), other.types.begin(), other.types.end());
+    offsets.insert(offsets.end(), other.offsets.begin(), other.offsets.end());
+    lengths.insert(lengths.end(), other.lengths.begin(), other.lengths.end());
+    payloads.insert(payloads.end(), other.payloads.begin(), other.payloads.end());
+    //literal payloads index the other stream's table
+    if(!other.intLiterals.empty()){
+        for(uint32_t i = first; i < size(); i++){
+            if(type(i) == TokenType::INT_LITERAL){ payloads[i] += literalBase; }
         }
-        it->lineNumber = lineNo;
-    }
-    std::erase_if(tokens, [](Token &t){return t.type==TokenType::NEWLINE;});
-}
-
-std::vector<Token> tokenize(const std::string& str){
-    std::vector<Token> tokens;
-    std::string charBuffer = "";
-    std::string binaryOperatorChars = "+-*/%=<>";
-    std::string repeatedOperators = "+-<>";
-    
-    for(int i = 0; i < str.size(); i++){
-        charBuffer = "";
-        char c = str.at(i);
-        if(c == ';'){ tokens.push_back(Token(TokenType::SEMI)); }
-        else if(c == '\n'){ tokens.push_back(Token(TokenType::NEWLINE)); }
-        else if(c == ' ' || c == '\t'){ /*skip whitespace characters*/ }
-        //handle ()[]{}
-        else if(c == '('){ tokens.push_back(Token(TokenType::OPEN_PARENTH)); }
-        else if(c == ')'){ tokens.push_back(Token(TokenType::CLOSE_PARENTH)); }
-        else if(c == '['){ tokens.push_back(Token(TokenType::OPEN_BRACKET)); }
-        else if(c == ']'){ tokens.push_back(Token(TokenType::CLOSE_BRACKET)); }
-        else if(c == '{'){ tokens.push_back(Token(TokenType::OPEN_CURLY)); }
-        else if(c == '}'){ tokens.push_back(Token(TokenType::CLOSE_CURLY)); }
-        //handle +-*/%=<>
-        else if(binaryOperatorChars.find(c) != std::string::npos){
-            //handle += type shit
-            if(i + 1 < str.size() && str.at(i+1) == '='){
-                tokens.push_back(Token(TokenType::BINARY_OPERATOR, charBuffer + c + "="));
-                i++;
-            } else {
-                //handle ++, --, <<, >>
-                if(i + 1 < str.size() && repeatedOperators.find(c) != std::string::npos && str.at(i+1) == c){ 
-                    tokens.push_back(Token((c == '+' || c == '-') ? TokenType::UNARY_OPERATOR : TokenType::BINARY_OPERATOR, charBuffer + c + c));
-                    i++;
-                //must be +-*/%=<>
-                } else {
-                    tokens.push_back(Token(TokenType::BINARY_OPERATOR, std::string(1, c)));
+    }
+    intLiterals.insert(intLiterals.end(), other.intLiterals.begin(), other.intLiterals.end());
+    newlines.insert(newlines.end(), other.newlines.begin(), other.newlines.end());
+}
+
+void TokenStream::clear(){
+    types.clear();
+    offsets.clear();
+    lengths.clear();
+    payloads.clear();
+    intLiterals.clear();
+    newlines.clear();
+}
+
+//1 + number of newlines before the token
+int TokenStream::lineNumber(uint32_t i) const{
+    return lineBase + 1 + (int)(std::upper_bound(newlines.begin(), newlines.end(), offsets[i]) - newlines.begin());
+}
+
+/*
+character classes for the lexer's first byte dispatch, one table lookup
+instead of a chain of comparisons
+*/
+enum class CharClass : uint8_t{
+    OTHER,      //ignored
+    SPACE,      //' ' '\t' '\r'
+    NEWLINE,
+    IDENT,      //a-z A-Z _
+    DIGIT,
+    DOT,
+    SINGLE,     //one character tokens ; ( ) [ ] { } ,
+    OPERATOR,   //+ - * / % = < > ! & |
+};
+
+struct CharTables{
+    CharClass classes[256] = {};
+    TokenType singles[256] = {};
+};
+
+constexpr CharTables makeCharTables(){
+    CharTables t;
+    for(int c = 0; c < 256; c++){
+        t.classes[c] = CharClass::OTHER;
+        t.singles[c] = TokenType::NULLTOKEN;
+    }
+    t.classes[(int)' '] = CharClass::SPACE;
+    t.classes[(int)'\t'] = CharClass::SPACE;
+    t.classes[(int)'\r'] = CharClass::SPACE;
+    t.classes[(int)'\n'] = CharClass::NEWLINE;
+    for(int c = 'a'; c <= 'z'; c++){ t.classes[c] = CharClass::IDENT; }
+    for(int c = 'A'; c <= 'Z'; c++){ t.classes[c] = CharClass::IDENT; }
+    t.classes[(int)'_'] = CharClass::IDENT;
+    for(int c = '0'; c <= '9'; c++){ t.classes[c] = CharClass::DIGIT; }
+    t.classes[(int)'.'] = CharClass::DOT;
+
+    const char singleChars[] = ";()[]{},";
+    const TokenType singleTypes[] = {
+        TokenType::SEMI, TokenType::OPEN_PARENTH, TokenType::CLOSE_PARENTH, TokenType::OPEN_BRACKET,
+        TokenType::CLOSE_BRACKET, TokenType::OPEN_CURLY, TokenType::CLOSE_CURLY, TokenType::COMMA,
+    };
+    for(int i = 0; i < 8; i++){
+        t.classes[(int)singleChars[i]] = CharClass::SINGLE;
+        t.singles[(int)singleChars[i]] = singleTypes[i];
+    }
+    const char operatorChars[] = "+-*/%=<>!&|";
+    for(int i = 0; operatorChars[i] != 0; i++){
+        t.classes[(int)operatorChars[i]] = CharClass::OPERATOR;
+    }
+    return t;
+}
+
+constexpr CharTables charTables = makeCharTables();
+
+/*
+run scanners, each returns the first position in [p, end) outside its
+character set. 32 or 16 bytes are classified per step when AVX2/SSE2 is
+available, the tail (and every non x86 build) uses the table.
+loads never go past end
+*/
+#if defined(__SSE2__)
+//bytes of v in [lo, hi], as 0xFF lanes
+static inline __m128i inRange16(__m128i v, char lo, char hi){
+    __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8((char)(hi - lo))), shifted);
+}
+#endif
+#if defined(__AVX2__)
+static inline __m256i inRange32(__m256i v, char lo, char hi){
+    __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8((char)(hi - lo))), shifted);
+}
+#endif
+
+static const char* skipSpaces(const char* p, const char* end){
+#if defined(__AVX2__)
+    while(end - p >= 32){
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+        uint32_t outside = ~(uint32_t)_mm256_movemask_epi8(m);
+        if(outside != 0){ return p + __builtin_ctz(outside); }
+        p += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    while(end - p >= 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+        uint32_t outside = ~(uint32_t)_mm_movemask_epi8(m) & 0xFFFF;
+        if(outside != 0){ return p + __builtin_ctz(outside); }
+        p += 16;
+    }
+#endif
+    while(p < end && charTables.classes[(unsigned char)*p] == CharClass::SPACE){ p++; }
+    return p;
+}
+
+static const char* scanIdentifier(const char* p, const char* end){
+#if defined(__AVX2__)
+    while(end - p >= 32){
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i m = _mm256_or_si256(inRange32(v, 'a', 'z'), inRange32(v, 'A', 'Z'));
+        m = _mm256_or_si256(m, inRange32(v, '0', '9'));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+        uint32_t outside = ~(uint32_t)_mm256_movemask_epi8(m);
+        if(outside != 0){ return p + __builtin_ctz(outside); }
+        p += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    while(end - p >= 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i m = _mm_or_si128(inRange16(v, 'a', 'z'), inRange16(v, 'A', 'Z'));
+        m = _mm_or_si128(m, inRange16(v, '0', '9'));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        uint32_t outside = ~(uint32_t)_mm_movemask_epi8(m) & 0xFFFF;
+        if(outside != 0){ return p + __builtin_ctz(outside); }
+        p += 16;
+    }
+#endif
+    while(p < end){
+        CharClass c = charTables.classes[(unsigned char)*p];
+        if(c != CharClass::IDENT && c != CharClass::DIGIT){ break; }
+        p++;
+    }
+    return p;
+}
+
+static const char* scanDigits(const char* p, const char* end){
+#if defined(__AVX2__)
+    while(end - p >= 32){
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        uint32_t outside = ~(uint32_t)_mm256_movemask_epi8(inRange32(v, '0', '9'));
+        if(outside != 0){ return p + __builtin_ctz(outside); }
+        p += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    while(end - p >= 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        uint32_t outside = ~(uint32_t)_mm_movemask_epi8(inRange16(v, '0', '9')) & 0xFFFF;
+        if(outside != 0){ return p + __builtin_ctz(outside); }
+        p += 16;
+    }
+#endif
+    while(p < end && charTables.classes[(unsigned char)*p] == CharClass::DIGIT){ p++; }
+    return p;
+}
+
+//pushes the longest operator starting at p, returns its length
+static int lexOperator(TokenStream& tokens, const char* p, const char* end, uint32_t offset){
+    const LexemeEntry* op = nullptr;
+    if(p + 1 < end && charTables.classes[(unsigned char)p[1]] == CharClass::OPERATOR){
+        op = lookupOperator(std::string_view(p, 2));
+    }
+    if(op == nullptr){
+        op = lookupOperator(std::string_view(p, 1));
+    }
+    tokens.push(op->type, offset, op->text.size(), op->value);
+    return op->text.size();
+}
+
+TokenStream tokenize(std::string_view str){
+    TokenStream tokens;
+    tokens.source = str;
+    //generated sources average under 3 bytes per token, reserving more only costs untouched pages
+    tokens.reserve(str.size() / 2);
+    tokenizeRange(tokens, 0, str.size());
+    return tokens;
+}
+
+/*
+appends the tokens of tokens.source[from, to) with offsets into the whole
+source. from and to must not split a token, a ';' always ends one
+*/
+void tokenizeRange(TokenStream& tokens, size_t from, size_t to){
+    SymbolTable& symbols = globalSymbols();
+    const char* begin = tokens.source.data();
+    const char* end = begin + to;
+    const char* p = begin + from;
+    while(p < end){
+        unsigned char c = (unsigned char)*p;
+        uint32_t offset = (uint32_t)(p - begin);
+        switch(charTables.classes[c]){
+            case CharClass::SPACE:
+                p = skipSpaces(p + 1, end);
+                break;
+            case CharClass::NEWLINE:
+                tokens.newlines.push_back(offset);
+                p++;
+                break;
+            case CharClass::SINGLE:
+                tokens.push(charTables.singles[c], offset, 1);
+                p++;
+                break;
+            case CharClass::OPERATOR:
+                p += lexOperator(tokens, p, end, offset);
+                break;
+            case CharClass::IDENT: {
+                const char* wordEnd = scanIdentifier(p + 1, end);
+                std::string_view word(p, wordEnd - p);
+                const LexemeEntry* keyword = lookupKeyword(word);
+                if(keyword != nullptr){
+                    tokens.push(keyword->type, offset, word.size(), keyword->value);
+                } else { //generic identifier (variable/function names etc.)
+                    tokens.push(TokenType::IDENTIFIER, offset, word.size(), symbols.intern(word));
                 }
+                p = wordEnd;
+                break;
             }
-        }
-        //handle !, !=, &, &&, |, ||
-        else if(c == '!' || c == '&' || c == '|'){
-            //check for !=, &&, ||
-            if(i + 1 < str.size()){
-                if(c == '!'){
-                    if(str.at(i+1) == '='){ tokens.push_back(Token(TokenType::BINARY_OPERATOR, "!=")); i++;}
-                    else { tokens.push_back(Token(TokenType::UNARY_OPERATOR, "!")); } 
+            case CharClass::DIGIT:
+            case CharClass::DOT: {
+                const char* numEnd = scanDigits(p, end);
+                if(numEnd < end && *numEnd == '.'){
+                    //floating point goes here, for now the whole literal is skipped
+                    while(numEnd < end && (charTables.classes[(unsigned char)*numEnd] == CharClass::DIGIT || *numEnd == '.')){
+                        numEnd++;
+                    }
                 } else {
-                    if(str.at(i+1) == c){ tokens.push_back(Token(TokenType::BINARY_OPERATOR, c=='&' ? "&&" : "||")); i++;}
-                    else { tokens.push_back(Token(TokenType::BINARY_OPERATOR, std::string(1, c))); }
+                    //digits are known valid, overflow wraps
+                    uint64_t value = 0;
+                    for(const char* d = p; d < numEnd; d++){
+                        value = value * 10 + (uint64_t)(*d - '0');
+                    }
+                    tokens.push(TokenType::INT_LITERAL, offset, numEnd - p, tokens.intLiterals.size());
+                    tokens.intLiterals.push_back((int64_t)value);
                 }
-            //must be !, &, |
-            } else {
-                if(c == '!'){ tokens.push_back(Token(TokenType::UNARY_OPERATOR, "!")); }
-                else { tokens.push_back(Token(TokenType::BINARY_OPERATOR, std::string(1, c))); }
+                p = numEnd;
+                break;
             }
+            default:
+                p++;
+                break;
         }
-        //start of identifier
-        else if(std::isalpha(c) || c == '_'){ 
-            while(std::isalnum(str.at(i)) || str.at(i) == '_'){
-                charBuffer += str.at(i);
-                i++;
-                if(i >= str.size()){
-                    break;
-                }
-            }
-            i--;
-            
-            //handle different identifiers
-            if(charBuffer == "return"){
-                tokens.push_back(Token(TokenType::RESERVED));
-                tokens.back().s_value = "return";
-            } else { //generic identifier (variable/function names etc.)
-                tokens.push_back(Token(TokenType::IDENTIFIER, charBuffer));
-            }
+    }
+}
+
+/*
+one stack based pass pairing every open delimiter with its close, so the
+parser can jump over a bracketed range without scanning it.
+fails on the first close that does not match the innermost open, or on
+the innermost open left unclosed at the end.
+extend() can be called as the stream grows, opens still waiting for
+their close read as unmatched (-1) until it arrives
+*/
+void DelimiterMatcher::extend(const TokenStream& tokens){
+    if(!result.success){ return; }
+    result.match.resize(tokens.size(), -1);
+    for(int i = (int)matched; i < (int)tokens.size(); i++){
+        TokenType t = tokens.type(i);
+        if(t == TokenType::OPEN_PARENTH || t == TokenType::OPEN_BRACKET || t == TokenType::OPEN_CURLY){
+            openStack.push_back(i);
+            continue;
         }
-        //number literal
-        else if(std::isdigit(c) || c == '.'){ 
-            while((str.at(i) >= 48 && str.at(i) <= 57) || str.at(i) == '.'){
-                charBuffer += str.at(i);
-                i++;
-                if(i >= str.size()){
-                    break;
-                }
-            }
-            i--;
-            
-            if(charBuffer.find('.') == std::string::npos){ // integer
-                tokens.push_back(Token(TokenType::INT_LITERAL, std::stoi(charBuffer)));
-            } else {
-                //floating point goes here
-            }
+        TokenType expected;
+        if(t == TokenType::CLOSE_PARENTH){ expected = TokenType::OPEN_PARENTH; }
+        else if(t == TokenType::CLOSE_BRACKET){ expected = TokenType::OPEN_BRACKET; }
+        else if(t == TokenType::CLOSE_CURLY){ expected = TokenType::OPEN_CURLY; }
+        else { continue; }
+
+        if(openStack.empty() || tokens.type(openStack.back()) != expected){
+            result.success = false;
+            result.errIndex = i;
+            result.err_s = openStack.empty() ? "Unmatched closing delimiter" : "Mismatched closing delimiter";
+            return;
         }
+        result.match[openStack.back()] = i;
+        result.match[i] = openStack.back();
+        openStack.pop_back();
     }
-    
-    cleanTokens(tokens);
-    return tokens;
+    matched = tokens.size();
 }
 
-void printTokens(std::vector<Token>& tokens){
-    int curLine = 1;
-    for(std::vector<Token>::iterator it = tokens.begin(); it != tokens.end(); ++it){
-        if(it->lineNumber != curLine){
-            std::cout << "\n";
-            curLine = it->lineNumber;
-        }
-        std::cout << "[";
-        std::cout << it->type;
-        if(it->has_i_val){
-            std::cout << " = " << it->i_value;
+void DelimiterMatcher::finish(){
+    if(result.success && !openStack.empty()){
+        result.success = false;
+        result.errIndex = openStack.back();
+        result.err_s = "Unclosed delimiter";
+    }
+}
+
+DelimiterMatch matchDelimiters(const TokenStream& tokens){
+    DelimiterMatcher matcher;
+    matcher.extend(tokens);
+    matcher.finish();
+    return std::move(matcher.result);
+}
+
+//same format as a single token in a parse tree: [TYPE = value]
+void printToken(const TokenStream& tokens, uint32_t i){
+    std::cout << "[";
+    std::cout << tokens.type(i);
+    switch(tokens.type(i)){
+        case TokenType::INT_LITERAL:
+            std::cout << " = " << tokens.intValue(i);
+            break;
+        case TokenType::IDENTIFIER:
+            std::cout << " = " << globalSymbols().name(tokens.symbol(i));
+            break;
+        case TokenType::BINARY_OPERATOR:
+        case TokenType::UNARY_OPERATOR:
+            std::cout << " = " << tokens.text(i);
+            break;
+        default:
+            break;
+    }
+    std::cout << "] ";
+}
+
+void printTokens(const TokenStream& tokens){
+    //walk the newline table alongside the tokens instead of searching it per token
+    size_t nextNewline = 0;
+    for(uint32_t i = 0; i < tokens.size(); i++){
+        bool newLine = false;
+        while(nextNewline < tokens.newlines.size() && tokens.newlines[nextNewline] < tokens.offsets[i]){
+            nextNewline++;
+            newLine = true;
         }
-        if(it->has_s_val){
-            std::cout << " = " << it->s_value;
+        if(newLine){
+            std::cout << "\n";
         }
-        std::cout << "] ";
+        printToken(tokens, i);
     }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,346 @@
+#ifndef VM_CPP
+#define VM_CPP
+
+#include <vector>
+
+#include "vm.h"
+#include "operators.h"
+
+#if defined(__GNUC__) && !defined(NICO_VM_SWITCH)
+#define NICO_COMPUTED_GOTO 1
+#endif
+
+bool threadedDispatchAvailable(){
+#ifdef NICO_COMPUTED_GOTO
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*
+the interpreter loop, both dispatch modes share the handlers. every
+handler is a case of the switch and, with computed goto, also a label
+that the previous handler jumps to through targets, which gives each
+handler its own indirect branch for the predictor. code has no loops,
+so instead of counting every dispatch the instructions of each straight
+run are added when it ends in a taken jump or the return
+*/
+template<bool threaded>
+static VmResult execute(const Bytecode& program, int64_t* cells){
+#ifdef NICO_COMPUTED_GOTO
+    static const void* const targets[] = {
+        &&op_CONST, &&op_CONSTW, &&op_LOAD, &&op_STORE, &&op_LOADX, &&op_STOREX, &&op_MOVE, &&op_INDEX,
+        &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_MOD, &&op_AND, &&op_OR, &&op_SHL, &&op_SHR,
+        &&op_EQ, &&op_NE, &&op_LT, &&op_GT, &&op_LE, &&op_GE,
+        &&op_NOT, &&op_TRUTH, &&op_INC, &&op_DEC, &&op_JMP, &&op_JZ, &&op_JNZ, &&op_RETURN,
+    };
+#define DISPATCH() do{ if constexpr(threaded){ goto *targets[(int)pc->op]; } else { goto dispatch; } }while(0)
+#define CASE(name) case BcOp::name: op_##name:
+#else
+#define DISPATCH() goto dispatch
+#define CASE(name) case BcOp::name:
+#endif
+#define NEXT() do{ pc++; DISPATCH(); }while(0)
+#define JUMP(target) do{ executed += pc - run + 1; pc = code + (target); run = pc; DISPATCH(); }while(0)
+#define BINARY(name, expression) CASE(name){ int64_t b = r[pc->b], c = r[pc->c]; (void)b; (void)c; r[pc->a] = (expression); NEXT(); }
+
+    const uint64_t MASK = VARIABLE_CELLS - 1;
+    std::vector<int64_t> registers(program.registers, 0);
+    int64_t* r = registers.data();
+    const BcInst* code = program.code.data();
+    const BcInst* pc = code;
+    const BcInst* run = pc;     //first instruction of the straight run being executed
+    uint64_t executed = 0;
+
+    //the first instruction is dispatched through the switch in both modes
+    goto dispatch;
+dispatch:
+    switch(pc->op){
+        CASE(CONST) r[pc->a] = (int32_t)pc->c; NEXT();
+        CASE(CONSTW) r[pc->a] = program.constants[pc->c]; NEXT();
+        CASE(LOAD) r[pc->a] = cells[pc->c]; NEXT();
+        CASE(STORE) cells[pc->c] = r[pc->a]; NEXT();
+        CASE(LOADX) r[pc->a] = cells[pc->c + ((uint64_t)r[pc->b] & MASK)]; NEXT();
+        CASE(STOREX) cells[pc->c + ((uint64_t)r[pc->b] & MASK)] = r[pc->a]; NEXT();
+        CASE(MOVE) r[pc->a] = r[pc->b]; NEXT();
+        BINARY(INDEX, (int64_t)((uint64_t)b * ARRAY_ROW_CELLS + (uint64_t)c))
+        BINARY(ADD, (int64_t)((uint64_t)b + (uint64_t)c))
+        BINARY(SUB, (int64_t)((uint64_t)b - (uint64_t)c))
+        BINARY(MUL, (int64_t)((uint64_t)b * (uint64_t)c))
+        BINARY(DIV, c == 0 ? 0 : c == -1 ? (int64_t)(0 - (uint64_t)b) : b / c)
+        BINARY(MOD, c == 0 || c == -1 ? 0 : b % c)
+        BINARY(AND, b & c)
+        BINARY(OR, b | c)
+        BINARY(SHL, (int64_t)((uint64_t)b << (c & 63)))
+        BINARY(SHR, b >> (c & 63))
+        BINARY(EQ, b == c)
+        BINARY(NE, b != c)
+        BINARY(LT, b < c)
+        BINARY(GT, b > c)
+        BINARY(LE, b <= c)
+        BINARY(GE, b >= c)
+        CASE(NOT) r[pc->a] = r[pc->b] == 0; NEXT();
+        CASE(TRUTH) r[pc->a] = r[pc->b] != 0; NEXT();
+        CASE(INC) r[pc->a] = (int64_t)((uint64_t)r[pc->b] + 1); NEXT();
+        CASE(DEC) r[pc->a] = (int64_t)((uint64_t)r[pc->b] - 1); NEXT();
+        CASE(JMP) JUMP(pc->c);
+        CASE(JZ) if(r[pc->a] == 0){ JUMP(pc->c); } NEXT();
+        CASE(JNZ) if(r[pc->a] != 0){ JUMP(pc->c); } NEXT();
+        CASE(RETURN){
+            executed += pc - run + 1;
+            return {r[pc->a], executed};
+        }
+    }
+    return {0, executed};
+#undef DISPATCH
+#undef CASE
+#undef NEXT
+#undef JUMP
+#undef BINARY
+}
+
+VmResult runBytecode(const Bytecode& program, int64_t* cells, VmDispatch dispatch){
+#ifdef NICO_COMPUTED_GOTO
+    if(dispatch == VmDispatch::threaded){
+        return execute<true>(program, cells);
+    }
+#endif
+    (void)dispatch;
+    return execute<false>(program, cells);
+}
+
+/*
+tree walking. a node evaluates a child by setting the step it resumes
+at and pushing the child (callNode), and finishes by popping itself and
+pushing its value (returnValue), variables in address mode push their
+cell index
+*/
+
+static void callNode(TreeWalker* walker, NodeId node, bool address=false){
+    WalkFrame f;
+    f.node = walker->unwrap(node);
+    f.address = address;
+    walker->frames.push_back(f);
+    walker->result.instructions++;
+}
+
+static void returnValue(TreeWalker* walker, int64_t value){
+    walker->frames.pop_back();
+    walker->values.push_back(value);
+}
+
+static int64_t popValue(TreeWalker* walker){
+    int64_t v = walker->values.back();
+    walker->values.pop_back();
+    return v;
+}
+
+static bool arithmeticOp(Operator op, IrOp* out){
+    switch(op){
+        case Operator::PLUS: case Operator::PLUS_ASSIGN: *out = IrOp::ADD; return true;
+        case Operator::MINUS: case Operator::MINUS_ASSIGN: *out = IrOp::SUB; return true;
+        case Operator::STAR: case Operator::STAR_ASSIGN: *out = IrOp::MUL; return true;
+        case Operator::SLASH: case Operator::SLASH_ASSIGN: *out = IrOp::DIV; return true;
+        case Operator::PERCENT: case Operator::PERCENT_ASSIGN: *out = IrOp::MOD; return true;
+        case Operator::BIT_AND: *out = IrOp::AND; return true;
+        case Operator::BIT_OR: *out = IrOp::OR; return true;
+        case Operator::SHIFT_LEFT: *out = IrOp::SHL; return true;
+        case Operator::SHIFT_RIGHT: *out = IrOp::SHR; return true;
+        case Operator::EQUAL: *out = IrOp::EQ; return true;
+        case Operator::NOT_EQUAL: *out = IrOp::NE; return true;
+        case Operator::LESS: *out = IrOp::LT; return true;
+        case Operator::GREATER: *out = IrOp::GT; return true;
+        case Operator::LESS_EQUAL: *out = IrOp::LE; return true;
+        case Operator::GREATER_EQUAL: *out = IrOp::GE; return true;
+        default: return false;
+    }
+}
+
+static void walkValue(TreeWalker* walker){
+    NodeId id = walker->frames.back().node;
+    uint32_t token = walker->arena->at(id).token;
+    if(walker->tokens->type(token) != TokenType::INT_LITERAL){
+        return walker->fail(id, "string literals are not supported");
+    }
+    returnValue(walker, walker->tokens->intValue(token));
+}
+
+static void walkVariable(TreeWalker* walker){
+    WalkFrame& f = walker->frames.back();
+    const Node& n = walker->arena->at(f.node);
+    if(f.step >= 2){
+        uint64_t index = (uint64_t)popValue(walker);
+        uint64_t rows = (uint64_t)popValue(walker);
+        walker->values.push_back((int64_t)(rows * ARRAY_ROW_CELLS + index));
+    }
+    if(f.step < n.childCount){
+        NodeId index = walker->arena->child(f.node, f.step);
+        f.step++;
+        return callNode(walker, index);
+    }
+    uint64_t cell = n.childCount > 0 ? (uint64_t)popValue(walker) & (VARIABLE_CELLS - 1) : 0;
+    uint64_t first = (uint64_t)walker->tokens->symbol(n.token) * VARIABLE_CELLS;
+    if(walker->cells.size() < first + VARIABLE_CELLS){
+        walker->cells.resize(first + VARIABLE_CELLS, 0);
+    }
+    if(f.address){
+        return returnValue(walker, (int64_t)(first + cell));
+    }
+    returnValue(walker, walker->cells[first + cell]);
+}
+
+static void walkAssignment(TreeWalker* walker){
+    WalkFrame& f = walker->frames.back();
+    Operator op = walker->operatorOf(f.node, 1);
+    switch(f.step){
+    case 0: {
+        NodeId target = walker->unwrap(walker->arena->child(f.node, 0));
+        if(walker->arena->at(target).type != NodeType::variable){
+            return walker->fail(f.node, "left side of " + OperatorStrings[(int)op] + " must be a variable");
+        }
+        f.step = 1;
+        return callNode(walker, target, true);
+    }
+    case 1:
+        f.step = 2;
+        return callNode(walker, walker->arena->child(f.node, 2));
+    default: {
+        int64_t value = popValue(walker);
+        int64_t cell = popValue(walker);
+        IrOp arith;
+        if(op != Operator::ASSIGN && arithmeticOp(op, &arith)){
+            value = evaluate(arith, walker->cells[cell], value);
+        }
+        walker->cells[cell] = value;
+        return returnValue(walker, value);
+    }
+    }
+}
+
+static void walkLogical(TreeWalker* walker){
+    WalkFrame& f = walker->frames.back();
+    bool isAnd = walker->operatorOf(f.node, 1) == Operator::AND;
+    switch(f.step){
+    case 0:
+        f.step = 1;
+        return callNode(walker, walker->arena->child(f.node, 0));
+    case 1: {
+        int64_t left = popValue(walker);
+        if(isAnd ? left == 0 : left != 0){
+            return returnValue(walker, isAnd ? 0 : 1);
+        }
+        f.step = 2;
+        return callNode(walker, walker->arena->child(f.node, 2));
+    }
+    default:
+        return returnValue(walker, popValue(walker) != 0);
+    }
+}
+
+static void walkBinary(TreeWalker* walker){
+    WalkFrame& f = walker->frames.back();
+    Operator op = walker->operatorOf(f.node, 1);
+    switch(op){
+        case Operator::ASSIGN: case Operator::PLUS_ASSIGN: case Operator::MINUS_ASSIGN:
+        case Operator::STAR_ASSIGN: case Operator::SLASH_ASSIGN: case Operator::PERCENT_ASSIGN:
+            return walkAssignment(walker);
+        case Operator::AND: case Operator::OR:
+            return walkLogical(walker);
+        default:
+            break;
+    }
+    IrOp arith;
+    if(!arithmeticOp(op, &arith)){
+        return walker->fail(f.node, "operator " + OperatorStrings[(int)op] + " is not supported");
+    }
+    switch(f.step){
+    case 0:
+        f.step = 1;
+        return callNode(walker, walker->arena->child(f.node, 0));
+    case 1:
+        f.step = 2;
+        return callNode(walker, walker->arena->child(f.node, 2));
+    default: {
+        int64_t right = popValue(walker);
+        int64_t left = popValue(walker);
+        return returnValue(walker, evaluate(arith, left, right));
+    }
+    }
+}
+
+static void walkUnary(TreeWalker* walker){
+    WalkFrame& f = walker->frames.back();
+    bool prefix = walker->arena->at(f.node).subtype == NodeSubType::prefix_unary;
+    NodeId operand = walker->unwrap(walker->arena->child(f.node, prefix ? 1 : 0));
+    Operator op = walker->operatorOf(f.node, prefix ? 0 : 1);
+
+    if(f.step == 0){
+        if(op != Operator::NOT && walker->arena->at(operand).type != NodeType::variable){
+            return walker->fail(f.node, "operand of " + OperatorStrings[(int)op] + " must be a variable");
+        }
+        f.step = 1;
+        return callNode(walker, operand, op != Operator::NOT);
+    }
+    if(op == Operator::NOT){
+        return returnValue(walker, popValue(walker) == 0);
+    }
+    int64_t cell = popValue(walker);
+    int64_t old = walker->cells[cell];
+    int64_t updated = evaluate(op == Operator::INCREMENT ? IrOp::ADD : IrOp::SUB, old, 1);
+    walker->cells[cell] = updated;
+    returnValue(walker, prefix ? updated : old);
+}
+
+static void walkReturn(TreeWalker* walker){
+    WalkFrame& f = walker->frames.back();
+    if(walker->arena->at(f.node).childCount > 0 && f.step == 0){
+        f.step = 1;
+        return callNode(walker, walker->arena->child(f.node, 0));
+    }
+    walker->result.status = f.step == 0 ? 0 : popValue(walker);
+    walker->returned = true;
+    walker->frames.clear();
+}
+
+void TreeWalker::statement(NodeId root){
+    frames.clear();
+    values.clear();
+    callNode(this, root);
+    while(success && !frames.empty()){
+        NodeId id = frames.back().node;
+        const Node& n = arena->at(id);
+        switch(n.type){
+            case NodeType::value:
+                walkValue(this);
+                break;
+            case NodeType::variable:
+                walkVariable(this);
+                break;
+            case NodeType::statement:
+                switch(n.subtype){
+                    case NodeSubType::binary_op: walkBinary(this); break;
+                    case NodeSubType::prefix_unary: case NodeSubType::postfix_unary: walkUnary(this); break;
+                    case NodeSubType::_return: walkReturn(this); break;
+                    case NodeSubType::func_call: fail(id, "function calls are not supported"); break;
+                    default: fail(id, "unexpected statement"); break;
+                }
+                break;
+            default:
+                fail(id, "unexpected " + NodeTypeStrings[(int)n.type] + " node");
+                break;
+        }
+    }
+}
+
+bool TreeWalker::run(const parseTreeReturn& parseTree, const TokenStream& _tokens){
+    tokens = &_tokens;
+    for(const StackTrace& trace : parseTree.traces){
+        if(!success || returned){ break; }
+        arena = &parseTree.arenaOf(trace);
+        statement(trace.node);
+    }
+    return success && !returned;
+}
+
+#endif
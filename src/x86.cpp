@@ -0,0 +1,413 @@
+#ifndef X86_CPP
+#define X86_CPP
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "x86.h"
+#include "symbolTable.h"
+#include "ir.h"
+
+struct RegisterNames{
+    const char* q;  //64 bit
+    const char* l;  //32 bit, writing it clears the upper half
+    const char* b;  //low byte
+    uint8_t number; //in the encoding
+};
+
+static const RegisterNames registerNames[X86_REGISTERS] = {
+    {"%rbx", "%ebx", "%bl", 3},
+    {"%rsi", "%esi", "%sil", 6},
+    {"%rdi", "%edi", "%dil", 7},
+    {"%rbp", "%ebp", "%bpl", 5},
+    {"%r8", "%r8d", "%r8b", 8},
+    {"%r9", "%r9d", "%r9b", 9},
+    {"%r10", "%r10d", "%r10b", 10},
+    {"%r11", "%r11d", "%r11b", 11},
+    {"%r12", "%r12d", "%r12b", 12},
+    {"%r13", "%r13d", "%r13b", 13},
+    {"%r14", "%r14d", "%r14b", 14},
+    {"%r15", "%r15d", "%r15b", 15},
+    {"%rax", "%eax", "%al", 0},
+    {"%rcx", "%ecx", "%cl", 1},
+    {"%rdx", "%edx", "%dl", 2},
+};
+
+Operand regOperand(uint8_t reg, uint8_t size){
+    Operand operand;
+    operand.kind = OperandKind::reg;
+    operand.reg = reg;
+    operand.size = size;
+    return operand;
+}
+
+Operand immOperand(int64_t value){
+    Operand operand;
+    operand.kind = OperandKind::imm;
+    operand.value = value;
+    return operand;
+}
+
+Operand variableOperand(uint32_t symbol, int64_t offset){
+    Operand operand;
+    operand.kind = OperandKind::variable;
+    operand.id = symbol;
+    operand.value = offset;
+    return operand;
+}
+
+Operand slotOperand(uint32_t slot){
+    Operand operand;
+    operand.kind = OperandKind::slot;
+    operand.value = (int64_t)slot * 8;
+    return operand;
+}
+
+Operand baseOperand(uint8_t base, int64_t offset, uint8_t index){
+    Operand operand;
+    operand.kind = OperandKind::base;
+    operand.reg = base;
+    operand.index = index;
+    operand.value = offset;
+    return operand;
+}
+
+Operand labelOperand(uint32_t label){
+    Operand operand;
+    operand.kind = OperandKind::label;
+    operand.id = label;
+    return operand;
+}
+
+static void printOffset(std::string& text, int64_t value){
+    if(value != 0){
+        text += '+';
+        text += std::to_string(value);
+    }
+}
+
+static void printOperand(std::string& text, const Operand& operand){
+    switch(operand.kind){
+        case OperandKind::reg:
+            text += operand.size == 8 ? registerNames[operand.reg].q : operand.size == 4 ? registerNames[operand.reg].l : registerNames[operand.reg].b;
+            return;
+        case OperandKind::imm:
+            text += '$';
+            text += std::to_string(operand.value);
+            return;
+        case OperandKind::variable:
+            text += "v_";
+            text += globalSymbols().name(operand.id);
+            printOffset(text, operand.value);
+            text += "(%rip)";
+            return;
+        case OperandKind::slot:
+            text += "nico_slots";
+            printOffset(text, operand.value);
+            text += "(%rip)";
+            return;
+        case OperandKind::base:
+            if(operand.value != 0){ text += std::to_string(operand.value); }
+            text += '(';
+            text += registerNames[operand.reg].q;
+            if(operand.index != UINT8_MAX){
+                text += ',';
+                text += registerNames[operand.index].q;
+                text += ",8";
+            }
+            text += ')';
+            return;
+        case OperandKind::label:
+            text += ".L";
+            text += std::to_string(operand.id);
+            return;
+        case OperandKind::none:
+            return;
+    }
+}
+
+void printX86(std::string& text, const X86Inst& in){
+    if(in.op == X86Op::LABEL){
+        printOperand(text, in.dst);
+        text += ":\n";
+        return;
+    }
+    if(in.op == X86Op::EXIT){
+        text += "    mov $60, %eax\n    syscall\n";
+        return;
+    }
+    text += "    ";
+    text += X86OpStrings[(int)in.op];
+    if(in.op == X86Op::MOVZB){
+        text += 'l';
+    } else if(in.dst.kind != OperandKind::reg && in.src.kind != OperandKind::reg && in.dst.kind != OperandKind::label && in.dst.kind != OperandKind::none){
+        //nothing else gives the operand size
+        text += 'q';
+    }
+    if(in.src.kind != OperandKind::none){
+        text += ' ';
+        printOperand(text, in.src);
+        text += ',';
+        if(in.op == X86Op::IMUL && in.src.kind == OperandKind::imm){
+            text += ' ';
+            printOperand(text, in.dst);
+            text += ',';
+        }
+    }
+    if(in.dst.kind != OperandKind::none){
+        text += ' ';
+        printOperand(text, in.dst);
+    }
+    text += '\n';
+}
+
+static bool fitsImm8(int64_t value){
+    return value >= INT8_MIN && value <= INT8_MAX;
+}
+
+static void put32(std::vector<uint8_t>& bytes, uint32_t value){
+    for(int k = 0; k < 4; k++){
+        bytes.push_back((uint8_t)(value >> (8 * k)));
+    }
+}
+
+/*
+an instruction with a modrm byte: an optional rex prefix, the opcode,
+then reg in the reg field and rm as register or memory operand. reg is
+a register number in the encoding, or the opcode extension of /digit
+forms. sil, dil, bpl and spl need a rex prefix to be told from the high
+byte registers
+*/
+static void encodeModRM(MachineCode* code, bool wide, std::initializer_list<uint8_t> opcode, uint8_t reg, const Operand& rm){
+    std::vector<uint8_t>& bytes = code->bytes;
+    uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg >> 3) << 2;
+    bool forceRex = false;
+    uint8_t base = 0;
+    if(rm.kind == OperandKind::reg){
+        base = registerNames[rm.reg].number;
+        forceRex = rm.size == 1 && base >= 4 && base < 8;
+        rex |= base >> 3;
+    } else if(rm.kind == OperandKind::base){
+        base = registerNames[rm.reg].number;
+        rex |= base >> 3;
+        if(rm.index != UINT8_MAX){
+            rex |= (registerNames[rm.index].number >> 3) << 1;
+        }
+    }
+    if(rex != 0x40 || forceRex){
+        bytes.push_back(rex);
+    }
+    bytes.insert(bytes.end(), opcode);
+
+    reg = (reg & 7) << 3;
+    if(rm.kind == OperandKind::reg){
+        bytes.push_back(0xC0 | reg | (base & 7));
+        return;
+    }
+    if(rm.kind != OperandKind::base){
+        //rip relative
+        bytes.push_back(0x05 | reg);
+        code->fixups.push_back({(uint32_t)bytes.size(), 0, rm});
+        put32(bytes, 0);
+        return;
+    }
+    //rbp and r13 as base always take a displacement, rsp and r12 need a sib byte
+    uint8_t mod = rm.value == 0 && (base & 7) != 5 ? 0x00 : fitsImm8(rm.value) ? 0x40 : 0x80;
+    if(rm.index != UINT8_MAX){
+        bytes.push_back(mod | reg | 4);
+        bytes.push_back(0xC0 | (registerNames[rm.index].number & 7) << 3 | (base & 7));
+    } else if((base & 7) == 4){
+        bytes.push_back(mod | reg | 4);
+        bytes.push_back(0x24);
+    } else {
+        bytes.push_back(mod | reg | (base & 7));
+    }
+    if(mod == 0x40){
+        bytes.push_back((uint8_t)rm.value);
+    } else if(mod == 0x80){
+        put32(bytes, (uint32_t)rm.value);
+    }
+}
+
+static void encodeJump(MachineCode* code, std::initializer_list<uint8_t> opcode, uint32_t label){
+    code->bytes.insert(code->bytes.end(), opcode);
+    code->fixups.push_back({(uint32_t)code->bytes.size(), 0, labelOperand(label)});
+    put32(code->bytes, 0);
+}
+
+//the /digit of the immediate forms, the register forms are digit*8+1 and digit*8+3
+static uint8_t aluDigit(X86Op op){
+    switch(op){
+        case X86Op::ADD: return 0;
+        case X86Op::OR: return 1;
+        case X86Op::AND: return 4;
+        case X86Op::SUB: return 5;
+        case X86Op::XOR: return 6;
+        default: return 7;
+    }
+}
+
+//condition codes of setcc and jcc
+static uint8_t condition(X86Op op){
+    switch(op){
+        case X86Op::SETE: case X86Op::JZ: return 0x4;
+        case X86Op::SETNE: case X86Op::JNZ: return 0x5;
+        case X86Op::JBE: return 0x6;
+        case X86Op::SETL: return 0xC;
+        case X86Op::SETGE: return 0xD;
+        case X86Op::SETLE: return 0xE;
+        default: return 0xF;
+    }
+}
+
+static uint8_t number(const Operand& operand){
+    return registerNames[operand.reg].number;
+}
+
+void MachineCode::begin(uint32_t _exitLabel){
+    exitLabel = _exitLabel;
+    //push rbx, rbp, r12-r15
+    bytes.insert(bytes.end(), {0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});
+}
+
+void MachineCode::encode(const X86Inst& in){
+    size_t firstFixup = fixups.size();
+    const Operand& dst = in.dst;
+    const Operand& src = in.src;
+    bool wide = dst.size == 8;
+    switch(in.op){
+        case X86Op::MOV:
+            if(src.kind == OperandKind::imm && dst.kind == OperandKind::reg && dst.size == 4){
+                if(number(dst) >= 8){ bytes.push_back(0x41); }
+                bytes.push_back(0xB8 | (number(dst) & 7));
+                put32(bytes, (uint32_t)src.value);
+            } else if(src.kind == OperandKind::imm){
+                encodeModRM(this, true, {0xC7}, 0, dst);
+                put32(bytes, (uint32_t)src.value);
+            } else if(src.kind == OperandKind::reg){
+                encodeModRM(this, true, {0x89}, number(src), dst);
+            } else {
+                encodeModRM(this, true, {0x8B}, number(dst), src);
+            }
+            break;
+        case X86Op::MOVABS:
+            bytes.push_back(number(dst) >= 8 ? 0x49 : 0x48);
+            bytes.push_back(0xB8 | (number(dst) & 7));
+            put32(bytes, (uint32_t)src.value);
+            put32(bytes, (uint32_t)((uint64_t)src.value >> 32));
+            break;
+        case X86Op::LEA:
+            encodeModRM(this, true, {0x8D}, number(dst), src);
+            break;
+        case X86Op::ADD: case X86Op::SUB: case X86Op::AND: case X86Op::OR: case X86Op::XOR: case X86Op::CMP: {
+            uint8_t digit = aluDigit(in.op);
+            if(src.kind == OperandKind::imm && fitsImm8(src.value)){
+                encodeModRM(this, wide, {0x83}, digit, dst);
+                bytes.push_back((uint8_t)src.value);
+            } else if(src.kind == OperandKind::imm){
+                encodeModRM(this, wide, {0x81}, digit, dst);
+                put32(bytes, (uint32_t)src.value);
+            } else if(src.kind == OperandKind::reg){
+                encodeModRM(this, wide, {(uint8_t)(digit * 8 + 1)}, number(src), dst);
+            } else {
+                encodeModRM(this, wide, {(uint8_t)(digit * 8 + 3)}, number(dst), src);
+            }
+            break;
+        }
+        case X86Op::IMUL:
+            if(src.kind == OperandKind::imm && fitsImm8(src.value)){
+                encodeModRM(this, true, {0x6B}, number(dst), dst);
+                bytes.push_back((uint8_t)src.value);
+            } else if(src.kind == OperandKind::imm){
+                encodeModRM(this, true, {0x69}, number(dst), dst);
+                put32(bytes, (uint32_t)src.value);
+            } else {
+                encodeModRM(this, true, {0x0F, 0xAF}, number(dst), src);
+            }
+            break;
+        case X86Op::TEST:
+            encodeModRM(this, true, {0x85}, number(src), dst);
+            break;
+        case X86Op::SHL: case X86Op::SAR: {
+            uint8_t digit = in.op == X86Op::SHL ? 4 : 7;
+            if(src.kind == OperandKind::imm){
+                encodeModRM(this, true, {0xC1}, digit, dst);
+                bytes.push_back((uint8_t)src.value);
+            } else {
+                encodeModRM(this, true, {0xD3}, digit, dst);
+            }
+            break;
+        }
+        case X86Op::NEG:
+            encodeModRM(this, true, {0xF7}, 3, dst);
+            break;
+        case X86Op::IDIV:
+            encodeModRM(this, true, {0xF7}, 7, dst);
+            break;
+        case X86Op::CQO:
+            bytes.insert(bytes.end(), {0x48, 0x99});
+            break;
+        case X86Op::SETE: case X86Op::SETNE: case X86Op::SETL: case X86Op::SETG: case X86Op::SETLE: case X86Op::SETGE:
+            encodeModRM(this, false, {0x0F, (uint8_t)(0x90 | condition(in.op))}, 0, dst);
+            break;
+        case X86Op::MOVZB:
+            encodeModRM(this, false, {0x0F, 0xB6}, number(dst), src);
+            break;
+        case X86Op::JMP:
+            encodeJump(this, {0xE9}, dst.id);
+            break;
+        case X86Op::JZ: case X86Op::JNZ: case X86Op::JBE:
+            encodeJump(this, {0x0F, (uint8_t)(0x80 | condition(in.op))}, dst.id);
+            break;
+        case X86Op::EXIT:
+            encodeJump(this, {0xE9}, exitLabel);
+            break;
+        case X86Op::LABEL:
+            if(dst.id >= labels.size()){
+                labels.resize(dst.id + 1, UINT32_MAX);
+            }
+            labels[dst.id] = (uint32_t)bytes.size();
+            break;
+    }
+    for(size_t k = firstFixup; k < fixups.size(); k++){
+        fixups[k].end = (uint32_t)bytes.size();
+    }
+}
+
+bool MachineCode::link(uint32_t slots, const std::vector<uint8_t>& used, std::string& err_s){
+    encode({X86Op::LABEL, labelOperand(exitLabel), {}});
+    //mov %rdi, %rax, pop r15-r12, rbp, rbx, ret
+    bytes.insert(bytes.end(), {0x48, 0x89, 0xF8, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3});
+
+    const uint64_t page = 4096;
+    dataStart = (bytes.size() + page - 1) / page * page;
+    dataSize = (uint64_t)slots * 8;
+    std::vector<uint64_t> variables(used.size(), 0);
+    for(size_t symbol = 0; symbol < used.size(); symbol++){
+        if(!used[symbol]){ continue; }
+        variables[symbol] = dataSize;
+        dataSize += VARIABLE_CELLS * 8;
+    }
+    for(const Fixup& fixup : fixups){
+        int64_t target;
+        if(fixup.target.kind == OperandKind::label){
+            target = labels[fixup.target.id];
+        } else if(fixup.target.kind == OperandKind::slot){
+            target = dataStart + fixup.target.value;
+        } else {
+            target = dataStart + variables[fixup.target.id] + fixup.target.value;
+        }
+        int64_t displacement = target - fixup.end;
+        if(displacement < INT32_MIN || displacement > INT32_MAX){
+            err_s = "program too large for 32 bit displacements";
+            return false;
+        }
+        uint32_t value = (uint32_t)displacement;
+        std::memcpy(&bytes[fixup.at], &value, 4);
+    }
+    fixups.clear();
+    return true;
+}
+
+#endif